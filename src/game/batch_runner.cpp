@@ -0,0 +1,315 @@
+#include "game/batch_runner.h"
+#include "game/game_state.h"
+#include "internal/common.h"
+#include "internal/job_system.h"
+#include "internal/memory.h"
+#include "platform_sdl/error.h"
+#include "platform_sdl/logger.h"
+#include "platform_sdl/profiler.h"
+#include <SDL.h>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Energy and survivors are sampled this many times, evenly through each run
+static const int kNumCurveSamples = 60;
+// Room for a game with the most characters plus its tick times
+static const int kRunMemSize = 1024*1024*12;
+static const int kMaxSlots = JobSystem::kMaxWorkers + 1;
+
+struct BatchRunResult {
+    Uint32 random_seed;
+    int num_characters;
+    int num_deaths;
+    double total_death_seconds; // Game time of every death added up
+    float player_death_seconds; // Negative if the player lived to the end
+    float tick_ms_mean;
+    float tick_ms_median;
+    float tick_ms_p99;
+    float tick_ms_max;
+    Uint32 checksum;
+    float mean_energy[kNumCurveSamples]; // Of the characters alive at each sample
+    int num_alive[kNumCurveSamples];
+};
+
+// A game in flight, each job system participant runs one at a time
+struct BatchSlot {
+    void* mem;
+    StackAllocator stack_allocator;
+    JobSystem job_system; // No workers, the batch already keeps every core busy
+    GameState* game_state;
+    float* tick_milliseconds;
+    bool alive[GameState::kMaxCharacters];
+    BatchRunResult* result;
+    int num_ticks;
+    float tick_seconds;
+};
+
+static int CompareFloats(const void* a, const void* b) {
+    float val[] = {*(const float*)a, *(const float*)b};
+    return (val[0] > val[1]) - (val[0] < val[1]);
+}
+
+// Loading goes through the one file loader thread, so this runs on the
+// main thread for every game in a wave before any of them start
+static void StartRun(BatchSlot* slot, BatchRunResult* result, Uint32 random_seed,
+                     int num_characters, const BatchSettings& settings, Profiler* profiler,
+                     FileLoadThreadData* file_load_thread_data)
+{
+    slot->stack_allocator.Init(slot->mem, kRunMemSize);
+    StackAllocator* stack_allocator = &slot->stack_allocator;
+    GameState* game_state;
+    game_state = new((GameState*)stack_allocator->Alloc(sizeof(GameState))) GameState();
+    if(!game_state){
+        FormattedError("Error", "Could not alloc memory for batch game state");
+        exit(1);
+    }
+    game_state->job_system = &slot->job_system;
+    game_state->num_characters = num_characters;
+    game_state->random_seed = random_seed;
+    game_state->headless = true;
+    int init_stage = 0;
+    while(init_stage != -1) {
+        game_state->Init(&init_stage, NULL, NULL, profiler,
+                         file_load_thread_data, stack_allocator);
+    }
+    slot->tick_milliseconds = (float*)stack_allocator->Alloc(settings.num_ticks * sizeof(float));
+    if(!slot->tick_milliseconds){
+        FormattedError("Error", "Could not alloc memory for %d tick times", settings.num_ticks);
+        exit(1);
+    }
+    memset(result, 0, sizeof(*result));
+    result->random_seed = random_seed;
+    result->num_characters = num_characters;
+    result->player_death_seconds = -1.0f;
+    slot->game_state = game_state;
+    slot->result = result;
+    slot->num_ticks = settings.num_ticks;
+    slot->tick_seconds = 1.0f / settings.ticks_per_second;
+}
+
+static void SampleCurves(const GameState& game_state, BatchRunResult* result, int sample) {
+    int num_alive = 0;
+    float total_energy = 0.0f;
+    for(int i=0; i<game_state.num_characters; ++i){
+        if(game_state.characters[i].exists){
+            ++num_alive;
+            total_energy += game_state.bodies.energy[i];
+        }
+    }
+    result->num_alive[sample] = num_alive;
+    result->mean_energy[sample] = num_alive ? total_energy / num_alive : 0.0f;
+}
+
+static void SimulateRun(BatchSlot* slot) {
+    GameState* game_state = slot->game_state;
+    BatchRunResult* result = slot->result;
+    int num_characters = game_state->num_characters;
+    int num_ticks = slot->num_ticks;
+    for(int i=0; i<num_characters; ++i){
+        slot->alive[i] = game_state->characters[i].exists;
+    }
+    double total_milliseconds = 0.0;
+    int sample = 0;
+    for(int tick=0; tick<num_ticks; ++tick){
+        SimulationInput input;
+        GetScriptedInput(tick, slot->tick_seconds, &input);
+        Uint64 start = SDL_GetPerformanceCounter();
+        game_state->Update(input, slot->tick_seconds);
+        Uint64 end = SDL_GetPerformanceCounter();
+        slot->tick_milliseconds[tick] = (float)((end - start) * 1000.0 /
+                                                (double)SDL_GetPerformanceFrequency());
+        total_milliseconds += slot->tick_milliseconds[tick];
+        for(int i=0; i<num_characters; ++i){
+            if(slot->alive[i] && !game_state->characters[i].exists){
+                slot->alive[i] = false;
+                ++result->num_deaths;
+                result->total_death_seconds += game_state->game_time;
+                if(game_state->characters[i].type == Character::kPlayer){
+                    result->player_death_seconds = (float)game_state->game_time;
+                }
+            }
+        }
+        while(sample < kNumCurveSamples && tick+1 >= (sample+1) * num_ticks / kNumCurveSamples){
+            SampleCurves(*game_state, result, sample);
+            ++sample;
+        }
+    }
+    qsort(slot->tick_milliseconds, num_ticks, sizeof(float), CompareFloats);
+    result->tick_ms_mean = (float)(total_milliseconds / num_ticks);
+    result->tick_ms_median = slot->tick_milliseconds[num_ticks/2];
+    result->tick_ms_p99 = slot->tick_milliseconds[num_ticks*99/100];
+    result->tick_ms_max = slot->tick_milliseconds[num_ticks-1];
+    result->checksum = game_state->CalcChecksum();
+}
+
+static void SimulateRunBatch(void* data, int start, int end) {
+    BatchSlot* slots = (BatchSlot*)data;
+    for(int i=start; i<end; ++i){
+        SimulateRun(&slots[i]);
+    }
+}
+
+static float MeanSecondsToDeath(int num_deaths, double total_death_seconds) {
+    return num_deaths ? (float)(total_death_seconds / num_deaths) : 0.0f;
+}
+
+static void WriteFormatted(SDL_RWops* file, const char* fmt, ...) {
+    static const int kBufSize = 512;
+    char buf[kBufSize];
+    va_list args;
+    va_start(args, fmt);
+    VFormatString(buf, kBufSize, fmt, args);
+    va_end(args);
+    SDL_RWwrite(file, buf, 1, strlen(buf));
+}
+
+static void WriteFloatArray(SDL_RWops* file, const char* name, const float* vals, int count) {
+    WriteFormatted(file, "\"%s\": [", name);
+    for(int i=0; i<count; ++i){
+        WriteFormatted(file, i ? ", %.4f" : "%.4f", vals[i]);
+    }
+    WriteFormatted(file, "]");
+}
+
+static void WriteResults(const char* path, const BatchSettings& settings,
+                         const BatchRunResult* results, int num_runs)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "w");
+    if(!file){
+        LogMessage(kLogError, "Could not open %s to write batch results: %s", path, SDL_GetError());
+        return;
+    }
+    float tick_seconds = 1.0f / settings.ticks_per_second;
+    float sample_seconds[kNumCurveSamples];
+    for(int i=0; i<kNumCurveSamples; ++i){
+        int sample_ticks = max(1, (i+1) * settings.num_ticks / kNumCurveSamples);
+        sample_seconds[i] = sample_ticks * tick_seconds;
+    }
+    WriteFormatted(file, "{\n  \"ticks\": %d,\n  \"ticks_per_second\": %.2f,\n  ",
+                   settings.num_ticks, settings.ticks_per_second);
+    WriteFloatArray(file, "sample_seconds", sample_seconds, kNumCurveSamples);
+    WriteFormatted(file, ",\n  \"runs\": [\n");
+    for(int i=0; i<num_runs; ++i){
+        const BatchRunResult& run = results[i];
+        float num_alive[kNumCurveSamples];
+        for(int j=0; j<kNumCurveSamples; ++j){
+            num_alive[j] = (float)run.num_alive[j];
+        }
+        WriteFormatted(file, "    {\"seed\": %u, \"characters\": %d, \"checksum\": \"%08x\", "
+                       "\"deaths\": %d, \"mean_seconds_to_death\": %.3f, \"player_death_seconds\": %.3f,\n",
+                       run.random_seed, run.num_characters, run.checksum, run.num_deaths,
+                       MeanSecondsToDeath(run.num_deaths, run.total_death_seconds),
+                       run.player_death_seconds);
+        WriteFormatted(file, "     \"tick_ms\": {\"mean\": %.4f, \"median\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n     ",
+                       run.tick_ms_mean, run.tick_ms_median, run.tick_ms_p99, run.tick_ms_max);
+        WriteFloatArray(file, "mean_energy", run.mean_energy, kNumCurveSamples);
+        WriteFormatted(file, ",\n     ");
+        WriteFloatArray(file, "alive", num_alive, kNumCurveSamples);
+        WriteFormatted(file, i+1 < num_runs ? "},\n" : "}\n");
+    }
+    WriteFormatted(file, "  ],\n  \"aggregate\": [\n");
+    // Runs are grouped by character count, num_seeds of them each
+    for(int i=0; i<settings.num_character_counts; ++i){
+        const BatchRunResult* group = &results[i * settings.num_seeds];
+        int num_group_runs = settings.num_seeds;
+        int num_deaths = 0;
+        double total_death_seconds = 0.0;
+        int num_player_deaths = 0;
+        double total_player_death_seconds = 0.0;
+        double tick_ms_mean = 0.0, tick_ms_median = 0.0, tick_ms_p99 = 0.0;
+        float tick_ms_max = 0.0f;
+        float mean_energy[kNumCurveSamples] = {0.0f};
+        float mean_alive[kNumCurveSamples] = {0.0f};
+        for(int j=0; j<num_group_runs; ++j){
+            const BatchRunResult& run = group[j];
+            num_deaths += run.num_deaths;
+            total_death_seconds += run.total_death_seconds;
+            if(run.player_death_seconds >= 0.0f){
+                ++num_player_deaths;
+                total_player_death_seconds += run.player_death_seconds;
+            }
+            tick_ms_mean += run.tick_ms_mean / num_group_runs;
+            tick_ms_median += run.tick_ms_median / num_group_runs;
+            tick_ms_p99 += run.tick_ms_p99 / num_group_runs;
+            tick_ms_max = max(tick_ms_max, run.tick_ms_max);
+            for(int k=0; k<kNumCurveSamples; ++k){
+                mean_energy[k] += run.mean_energy[k] / num_group_runs;
+                mean_alive[k] += (float)run.num_alive[k] / num_group_runs;
+            }
+        }
+        float mean_seconds_to_death = MeanSecondsToDeath(num_deaths, total_death_seconds);
+        float mean_player_death_seconds = MeanSecondsToDeath(num_player_deaths, total_player_death_seconds);
+        WriteFormatted(file, "    {\"characters\": %d, \"runs\": %d, \"mean_deaths\": %.2f, "
+                       "\"mean_seconds_to_death\": %.3f, \"player_deaths\": %d, \"mean_player_death_seconds\": %.3f,\n",
+                       group[0].num_characters, num_group_runs, (float)num_deaths / num_group_runs,
+                       mean_seconds_to_death, num_player_deaths, mean_player_death_seconds);
+        WriteFormatted(file, "     \"tick_ms\": {\"mean\": %.4f, \"median\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n     ",
+                       tick_ms_mean, tick_ms_median, tick_ms_p99, tick_ms_max);
+        WriteFloatArray(file, "mean_energy", mean_energy, kNumCurveSamples);
+        WriteFormatted(file, ",\n     ");
+        WriteFloatArray(file, "mean_alive", mean_alive, kNumCurveSamples);
+        WriteFormatted(file, i+1 < settings.num_character_counts ? "},\n" : "}\n");
+        LogMessage(kLogInfo, "Batch: %d characters over %d seeds, %.2f deaths at %.2f s on average, "
+                   "player died in %d, tick ms mean %.3f, 99th percentile %.3f, max %.3f",
+                   group[0].num_characters, num_group_runs, (float)num_deaths / num_group_runs,
+                   mean_seconds_to_death, num_player_deaths, tick_ms_mean, tick_ms_p99, tick_ms_max);
+    }
+    WriteFormatted(file, "  ]\n}\n");
+    SDL_RWclose(file);
+    LogMessage(kLogInfo, "Batch: wrote results to %s", path);
+}
+
+void RunBatch(const BatchSettings& settings, Profiler* profiler,
+              FileLoadThreadData* file_load_thread_data, JobSystem* job_system)
+{
+    int num_runs = settings.num_seeds * settings.num_character_counts;
+    BatchRunResult* results = (BatchRunResult*)malloc(num_runs * sizeof(BatchRunResult));
+    if(!results){
+        FormattedError("Malloc failed", "Could not allocate memory for %d batch results", num_runs);
+        exit(1);
+    }
+    static BatchSlot slots[kMaxSlots]; // Too big for the stack
+    int num_slots = min(job_system->num_workers + 1, num_runs);
+    for(int i=0; i<num_slots; ++i){
+        slots[i].mem = malloc(kRunMemSize);
+        if(!slots[i].mem){
+            FormattedError("Malloc failed", "Could not allocate memory for batch games");
+            exit(1);
+        }
+        slots[i].job_system.Init(0);
+    }
+    LogMessage(kLogInfo, "Batch: running %d games of %d ticks, %d at a time",
+               num_runs, settings.num_ticks, num_slots);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int first_run=0; first_run<num_runs; first_run+=num_slots){
+        int num_wave_runs = min(num_slots, num_runs - first_run);
+        profiler->StartEvent("Batch setup");
+        for(int i=0; i<num_wave_runs; ++i){
+            int run = first_run + i;
+            Uint32 random_seed = settings.first_seed + run % settings.num_seeds;
+            int num_characters = settings.character_counts[run / settings.num_seeds];
+            StartRun(&slots[i], &results[run], random_seed, num_characters, settings,
+                     profiler, file_load_thread_data);
+        }
+        profiler->EndEvent();
+        profiler->StartEvent("Batch simulate");
+        job_system->ParallelFor(SimulateRunBatch, slots, num_wave_runs, 1);
+        profiler->EndEvent();
+        profiler->MarkFrame();
+        for(int i=0; i<num_wave_runs; ++i){
+            const BatchRunResult& run = results[first_run + i];
+            LogMessage(kLogInfo, "Batch: seed %u, %d characters, %d deaths, tick ms mean %.3f, checksum %08x",
+                       run.random_seed, run.num_characters, run.num_deaths, run.tick_ms_mean, run.checksum);
+        }
+    }
+    double seconds = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+    LogMessage(kLogInfo, "Batch: finished %d games in %.1f s", num_runs, seconds);
+    WriteResults(settings.output_path, settings, results, num_runs);
+    for(int i=0; i<num_slots; ++i){
+        slots[i].job_system.Dispose();
+        free(slots[i].mem);
+    }
+    free(results);
+}
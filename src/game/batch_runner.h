@@ -0,0 +1,30 @@
+#pragma once
+#ifndef GAME_BATCH_RUNNER_H
+#define GAME_BATCH_RUNNER_H
+
+#include <SDL.h>
+
+class JobSystem;
+class Profiler;
+class FileLoadThreadData;
+
+struct BatchSettings {
+    static const int kMaxCharacterCounts = 16;
+    int num_seeds; // Seeds first_seed, first_seed+1, ... are each run at every character count
+    Uint32 first_seed;
+    int num_character_counts;
+    int character_counts[kMaxCharacterCounts];
+    int num_ticks;
+    float ticks_per_second;
+    const char* output_path; // Per-run and aggregate results are written here as JSON
+};
+
+// Run many independent headless games with scripted input, one per job
+// system participant at a time, and report how long characters lived, their
+// energy over time and what each tick cost. Every game has its own memory
+// and runs its characters on one thread, so its results only depend on its
+// seed and character count.
+void RunBatch(const BatchSettings& settings, Profiler* profiler,
+              FileLoadThreadData* file_load_thread_data, JobSystem* job_system);
+
+#endif
@@ -0,0 +1,498 @@
+#include "game/character_benchmark.h"
+#include "game/character_movement.h"
+#include "game/nav_mesh.h"
+#include "game/nav_flow_field.h"
+#include "game/nav_path.h"
+#include "internal/job_system.h"
+#include "internal/memory.h"
+#include "platform_sdl/error.h"
+#include "platform_sdl/logger.h"
+#include "glm/glm.hpp"
+#include <SDL.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace glm;
+
+// Square grid of quads, two triangles each
+static const int kGridSize = 70;
+static const int kWarmupTicks = 10;
+static const int kTimedTicks = 100;
+static const float kTimeStep = 1.0f / 60.0f;
+
+static void BuildGridNavMesh(NavMesh* nav, StackAllocator* stack_allocator) {
+    nav->AllocMemory((kGridSize+1)*(kGridSize+1), kGridSize*kGridSize*2, stack_allocator);
+    for(int z=0; z<=kGridSize; ++z){
+        for(int x=0; x<=kGridSize; ++x){
+            nav->verts[nav->num_verts++] = vec3((float)x, 0.0f, (float)z);
+        }
+    }
+    // Quad q has triangles 2q = (a,b,c) and 2q+1 = (a,c,d), wound so edge 
+    // planes face outward. Edge e of a triangle runs from vert e to vert e+1.
+    for(int z=0; z<kGridSize; ++z){
+        for(int x=0; x<kGridSize; ++x){
+            Uint32 a = z*(kGridSize+1)+x;
+            Uint32 b = a+1;
+            Uint32 c = a+kGridSize+2;
+            Uint32 d = a+kGridSize+1;
+            Uint32 quad_indices[] = {a, b, c, a, c, d};
+            for(int i=0; i<6; ++i){
+                nav->indices[nav->num_indices++] = quad_indices[i];
+            }
+            int quad = z*kGridSize+x;
+            int* lower = &nav->tri_neighbors[quad*6];
+            int* upper = &nav->tri_neighbors[quad*6+3];
+            lower[0] = z>0 ? ((quad-kGridSize)*2+1)*3+1 : -1;
+            lower[1] = x<kGridSize-1 ? ((quad+1)*2+1)*3+2 : -1;
+            lower[2] = (quad*2+1)*3+0;
+            upper[0] = (quad*2)*3+2;
+            upper[1] = z<kGridSize-1 ? ((quad+kGridSize)*2)*3+0 : -1;
+            upper[2] = x>0 ? ((quad-1)*2)*3+1 : -1;
+        }
+    }
+    nav->CalcPlanes(stack_allocator);
+}
+
+static int GridTriContaining(float x, float z) {
+    int cell_x = (int)x;
+    int cell_z = (int)z;
+    int quad = cell_z*kGridSize+cell_x;
+    return (x - cell_x >= z - cell_z) ? quad*2 : quad*2+1;
+}
+
+static double Milliseconds(Uint64 counter) {
+    return counter * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static const int kNumFloatArrays = 12;
+// Same batch size as the game, see GameState::Update
+static const int kBatchSize = 64;
+
+// Carve the arrays for count characters out of mem and scatter them over the grid
+static void SetupCrowd(void* mem, int count, CharacterMovement* movement, float* target[3]) {
+    float* arrays[kNumFloatArrays];
+    for(int i=0; i<kNumFloatArrays; ++i){
+        arrays[i] = (float*)mem + i*count;
+    }
+    movement->count = count;
+    movement->pos_x = arrays[0];
+    movement->pos_y = arrays[1];
+    movement->pos_z = arrays[2];
+    movement->vel_x = arrays[3];
+    movement->vel_y = arrays[4];
+    movement->vel_z = arrays[5];
+    movement->rotation = arrays[6];
+    movement->walk_cycle_frame = arrays[7];
+    float* turn_speed = arrays[8];
+    movement->turn_speed = turn_speed;
+    for(int i=0; i<3; ++i){
+        target[i] = arrays[9+i];
+    }
+    movement->target_x = target[0];
+    movement->target_y = target[1];
+    movement->target_z = target[2];
+    movement->nav_tri = (int*)((float*)mem + kNumFloatArrays*count);
+
+    srand(1);
+    for(int i=0; i<count; ++i){
+        float x = (rand() % (kGridSize*100)) / 100.0f;
+        float z = (rand() % (kGridSize*100)) / 100.0f;
+        movement->pos_x[i] = x;
+        movement->pos_y[i] = 0.0f;
+        movement->pos_z[i] = z;
+        movement->vel_x[i] = 0.0f;
+        movement->vel_y[i] = 0.0f;
+        movement->vel_z[i] = 0.0f;
+        movement->rotation[i] = 0.0f;
+        movement->walk_cycle_frame[i] = (float)CharacterMovement::kWalkCycleStart;
+        turn_speed[i] = 5.0f;
+        movement->nav_tri[i] = GridTriContaining(x, z);
+    }
+}
+
+// Wander like the AI does, with new directions every second or so
+static void RerollTargets(int tick, int count, float* target[3]) {
+    if(tick % 60 == 0){
+        for(int i=0; i<count; ++i){
+            float angle = (rand() % 628) / 100.0f;
+            target[0][i] = cosf(angle) * 0.5f;
+            target[1][i] = 0.0f;
+            target[2][i] = sinf(angle) * 0.5f;
+        }
+    }
+}
+
+struct MoveBatchData {
+    CharacterMovement movement;
+    const NavMesh* nav;
+};
+
+static void MoveBatch(void* data, int start, int end) {
+    MoveBatchData* move_data = (MoveBatchData*)data;
+    CharacterMovement slice = move_data->movement.Slice(start, end);
+    IntegrateCharacterVelocities(slice, kTimeStep);
+    ConstrainCharactersToNavMesh(slice, *move_data->nav);
+    AdvanceCharacterWalkCycles(slice, kTimeStep);
+}
+
+static void TurnBatch(void* data, int start, int end) {
+    MoveBatchData* move_data = (MoveBatchData*)data;
+    TurnCharactersTowardVelocities(move_data->movement.Slice(start, end), kTimeStep);
+}
+
+static void BenchmarkCrowd(const NavMesh& nav, int count, JobSystem* job_system) {
+    int mem_size = count * (kNumFloatArrays * sizeof(float) + sizeof(int));
+    void* mem[2] = {malloc(mem_size), malloc(mem_size)};
+    if(!mem[0] || !mem[1]){
+        FormattedError("Malloc failed", "Could not allocate %d benchmark characters", count);
+        exit(1);
+    }
+
+    // One thread, timing each pass separately
+    CharacterMovement movement;
+    float* target[3];
+    SetupCrowd(mem[0], count, &movement, target);
+    static const int kNumPasses = 4;
+    static const char* pass_names[kNumPasses] = {"integrate", "nav mesh", "walk cycle", "turn"};
+    Uint64 pass_counters[kNumPasses] = {0};
+    for(int tick=0; tick<kWarmupTicks+kTimedTicks; ++tick){
+        RerollTargets(tick, count, target);
+        Uint64 counters[kNumPasses+1];
+        counters[0] = SDL_GetPerformanceCounter();
+        IntegrateCharacterVelocities(movement, kTimeStep);
+        counters[1] = SDL_GetPerformanceCounter();
+        ConstrainCharactersToNavMesh(movement, nav);
+        counters[2] = SDL_GetPerformanceCounter();
+        AdvanceCharacterWalkCycles(movement, kTimeStep);
+        counters[3] = SDL_GetPerformanceCounter();
+        TurnCharactersTowardVelocities(movement, kTimeStep);
+        counters[4] = SDL_GetPerformanceCounter();
+        if(tick >= kWarmupTicks){
+            for(int i=0; i<kNumPasses; ++i){
+                pass_counters[i] += counters[i+1] - counters[i];
+            }
+        }
+    }
+    double total_ns = 0.0;
+    for(int i=0; i<kNumPasses; ++i){
+        double ns = Milliseconds(pass_counters[i]) * 1000000.0 / ((double)kTimedTicks * count);
+        total_ns += ns;
+        LogMessage(kLogInfo, "%d characters: %s %.2f ns per character", count, pass_names[i], ns);
+    }
+    LogMessage(kLogInfo, "%d characters: total %.2f ns per character, %.3f ms per tick", 
+               count, total_ns, total_ns * count / 1000000.0);
+
+    // The same ticks in batches over the job system, which must give the same bits
+    MoveBatchData move_data;
+    SetupCrowd(mem[1], count, &move_data.movement, target);
+    move_data.nav = &nav;
+    Uint64 parallel_counter = 0;
+    for(int tick=0; tick<kWarmupTicks+kTimedTicks; ++tick){
+        RerollTargets(tick, count, target);
+        Uint64 start_counter = SDL_GetPerformanceCounter();
+        job_system->ParallelFor(MoveBatch, &move_data, count, kBatchSize);
+        job_system->ParallelFor(TurnBatch, &move_data, count, kBatchSize);
+        if(tick >= kWarmupTicks){
+            parallel_counter += SDL_GetPerformanceCounter() - start_counter;
+        }
+    }
+    double parallel_ns = Milliseconds(parallel_counter) * 1000000.0 / ((double)kTimedTicks * count);
+    LogMessage(kLogInfo, "%d characters: %d threads %.2f ns per character, %.3f ms per tick, %.2fx, results %s", 
+               count, job_system->num_workers+1, parallel_ns, parallel_ns * count / 1000000.0,
+               total_ns / parallel_ns, memcmp(mem[0], mem[1], mem_size) == 0 ? "match" : "DIFFER");
+    free(mem[0]);
+    free(mem[1]);
+}
+
+// Weld and link a large tiled map put together the way the game builds its
+// nav mesh, with every quad bringing its own copy of its corners
+static void BenchmarkNavBuild(StackAllocator* stack_allocator) {
+    static const int kBuildGridSize = 400;
+    NavMesh nav;
+    nav.AllocMemory(kBuildGridSize*kBuildGridSize*4, kBuildGridSize*kBuildGridSize*2, stack_allocator);
+    for(int z=0; z<kBuildGridSize; ++z){
+        for(int x=0; x<kBuildGridSize; ++x){
+            Uint32 a = nav.num_verts;
+            nav.verts[nav.num_verts++] = vec3((float)x, 0.0f, (float)z);
+            nav.verts[nav.num_verts++] = vec3((float)(x+1), 0.0f, (float)z);
+            nav.verts[nav.num_verts++] = vec3((float)(x+1), 0.0f, (float)(z+1));
+            nav.verts[nav.num_verts++] = vec3((float)x, 0.0f, (float)(z+1));
+            Uint32 quad_indices[] = {a, a+1, a+2, a, a+2, a+3};
+            for(int i=0; i<6; ++i){
+                nav.indices[nav.num_indices++] = quad_indices[i];
+            }
+        }
+    }
+    int num_unwelded_verts = nav.num_verts;
+    Uint64 counters[3];
+    counters[0] = SDL_GetPerformanceCounter();
+    nav.WeldVerts(stack_allocator);
+    counters[1] = SDL_GetPerformanceCounter();
+    nav.CalcNeighbors(stack_allocator);
+    counters[2] = SDL_GetPerformanceCounter();
+    int num_linked = 0;
+    for(int i=0; i<nav.num_indices; ++i){
+        if(nav.tri_neighbors[i] != -1 && nav.tri_neighbors[nav.tri_neighbors[i]] == i){
+            ++num_linked;
+        }
+    }
+    // Every quad's diagonal plus the edges between quads, counted from both sides
+    int expected_linked = 2 * (kBuildGridSize*kBuildGridSize + 2*kBuildGridSize*(kBuildGridSize-1));
+    LogMessage(kLogInfo, "Nav mesh build: %d triangles welded from %d to %d verts (expected %d) in %.2f ms, "
+               "%d of %d shared edges linked in %.2f ms", nav.num_indices/3, num_unwelded_verts,
+               nav.num_verts, (kBuildGridSize+1)*(kBuildGridSize+1), Milliseconds(counters[1] - counters[0]),
+               num_linked, expected_linked, Milliseconds(counters[2] - counters[1]));
+    stack_allocator->Free(nav.tri_neighbors);
+    stack_allocator->Free(nav.indices);
+    stack_allocator->Free(nav.verts);
+}
+
+// Time NavMesh::ClosestTriToPoint on points a little above the middle of
+// random triangles, so the right answer is known
+static void BenchmarkClosestTri(NavMesh* nav, StackAllocator* stack_allocator) {
+    static const int kNumQueries = 100000;
+    nav->BuildTriGrid(stack_allocator);
+    vec3* points = (vec3*)stack_allocator->Alloc(kNumQueries * sizeof(vec3));
+    if(!points){
+        FormattedError("Alloc failed", "Could not allocate %d query points", kNumQueries);
+        exit(1);
+    }
+    srand(2);
+    for(int i=0; i<kNumQueries; ++i){
+        bool upper = rand() % 2 == 0;
+        points[i][0] = (rand() % kGridSize) + (upper ? 0.25f : 0.75f);
+        points[i][1] = 0.5f;
+        points[i][2] = (rand() % kGridSize) + (upper ? 0.75f : 0.25f);
+    }
+    int num_correct = 0;
+    Uint64 start_counter = SDL_GetPerformanceCounter();
+    for(int i=0; i<kNumQueries; ++i){
+        if(nav->ClosestTriToPoint(points[i]) == GridTriContaining(points[i][0], points[i][2])){
+            ++num_correct;
+        }
+    }
+    double us = Milliseconds(SDL_GetPerformanceCounter() - start_counter) * 1000.0 / kNumQueries;
+    LogMessage(kLogInfo, "ClosestTriToPoint: %.3f us per query over %d triangles in a %dx%d grid, "
+               "%d of %d found the triangle below", us, nav->num_indices/3, nav->grid_dims[0], 
+               nav->grid_dims[1], num_correct, kNumQueries);
+    stack_allocator->Free(points);
+}
+
+static vec3 TriCenter(const NavMesh& nav, int tri) {
+    return (nav.verts[nav.indices[tri*3]] + nav.verts[nav.indices[tri*3+1]] +
+            nav.verts[nav.indices[tri*3+2]]) / 3.0f;
+}
+
+// Length of the path through points
+static float PathLength(const vec3* points, int num_points) {
+    float len = 0.0f;
+    for(int i=1; i<num_points; ++i){
+        len += distance(points[i-1], points[i]);
+    }
+    return len;
+}
+
+// Large map crossed by walls every few quads, with gaps now and then, so
+// paths have to wind through them
+static void BuildWalledNavMesh(NavMesh* nav, StackAllocator* stack_allocator) {
+    static const int kWalledGridSize = 200;
+    static const int kWallSpacing = 10;
+    static const int kGapSpacing = 8;
+    nav->AllocMemory(kWalledGridSize*kWalledGridSize*4, kWalledGridSize*kWalledGridSize*2, stack_allocator);
+    for(int z=0; z<kWalledGridSize; ++z){
+        for(int x=0; x<kWalledGridSize; ++x){
+            int gap_offset = (x / kWallSpacing * 7) % kGapSpacing;
+            if(x % kWallSpacing == kWallSpacing - 1 && (z + gap_offset) % kGapSpacing >= 2){
+                continue;
+            }
+            Uint32 a = nav->num_verts;
+            nav->verts[nav->num_verts++] = vec3((float)x, 0.0f, (float)z);
+            nav->verts[nav->num_verts++] = vec3((float)(x+1), 0.0f, (float)z);
+            nav->verts[nav->num_verts++] = vec3((float)(x+1), 0.0f, (float)(z+1));
+            nav->verts[nav->num_verts++] = vec3((float)x, 0.0f, (float)(z+1));
+            Uint32 quad_indices[] = {a, a+1, a+2, a, a+2, a+3};
+            for(int i=0; i<6; ++i){
+                nav->indices[nav->num_indices++] = quad_indices[i];
+            }
+        }
+    }
+    nav->WeldVerts(stack_allocator);
+    nav->CalcNeighbors(stack_allocator);
+}
+
+static int RandomTri(int num_tris) {
+    return (rand() % 1024 * 1024 + rand() % 1024) % num_tris;
+}
+
+// Time NavPathfinder queries on the walled map. Random queries mostly
+// search, then a crowd chasing one goal mostly hits the cache.
+static void BenchmarkNavPaths(const NavMesh& nav, StackAllocator* stack_allocator) {
+    static const int kNumQueries = 4000;
+    static const int kNumCrowdStarts = 256;
+    static const int kMaxPathPoints = 256;
+    NavPathfinder pathfinder;
+    pathfinder.Init(&nav, stack_allocator);
+    int num_tris = nav.num_indices / 3;
+    int* query_tris = (int*)stack_allocator->Alloc(kNumQueries * 2 * sizeof(int));
+    vec3* points = (vec3*)stack_allocator->Alloc(kMaxPathPoints * sizeof(vec3));
+    if(!query_tris || !points){
+        FormattedError("Alloc failed", "Could not allocate %d path queries", kNumQueries);
+        exit(1);
+    }
+    srand(3);
+    for(int i=0; i<kNumQueries*2; ++i){
+        query_tris[i] = RandomTri(num_tris);
+    }
+    // A path can't be shorter than a straight line, or longer than the
+    // line through the middles of the triangles it searched
+    int num_found = 0;
+    int num_in_bounds = 0;
+    int num_points_total = 0;
+    Uint64 start_counter = SDL_GetPerformanceCounter();
+    for(int i=0; i<kNumQueries; ++i){
+        int start_tri = query_tris[i*2];
+        int goal_tri = query_tris[i*2+1];
+        vec3 start = TriCenter(nav, start_tri);
+        vec3 goal = TriCenter(nav, goal_tri);
+        int num_points = pathfinder.FindPath(start, start_tri, goal, goal_tri, points, kMaxPathPoints);
+        if(num_points == 0){
+            continue;
+        }
+        ++num_found;
+        num_points_total += num_points;
+        const int* tris;
+        int num_tris_crossed = pathfinder.FindCorridor(start_tri, goal_tri, &tris);
+        float corridor_len = 0.0f;
+        for(int j=1; j<num_tris_crossed; ++j){
+            corridor_len += distance(TriCenter(nav, tris[j-1]), TriCenter(nav, tris[j]));
+        }
+        float path_len = PathLength(points, num_points);
+        if(path_len >= distance(start, goal) - 0.01f && path_len <= corridor_len + 0.01f){
+            ++num_in_bounds;
+        }
+    }
+    double us = Milliseconds(SDL_GetPerformanceCounter() - start_counter) * 1000.0 / kNumQueries;
+    LogMessage(kLogInfo, "Nav paths: %.2f us per random query over %d triangles (checks included), "
+               "%d of %d found, %d of those within bounds, %.1f corners on average, %d searches",
+               us, num_tris, num_found, kNumQueries, num_in_bounds,
+               num_found ? (float)num_points_total / num_found : 0.0f, pathfinder.num_searches);
+
+    // Every crowd member asks again each frame, the goal's triangle stays put
+    pathfinder.ResetStats();
+    vec3 goal = nav.verts[nav.indices[query_tris[0]*3]];
+    start_counter = SDL_GetPerformanceCounter();
+    for(int i=0; i<kNumQueries; ++i){
+        int start_tri = query_tris[(i % kNumCrowdStarts)*2+1];
+        vec3 start = nav.verts[nav.indices[start_tri*3]];
+        pathfinder.FindPath(start, start_tri, goal, query_tris[0], points, 2);
+    }
+    us = Milliseconds(SDL_GetPerformanceCounter() - start_counter) * 1000.0 / kNumQueries;
+    LogMessage(kLogInfo, "Nav paths: %.2f us per crowd query for the next corner, %d searches for %d queries",
+               us, pathfinder.num_searches, pathfinder.num_queries);
+    stack_allocator->Free(points);
+    stack_allocator->Free(query_tris);
+    pathfinder.Dispose(stack_allocator);
+}
+
+// Time a flow field on the walled map: full rebuilds, a goal walking from
+// triangle to neighboring triangle, and a crowd looking up its waypoints
+static void BenchmarkFlowField(const NavMesh& nav, StackAllocator* stack_allocator) {
+    static const int kNumRebuilds = 20;
+    static const int kNumSteps = 200;
+    static const int kNumAgents = 50000;
+    NavFlowField flow_field;
+    flow_field.Init(&nav, stack_allocator);
+    int num_tris = nav.num_indices / 3;
+    srand(4);
+    // Far apart goals, so each one rebuilds
+    Uint64 start_counter = SDL_GetPerformanceCounter();
+    for(int i=0; i<kNumRebuilds; ++i){
+        int goal_tri = RandomTri(num_tris);
+        flow_field.SetGoal(TriCenter(nav, goal_tri), goal_tri);
+    }
+    double rebuild_ms = Milliseconds(SDL_GetPerformanceCounter() - start_counter) / kNumRebuilds;
+
+    // Step to a random neighbor each time, a full rebuild comes every
+    // kMaxIncrementalUpdates steps
+    start_counter = SDL_GetPerformanceCounter();
+    for(int i=0; i<kNumSteps; ++i){
+        int goal_tri = flow_field.goal_tri;
+        int side = rand()%3;
+        for(int j=0; j<3 && nav.tri_neighbors[goal_tri*3+side] == -1; ++j){
+            side = (side+1)%3;
+        }
+        if(nav.tri_neighbors[goal_tri*3+side] != -1){
+            goal_tri = nav.tri_neighbors[goal_tri*3+side] / 3;
+        }
+        flow_field.SetGoal(TriCenter(nav, goal_tri), goal_tri);
+    }
+    double step_ms = Milliseconds(SDL_GetPerformanceCounter() - start_counter) / kNumSteps;
+
+    // Every triangle that can reach the goal must lead to it without loops
+    int num_reachable = 0;
+    int num_leading = 0;
+    for(int i=0; i<num_tris; ++i){
+        if(i != flow_field.goal_tri && flow_field.next_tri[i] == -1){
+            continue;
+        }
+        ++num_reachable;
+        int tri = i;
+        for(int j=0; j<num_tris && tri != flow_field.goal_tri && tri != -1; ++j){
+            tri = flow_field.next_tri[tri];
+        }
+        if(tri == flow_field.goal_tri){
+            ++num_leading;
+        }
+    }
+
+    int* agent_tris = (int*)stack_allocator->Alloc(kNumAgents * sizeof(int));
+    if(!agent_tris){
+        FormattedError("Alloc failed", "Could not allocate %d flow field agents", kNumAgents);
+        exit(1);
+    }
+    for(int i=0; i<kNumAgents; ++i){
+        agent_tris[i] = RandomTri(num_tris);
+    }
+    vec3 waypoint_sum;
+    start_counter = SDL_GetPerformanceCounter();
+    for(int i=0; i<kNumAgents; ++i){
+        vec3 waypoint;
+        if(flow_field.GetWaypoint(agent_tris[i], &waypoint)){
+            waypoint_sum += waypoint;
+        }
+    }
+    double agent_ns = Milliseconds(SDL_GetPerformanceCounter() - start_counter) * 1000000.0 / kNumAgents;
+    LogMessage(kLogInfo, "Flow field: %.2f ms per rebuild over %d triangles, %.3f ms per step to a neighbor, "
+               "%d of %d reachable triangles lead to the goal, %.1f ns per agent lookup (sum %.0f)",
+               rebuild_ms, num_tris, step_ms, num_leading, num_reachable, agent_ns,
+               waypoint_sum[0] + waypoint_sum[2]);
+    stack_allocator->Free(agent_tris);
+    flow_field.Dispose(stack_allocator);
+}
+
+void RunCharacterMovementBenchmark(JobSystem* job_system) {
+    static const int kMemSize = 1024*1024*48;
+    StackAllocator stack_allocator;
+    stack_allocator.Init(malloc(kMemSize), kMemSize);
+    if(!stack_allocator.mem){
+        FormattedError("Malloc failed", "Could not allocate memory for the benchmark nav meshes");
+        exit(1);
+    }
+    BenchmarkNavBuild(&stack_allocator);
+    NavMesh walled_nav;
+    BuildWalledNavMesh(&walled_nav, &stack_allocator);
+    BenchmarkNavPaths(walled_nav, &stack_allocator);
+    BenchmarkFlowField(walled_nav, &stack_allocator);
+    stack_allocator.Free(walled_nav.tri_neighbors);
+    stack_allocator.Free(walled_nav.indices);
+    stack_allocator.Free(walled_nav.verts);
+    NavMesh nav;
+    BuildGridNavMesh(&nav, &stack_allocator);
+    BenchmarkClosestTri(&nav, &stack_allocator);
+    static const int kCrowdSizes[] = {1000, 10000, 50000};
+    for(int i=0; i<3; ++i){
+        BenchmarkCrowd(nav, kCrowdSizes[i], job_system);
+    }
+    free(stack_allocator.mem);
+}
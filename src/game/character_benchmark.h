@@ -0,0 +1,12 @@
+#pragma once
+#ifndef GAME_CHARACTER_BENCHMARK_H
+#define GAME_CHARACTER_BENCHMARK_H
+
+class JobSystem;
+
+// Time the character movement passes at several crowd sizes on a flat 
+// synthetic nav mesh and log the cost per character per tick, on one thread
+// and then spread over the job system's workers
+void RunCharacterMovementBenchmark(JobSystem* job_system);
+
+#endif
@@ -0,0 +1,310 @@
+#include "game/character_movement.h"
+#include "game/nav_mesh.h"
+#include "glm/glm.hpp"
+#include <SDL.h>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHARACTER_MOVEMENT_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace glm;
+
+const float CharacterMovement::kSpeed = 2.0f;
+const float CharacterMovement::kAcceleration = 10.0f;
+
+static const float kWalkAnimSpeed = 30.0f;
+static const float kPi = 3.14159265f;
+static const float kTwoPi = 6.28318531f;
+static const float kHalfPi = 1.57079633f;
+
+CharacterMovement CharacterMovement::Slice(int start, int end) const {
+    CharacterMovement slice;
+    slice.count = end - start;
+    slice.pos_x = pos_x + start;
+    slice.pos_y = pos_y + start;
+    slice.pos_z = pos_z + start;
+    slice.vel_x = vel_x + start;
+    slice.vel_y = vel_y + start;
+    slice.vel_z = vel_z + start;
+    slice.target_x = target_x + start;
+    slice.target_y = target_y + start;
+    slice.target_z = target_z + start;
+    slice.rotation = rotation + start;
+    slice.turn_speed = turn_speed + start;
+    slice.walk_cycle_frame = walk_cycle_frame + start;
+    slice.nav_tri = nav_tri + start;
+    return slice;
+}
+
+// Each pass has a scalar version of its per-character step, used for the
+// remainder after the SIMD loop and on platforms without SSE2
+
+static void IntegrateVelocity(const CharacterMovement& m, int i, float time_step) {
+    // Velocity can change by at most kAcceleration * time_step per tick
+    float max_change = CharacterMovement::kAcceleration * time_step;
+    float rel_x = m.target_x[i] * CharacterMovement::kSpeed - m.vel_x[i];
+    float rel_y = m.target_y[i] * CharacterMovement::kSpeed - m.vel_y[i];
+    float rel_z = m.target_z[i] * CharacterMovement::kSpeed - m.vel_z[i];
+    float rel_len = sqrtf(rel_x*rel_x + rel_y*rel_y + rel_z*rel_z);
+    if(rel_len > max_change){
+        float scale = max_change / rel_len;
+        rel_x *= scale;
+        rel_y *= scale;
+        rel_z *= scale;
+    }
+    m.vel_x[i] += rel_x;
+    m.vel_y[i] += rel_y;
+    m.vel_z[i] += rel_z;
+    SDL_assert(m.vel_x[i] == m.vel_x[i]);
+    float move_scale = CharacterMovement::kSpeed * time_step;
+    m.pos_x[i] += m.vel_x[i] * move_scale;
+    m.pos_y[i] += m.vel_y[i] * move_scale;
+    m.pos_z[i] += m.vel_z[i] * move_scale;
+}
+
+static void AdvanceWalkCycle(const CharacterMovement& m, int i, float time_step) {
+    float speed = sqrtf(m.vel_x[i]*m.vel_x[i] + m.vel_y[i]*m.vel_y[i] + m.vel_z[i]*m.vel_z[i]);
+    float frame = m.walk_cycle_frame[i] + speed * kWalkAnimSpeed * time_step;
+    while((int)frame > CharacterMovement::kWalkCycleEnd){
+        frame -= (float)(CharacterMovement::kWalkCycleEnd - CharacterMovement::kWalkCycleStart);
+    }
+    while((int)frame < CharacterMovement::kWalkCycleStart){
+        frame += (float)(CharacterMovement::kWalkCycleEnd - CharacterMovement::kWalkCycleStart);
+    }
+    m.walk_cycle_frame[i] = frame;
+}
+
+// Polynomial approximation, within about 1e-5 radians of atan2f. The SSE2
+// version below does the same float operations in the same order, so both
+// give the same angle. Both arguments zero gives zero.
+static float Atan2(float y, float x) {
+    float abs_x = fabsf(x);
+    float abs_y = fabsf(y);
+    float max_abs = max(abs_x, abs_y);
+    float ratio = max_abs > 0.0f ? min(abs_x, abs_y) / max_abs : 0.0f;
+    float sq = ratio * ratio;
+    float poly = -0.0464964749f * sq + 0.15931422f;
+    poly = poly * sq - 0.327622764f;
+    float angle = poly * sq * ratio + ratio;
+    if(abs_y > abs_x){
+        angle = kHalfPi - angle;
+    }
+    if(x < 0.0f){
+        angle = kPi - angle;
+    }
+    if(y < 0.0f){
+        angle = 0.0f - angle;
+    }
+    return angle;
+}
+
+static void TurnTowardVelocity(const CharacterMovement& m, int i, float time_step) {
+    // Only the heading on the ground matters
+    if(m.vel_x[i] == 0.0f && m.vel_z[i] == 0.0f){
+        return;
+    }
+    float target_rotation = kHalfPi - Atan2(m.vel_z[i], m.vel_x[i]);
+    float rel_rotation = target_rotation - m.rotation[i];
+    // Wrap like the SSE2 loop does, multiplying by the reciprocal and
+    // rounding halfway cases to even, so characters in the scalar tail turn
+    // the same way as the rest
+    rel_rotation -= nearbyintf(rel_rotation * (1.0f / kTwoPi)) * kTwoPi;
+    float max_turn = m.turn_speed[i] * time_step;
+    m.rotation[i] += clamp(rel_rotation, -max_turn, max_turn);
+}
+
+#ifdef CHARACTER_MOVEMENT_SSE2
+static __m128 Abs(__m128 val) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), val);
+}
+
+// Where mask is set take a, otherwise b
+static __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Four lanes of the scalar Atan2 above
+static __m128 Atan2(__m128 y, __m128 x) {
+    __m128 abs_x = Abs(x);
+    __m128 abs_y = Abs(y);
+    __m128 max_abs = _mm_max_ps(abs_x, abs_y);
+    // Lanes with both zero divide 0 by 0 here, Select drops them
+    __m128 ratio = Select(_mm_cmpgt_ps(max_abs, _mm_setzero_ps()),
+                          _mm_div_ps(_mm_min_ps(abs_x, abs_y), max_abs), _mm_setzero_ps());
+    __m128 sq = _mm_mul_ps(ratio, ratio);
+    __m128 poly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0464964749f), sq), _mm_set1_ps(0.15931422f));
+    poly = _mm_sub_ps(_mm_mul_ps(poly, sq), _mm_set1_ps(0.327622764f));
+    __m128 angle = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(poly, sq), ratio), ratio);
+    angle = Select(_mm_cmpgt_ps(abs_y, abs_x), _mm_sub_ps(_mm_set1_ps(kHalfPi), angle), angle);
+    angle = Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(kPi), angle), angle);
+    return Select(_mm_cmplt_ps(y, _mm_setzero_ps()), _mm_sub_ps(_mm_setzero_ps(), angle), angle);
+}
+#endif
+
+void IntegrateCharacterVelocities(const CharacterMovement& m, float time_step) {
+    int i = 0;
+#ifdef CHARACTER_MOVEMENT_SSE2
+    __m128 speed = _mm_set1_ps(CharacterMovement::kSpeed);
+    __m128 max_change = _mm_set1_ps(CharacterMovement::kAcceleration * time_step);
+    __m128 move_scale = _mm_set1_ps(CharacterMovement::kSpeed * time_step);
+    for(; i+4<=m.count; i+=4){
+        __m128 vel_x = _mm_loadu_ps(&m.vel_x[i]);
+        __m128 vel_y = _mm_loadu_ps(&m.vel_y[i]);
+        __m128 vel_z = _mm_loadu_ps(&m.vel_z[i]);
+        __m128 rel_x = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&m.target_x[i]), speed), vel_x);
+        __m128 rel_y = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&m.target_y[i]), speed), vel_y);
+        __m128 rel_z = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&m.target_z[i]), speed), vel_z);
+        __m128 rel_len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rel_x, rel_x),
+            _mm_mul_ps(rel_y, rel_y)), _mm_mul_ps(rel_z, rel_z)));
+        // Lanes that are not clamped may divide by zero here, Select drops them
+        __m128 scale = Select(_mm_cmpgt_ps(rel_len, max_change),
+                              _mm_div_ps(max_change, rel_len), _mm_set1_ps(1.0f));
+        vel_x = _mm_add_ps(vel_x, _mm_mul_ps(rel_x, scale));
+        vel_y = _mm_add_ps(vel_y, _mm_mul_ps(rel_y, scale));
+        vel_z = _mm_add_ps(vel_z, _mm_mul_ps(rel_z, scale));
+        _mm_storeu_ps(&m.vel_x[i], vel_x);
+        _mm_storeu_ps(&m.vel_y[i], vel_y);
+        _mm_storeu_ps(&m.vel_z[i], vel_z);
+        _mm_storeu_ps(&m.pos_x[i], _mm_add_ps(_mm_loadu_ps(&m.pos_x[i]), _mm_mul_ps(vel_x, move_scale)));
+        _mm_storeu_ps(&m.pos_y[i], _mm_add_ps(_mm_loadu_ps(&m.pos_y[i]), _mm_mul_ps(vel_y, move_scale)));
+        _mm_storeu_ps(&m.pos_z[i], _mm_add_ps(_mm_loadu_ps(&m.pos_z[i]), _mm_mul_ps(vel_z, move_scale)));
+    }
+#endif
+    for(; i<m.count; ++i){
+        IntegrateVelocity(m, i, time_step);
+    }
+}
+
+void ConstrainCharactersToNavMesh(const CharacterMovement& m, const NavMesh& nav) {
+    for(int char_index=0; char_index<m.count; ++char_index){
+        int* tri = &m.nav_tri[char_index];
+        if(*tri == -1){
+            continue;
+        }
+        vec3 pos(m.pos_x[char_index], m.pos_y[char_index], m.pos_z[char_index]);
+        vec3 velocity(m.vel_x[char_index], m.vel_y[char_index], m.vel_z[char_index]);
+        bool repeat;
+        do {
+            repeat = false;
+            int tri_history[] = {*tri, *tri};
+            vec3 tri_normal(nav.tri_normal_x[*tri], nav.tri_normal_y[*tri], nav.tri_normal_z[*tri]);
+            SDL_assert(tri_normal == tri_normal);
+            float char_norm_d = dot(pos, tri_normal);
+            SDL_assert(pos == pos);
+            pos += tri_normal * (nav.tri_plane_d[*tri] - char_norm_d);
+            SDL_assert(pos == pos);
+            // Edge planes in the order of the verts opposite them
+            for(int i=0; i<3; ++i){
+                int edge = *tri*3+(i+1)%3;
+                vec3 plane_n(nav.edge_normal_x[edge], nav.edge_normal_y[edge], nav.edge_normal_z[edge]);
+                float plane_d = nav.edge_plane_d[edge];
+                float char_d = dot(pos, plane_n);
+                if(char_d > plane_d){
+                    int neighbor = nav.tri_neighbors[edge];
+                    if(neighbor != -1){
+                        // Go to neighboring triangle if possible
+                        tri_history[1] = tri_history[0];
+                        tri_history[0] = *tri;
+                        *tri = neighbor/3;
+                        // Prevent infinite loops
+                        if(*tri != tri_history[0] && *tri != tri_history[1]){
+                            repeat = true;
+                        }
+                        break;
+                    } else {
+                        // Otherwise slide along wall
+                        pos -= plane_n * (char_d - plane_d);
+                        float char_vel_d = dot(velocity, plane_n);
+                        if(char_vel_d > 0.0f){
+                            velocity -= plane_n * (char_vel_d);
+                            SDL_assert(velocity == velocity);
+                        }
+                    }
+                }
+            }
+            SDL_assert(pos == pos);
+        } while(repeat);
+        m.pos_x[char_index] = pos[0];
+        m.pos_y[char_index] = pos[1];
+        m.pos_z[char_index] = pos[2];
+        m.vel_x[char_index] = velocity[0];
+        m.vel_y[char_index] = velocity[1];
+        m.vel_z[char_index] = velocity[2];
+    }
+}
+
+void AdvanceCharacterWalkCycles(const CharacterMovement& m, float time_step) {
+    int i = 0;
+#ifdef CHARACTER_MOVEMENT_SSE2
+    __m128 anim_scale = _mm_set1_ps(kWalkAnimSpeed * time_step);
+    // (int)frame > kWalkCycleEnd is the same as frame >= kWalkCycleEnd+1
+    __m128 cycle_end = _mm_set1_ps((float)(CharacterMovement::kWalkCycleEnd + 1));
+    __m128 cycle_start = _mm_set1_ps((float)CharacterMovement::kWalkCycleStart);
+    __m128 cycle_len = _mm_set1_ps(
+        (float)(CharacterMovement::kWalkCycleEnd - CharacterMovement::kWalkCycleStart));
+    for(; i+4<=m.count; i+=4){
+        __m128 vel_x = _mm_loadu_ps(&m.vel_x[i]);
+        __m128 vel_y = _mm_loadu_ps(&m.vel_y[i]);
+        __m128 vel_z = _mm_loadu_ps(&m.vel_z[i]);
+        __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vel_x, vel_x),
+            _mm_mul_ps(vel_y, vel_y)), _mm_mul_ps(vel_z, vel_z)));
+        __m128 frame = _mm_add_ps(_mm_loadu_ps(&m.walk_cycle_frame[i]), _mm_mul_ps(speed, anim_scale));
+        // Frames only move a little per tick, so these rarely run more than once
+        for(;;){
+            __m128 over = _mm_cmpge_ps(frame, cycle_end);
+            if(!_mm_movemask_ps(over)){
+                break;
+            }
+            frame = _mm_sub_ps(frame, _mm_and_ps(over, cycle_len));
+        }
+        for(;;){
+            __m128 under = _mm_cmplt_ps(frame, cycle_start);
+            if(!_mm_movemask_ps(under)){
+                break;
+            }
+            frame = _mm_add_ps(frame, _mm_and_ps(under, cycle_len));
+        }
+        _mm_storeu_ps(&m.walk_cycle_frame[i], frame);
+    }
+#endif
+    for(; i<m.count; ++i){
+        AdvanceWalkCycle(m, i, time_step);
+    }
+}
+
+void TurnCharactersTowardVelocities(const CharacterMovement& m, float time_step) {
+    int i = 0;
+#ifdef CHARACTER_MOVEMENT_SSE2
+    __m128 half_pi = _mm_set1_ps(kHalfPi);
+    __m128 two_pi = _mm_set1_ps(kTwoPi);
+    __m128 inv_two_pi = _mm_set1_ps(1.0f / kTwoPi);
+    __m128 step = _mm_set1_ps(time_step);
+    for(; i+4<=m.count; i+=4){
+        __m128 vel_x = _mm_loadu_ps(&m.vel_x[i]);
+        __m128 vel_z = _mm_loadu_ps(&m.vel_z[i]);
+        // Only the heading on the ground matters
+        __m128 moving = _mm_or_ps(_mm_cmpneq_ps(vel_x, _mm_setzero_ps()),
+                                  _mm_cmpneq_ps(vel_z, _mm_setzero_ps()));
+        if(!_mm_movemask_ps(moving)){
+            continue;
+        }
+        __m128 rotation = _mm_loadu_ps(&m.rotation[i]);
+        __m128 target_rotation = _mm_sub_ps(half_pi, Atan2(vel_z, vel_x));
+        // Wrap to [-pi, pi] by removing the nearest whole number of turns
+        __m128 rel_rotation = _mm_sub_ps(target_rotation, rotation);
+        __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(rel_rotation, inv_two_pi)));
+        rel_rotation = _mm_sub_ps(rel_rotation, _mm_mul_ps(turns, two_pi));
+        __m128 max_turn = _mm_mul_ps(_mm_loadu_ps(&m.turn_speed[i]), step);
+        rel_rotation = _mm_max_ps(_mm_min_ps(rel_rotation, max_turn),
+                                  _mm_sub_ps(_mm_setzero_ps(), max_turn));
+        // Leave lanes that aren't moving across the ground alone
+        rotation = Select(moving, _mm_add_ps(rotation, rel_rotation), rotation);
+        _mm_storeu_ps(&m.rotation[i], rotation);
+    }
+#endif
+    for(; i<m.count; ++i){
+        TurnTowardVelocity(m, i, time_step);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef GAME_CHARACTER_MOVEMENT_H
+#define GAME_CHARACTER_MOVEMENT_H
+
+class NavMesh;
+
+// Structure-of-arrays view of the per-character fields the movement passes
+// stream through, so each pass only touches the arrays it needs. GameState
+// points this at its CharacterBodies; the benchmark points it at larger
+// arrays. Characters that should stay still need a zero target and velocity,
+// and a nav_tri of -1 skips the nav mesh pass.
+struct CharacterMovement {
+    static const int kWalkCycleStart = 31;
+    static const int kWalkCycleEnd = 58;
+    static const float kSpeed;
+    static const float kAcceleration;
+    int count;
+    float* pos_x;
+    float* pos_y;
+    float* pos_z;
+    float* vel_x;
+    float* vel_y;
+    float* vel_z;
+    const float* target_x; // Desired direction of travel, length <= 1
+    const float* target_y;
+    const float* target_z;
+    float* rotation; // Radians around the Y axis
+    const float* turn_speed; // Radians per second
+    float* walk_cycle_frame;
+    int* nav_tri;
+    // The same arrays offset to cover characters [start, end)
+    CharacterMovement Slice(int start, int end) const;
+};
+
+// Accelerate velocity toward the target direction, then move by it
+void IntegrateCharacterVelocities(const CharacterMovement& movement, float time_step);
+// Walk each character across the nav mesh to its new position, sliding
+// along edges with no neighbor
+void ConstrainCharactersToNavMesh(const CharacterMovement& movement, const NavMesh& nav);
+// Advance the walk animation by distance travelled, wrapping within the cycle
+void AdvanceCharacterWalkCycles(const CharacterMovement& movement, float time_step);
+// Turn each moving character toward its velocity at its turn speed
+void TurnCharactersTowardVelocities(const CharacterMovement& movement, float time_step);
+
+#endif
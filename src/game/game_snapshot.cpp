@@ -0,0 +1,204 @@
+#include "game/game_snapshot.h"
+#include "game/game_state.h"
+#include "internal/memory.h"
+#include "platform_sdl/logger.h"
+#include <SDL.h>
+#include <cstring>
+
+static const Uint32 kSnapshotMagic = 0x53534755; // "UGSS" little endian
+static const Uint32 kSnapshotVersion = 3;
+
+// Leads the snapshot data, restoring needs a GameState that matches it
+struct SnapshotLayout {
+    Uint32 random_seed;
+    int num_characters;
+    int num_nav_verts;
+    int num_nav_indices;
+    int character_size; // Catches snapshots from builds with another layout
+};
+
+struct SnapshotRegion {
+    void* data;
+    int size;
+};
+
+static const int kMaxRegions = 48;
+
+// The parts of game_state that make up the simulation, in snapshot order.
+// The nav mesh is left out: it is built from the level when the GameState is
+// initialized and never changes after, and the layout checks its counts.
+static int GetRegions(GameState* game_state, SnapshotRegion* regions) {
+    int num_regions = 0;
+    int num_characters = game_state->num_characters;
+    int float_bytes = num_characters * sizeof(float);
+    CharacterBodies& bodies = game_state->bodies;
+#define ADD_REGION(region_data, region_size) \
+    regions[num_regions].data = (void*)(region_data); \
+    regions[num_regions].size = (int)(region_size); \
+    ++num_regions;
+    ADD_REGION(game_state->characters, num_characters * sizeof(Character));
+    ADD_REGION(bodies.pos_x, float_bytes);
+    ADD_REGION(bodies.pos_y, float_bytes);
+    ADD_REGION(bodies.pos_z, float_bytes);
+    ADD_REGION(bodies.vel_x, float_bytes);
+    ADD_REGION(bodies.vel_y, float_bytes);
+    ADD_REGION(bodies.vel_z, float_bytes);
+    ADD_REGION(bodies.target_x, float_bytes);
+    ADD_REGION(bodies.target_y, float_bytes);
+    ADD_REGION(bodies.target_z, float_bytes);
+    ADD_REGION(bodies.rotation, float_bytes);
+    ADD_REGION(bodies.turn_speed, float_bytes);
+    ADD_REGION(bodies.walk_cycle_frame, float_bytes);
+    ADD_REGION(bodies.energy, float_bytes);
+    ADD_REGION(bodies.nav_tri, num_characters * sizeof(int));
+    ADD_REGION(bodies.prev_pos_x, float_bytes);
+    ADD_REGION(bodies.prev_pos_y, float_bytes);
+    ADD_REGION(bodies.prev_pos_z, float_bytes);
+    ADD_REGION(bodies.prev_rotation, float_bytes);
+    ADD_REGION(&game_state->camera, sizeof(Camera));
+    ADD_REGION(&game_state->prev_camera, sizeof(Camera));
+    ADD_REGION(&game_state->camera_fov, sizeof(float));
+    ADD_REGION(&game_state->editor_mode, sizeof(bool));
+    ADD_REGION(&game_state->toggle_editor_held, sizeof(bool));
+    ADD_REGION(&game_state->next_inactive_mind, sizeof(int));
+    // Incremental updates make the flow field depend on where the player has been
+    NavFlowField& flow_field = game_state->player_flow_field;
+    ADD_REGION(&flow_field.goal_tri, sizeof(int));
+    ADD_REGION(&flow_field.goal, sizeof(glm::vec3));
+    ADD_REGION(&flow_field.num_incremental_updates, sizeof(int));
+    ADD_REGION(flow_field.cost, flow_field.num_tris * sizeof(float));
+    ADD_REGION(flow_field.next_tri, flow_field.num_tris * sizeof(int));
+    ADD_REGION(flow_field.waypoint, flow_field.num_tris * sizeof(glm::vec3));
+    ADD_REGION(&game_state->num_lights, sizeof(int));
+    ADD_REGION(game_state->light_pos, sizeof(game_state->light_pos));
+    ADD_REGION(game_state->light_color, sizeof(game_state->light_color));
+    ADD_REGION(game_state->light_type, sizeof(game_state->light_type));
+    ADD_REGION(&game_state->fog_color, sizeof(glm::vec3));
+    ADD_REGION(game_state->tile_height, sizeof(game_state->tile_height));
+    ADD_REGION(&game_state->game_time, sizeof(double));
+#undef ADD_REGION
+    SDL_assert(num_regions <= kMaxRegions);
+    return num_regions;
+}
+
+static void GetLayout(const GameState& game_state, SnapshotLayout* layout) {
+    memset(layout, 0, sizeof(*layout));
+    layout->random_seed = game_state.random_seed;
+    layout->num_characters = game_state.num_characters;
+    layout->num_nav_verts = game_state.nav_mesh.num_verts;
+    layout->num_nav_indices = game_state.nav_mesh.num_indices;
+    layout->character_size = sizeof(Character);
+}
+
+int GameSnapshot::CalcSize(const GameState& game_state) {
+    SnapshotRegion regions[kMaxRegions];
+    int num_regions = GetRegions(const_cast<GameState*>(&game_state), regions);
+    int total = sizeof(SnapshotLayout);
+    for(int i=0; i<num_regions; ++i){
+        total += regions[i].size;
+    }
+    return total;
+}
+
+bool GameSnapshot::Init(const GameState& game_state, StackAllocator* stack_allocator) {
+    size = CalcSize(game_state);
+    data = stack_allocator->Alloc(size);
+    if(!data){
+        LogMessage(kLogError, "Could not allocate %d bytes for a game snapshot", size);
+        return false;
+    }
+    random_seed = game_state.random_seed;
+    num_characters = game_state.num_characters;
+    return true;
+}
+
+void GameSnapshot::Save(const GameState& game_state) {
+    SnapshotLayout layout;
+    GetLayout(game_state, &layout);
+    memcpy(data, &layout, sizeof(layout));
+    SnapshotRegion regions[kMaxRegions];
+    int num_regions = GetRegions(const_cast<GameState*>(&game_state), regions);
+    int pos = sizeof(layout);
+    for(int i=0; i<num_regions; ++i){
+        SDL_assert(pos + regions[i].size <= size);
+        memcpy((char*)data + pos, regions[i].data, regions[i].size);
+        pos += regions[i].size;
+    }
+    random_seed = game_state.random_seed;
+    num_characters = game_state.num_characters;
+}
+
+bool GameSnapshot::Restore(GameState* game_state) const {
+    SnapshotLayout layout, expected_layout;
+    memcpy(&layout, data, sizeof(layout));
+    GetLayout(*game_state, &expected_layout);
+    if(memcmp(&layout, &expected_layout, sizeof(layout)) != 0){
+        LogMessage(kLogError, "Game snapshot of %d characters with seed %u does not fit a game of "
+                   "%d characters with seed %u", layout.num_characters, layout.random_seed,
+                   expected_layout.num_characters, expected_layout.random_seed);
+        return false;
+    }
+    SnapshotRegion regions[kMaxRegions];
+    int num_regions = GetRegions(game_state, regions);
+    int pos = sizeof(layout);
+    for(int i=0; i<num_regions; ++i){
+        memcpy(regions[i].data, (const char*)data + pos, regions[i].size);
+        pos += regions[i].size;
+    }
+    return true;
+}
+
+bool GameSnapshot::ReadFile(const char* path, StackAllocator* stack_allocator) {
+    SDL_RWops* file = SDL_RWFromFile(path, "rb");
+    if(!file){
+        LogMessage(kLogError, "Could not open game snapshot %s: %s", path, SDL_GetError());
+        return false;
+    }
+    Uint32 magic = SDL_ReadLE32(file);
+    Uint32 version = SDL_ReadLE32(file);
+    size = (int)SDL_ReadLE32(file);
+    Sint64 file_size = SDL_RWsize(file);
+    if(magic != kSnapshotMagic || version != kSnapshotVersion ||
+       size < (int)sizeof(SnapshotLayout) || file_size != (Sint64)(3*sizeof(Uint32)) + size)
+    {
+        LogMessage(kLogError, "%s is not a game snapshot of version %d", path, kSnapshotVersion);
+        SDL_RWclose(file);
+        return false;
+    }
+    data = stack_allocator->Alloc(size);
+    if(!data){
+        LogMessage(kLogError, "Could not allocate %d bytes for game snapshot %s", size, path);
+        SDL_RWclose(file);
+        return false;
+    }
+    size_t bytes_read = SDL_RWread(file, data, 1, size);
+    SDL_RWclose(file);
+    if((int)bytes_read != size){
+        LogMessage(kLogError, "Could not read game snapshot %s", path);
+        stack_allocator->Free(data);
+        data = NULL;
+        return false;
+    }
+    SnapshotLayout layout;
+    memcpy(&layout, data, sizeof(layout));
+    random_seed = layout.random_seed;
+    num_characters = layout.num_characters;
+    return true;
+}
+
+bool GameSnapshot::WriteFile(const char* path) const {
+    SDL_RWops* file = SDL_RWFromFile(path, "wb");
+    if(!file){
+        LogMessage(kLogError, "Could not open %s to write game snapshot: %s", path, SDL_GetError());
+        return false;
+    }
+    SDL_WriteLE32(file, kSnapshotMagic);
+    SDL_WriteLE32(file, kSnapshotVersion);
+    SDL_WriteLE32(file, (Uint32)size);
+    bool ok = SDL_RWwrite(file, data, 1, size) == (size_t)size;
+    SDL_RWclose(file);
+    if(!ok){
+        LogMessage(kLogError, "Could not write game snapshot %s", path);
+    }
+    return ok;
+}
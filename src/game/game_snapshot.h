@@ -0,0 +1,34 @@
+#pragma once
+#ifndef GAME_GAME_SNAPSHOT_H
+#define GAME_GAME_SNAPSHOT_H
+
+#include <SDL.h>
+
+class GameState;
+class StackAllocator;
+
+// Copy of the simulation part of a GameState: characters, the flow field
+// toward the player, tiles, lights, camera and clocks. Assets, GPU resources
+// and the nav mesh, which never changes after Init, are not included, so a
+// snapshot can only be restored into a GameState initialized with the same
+// seed and character count, and doing so takes about as long as a memcpy.
+class GameSnapshot {
+public:
+    // Bytes a snapshot of game_state takes
+    static int CalcSize(const GameState& game_state);
+    // Allocate room for snapshots of game_state, which must be initialized
+    bool Init(const GameState& game_state, StackAllocator* stack_allocator);
+    void Save(const GameState& game_state);
+    // Returns false if the snapshot doesn't fit game_state
+    bool Restore(GameState* game_state) const;
+    // Read a file written by WriteFile(), allocating room for it
+    bool ReadFile(const char* path, StackAllocator* stack_allocator);
+    bool WriteFile(const char* path) const;
+    Uint32 random_seed;
+    int num_characters;
+private:
+    void* data;
+    int size;
+};
+
+#endif
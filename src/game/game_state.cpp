@@ -10,7 +10,9 @@
 #include "platform_sdl/profiler.h"
 #include "internal/common.h"
 #include "internal/geometry.h"
+#include "internal/job_system.h"
 #include "internal/memory.h"
+#include "internal/random.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/random.hpp"
@@ -18,6 +20,7 @@
 #include <SDL.h>
 #include <GL/glew.h>
 #include <cstring>
+#include <cstdlib>
 
 #ifndef WIN32
 const int GameState::kMapSize;
@@ -27,6 +30,22 @@ using namespace glm;
 
 
 static const bool kDrawNavMesh = false;
+static const float kCharacterHashCellSize = 1.0f;
+static const int kMaxQueryResults = 256;
+// Minds within this distance of the player become active, and go inactive 
+// again past the larger distance, so characters near the edge don't flicker
+static const float kActivateMindDist = 16.0f;
+static const float kDeactivateMindDist = 18.0f;
+// Inactive minds thinking per tick, taking turns
+static const int kInactiveMindsPerTick = 64;
+// Waking a mind finds its nav mesh triangle through the triangle grid, about
+// a microsecond each, so this only bounds the spike when a whole crowd
+// wakes at once, like after the editor camera jumps
+static const int kMaxMindActivationsPerTick = 256;
+
+static int CompareInts(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
 
 quat Camera::GetRotation() {
     quat xRot = angleAxis(rotation_x, vec3(1,0,0));
@@ -204,16 +223,20 @@ void BoundingBoxFromParseMesh(ParseMesh* parse_mesh, vec3* bounding_box){
 
 void LoadMeshAssetTxt(FileLoadThreadData* file_load_thread_data,
                       MeshAsset* mesh_asset, const char* path,
-                      StackAllocator* stack_alloc) 
+                      StackAllocator* stack_alloc, bool create_vbos) 
 {
     ParseMesh parse_mesh;
     ParseTestFile(path, &parse_mesh, stack_alloc);
-    mesh_asset->vert_vbo = 
-        CreateVBO(kArrayVBO, kStaticVBO, parse_mesh.vert, 
-        parse_mesh.num_vert*sizeof(float)*8);
-    mesh_asset->index_vbo = 
-        CreateVBO(kElementVBO, kStaticVBO, parse_mesh.indices, 
-        parse_mesh.num_index*sizeof(Uint32));
+    mesh_asset->vert_vbo = 0;
+    mesh_asset->index_vbo = 0;
+    if(create_vbos){
+        mesh_asset->vert_vbo = 
+            CreateVBO(kArrayVBO, kStaticVBO, parse_mesh.vert, 
+            parse_mesh.num_vert*sizeof(float)*8);
+        mesh_asset->index_vbo = 
+            CreateVBO(kElementVBO, kStaticVBO, parse_mesh.indices, 
+            parse_mesh.num_index*sizeof(Uint32));
+    }
     mesh_asset->num_index = parse_mesh.num_index;
     BoundingBoxFromParseMesh(&parse_mesh, mesh_asset->bounding_box);
     parse_mesh.Dispose();
@@ -232,12 +255,15 @@ void FillStaticDrawable(Drawable* drawable, const MeshAsset& mesh_asset,
     drawable->vbo_layout = kInterleave_3V2T3N;
     drawable->texture_id = texture;
     drawable->shader_id = shader;
+    drawable->character = -1;
     SeparableTransform sep_transform;
     sep_transform.translation = translation;
     drawable->transform = sep_transform.GetCombination();
 }
 
 void AddNavMeshAsset(NavMeshAsset* nav_mesh_asset, NavMesh* nav_mesh, const mat4& mat) {
+    SDL_assert(nav_mesh->num_verts + nav_mesh_asset->num_verts <= nav_mesh->max_verts &&
+               nav_mesh->num_indices + nav_mesh_asset->num_indices <= nav_mesh->max_indices);
     int start_verts = nav_mesh->num_verts;
     for(int i=0; i<nav_mesh_asset->num_verts; ++i){
         nav_mesh->verts[nav_mesh->num_verts++] = 
@@ -348,20 +374,22 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
                      StackAllocator* stack_allocator) 
 {
     profiler->StartEvent("Game Init");
-    profiler->StartEvent("Loading music");
     num_ogg_tracks = 0;
-
-    for(int i=kOggDrone; i<=kOggDrums2; ++i){
-        if(num_ogg_tracks > kMaxOggTracks){
-            FormattedError("Error", "Too many OggTracks");
-            exit(1);
+    // Headless runs load no music, Update() sets gains that are never mixed
+    if(!headless){
+        profiler->StartEvent("Loading music");
+        for(int i=kOggDrone; i<=kOggDrums2; ++i){
+            if(num_ogg_tracks > kMaxOggTracks){
+                FormattedError("Error", "Too many OggTracks");
+                exit(1);
+            }
+            LoadOgg(&ogg_track[num_ogg_tracks++], asset_list[i], file_load_thread_data, stack_allocator, audio_context->buffer_samples);
         }
-        LoadOgg(&ogg_track[num_ogg_tracks++], asset_list[i], file_load_thread_data, stack_allocator, audio_context->buffer_samples);
-    }
-    for(int i=0; i<num_ogg_tracks; ++i) {
-        audio_context->AddOggTrack(&ogg_track[i]);
+        for(int i=0; i<num_ogg_tracks; ++i) {
+            audio_context->AddOggTrack(&ogg_track[i]);
+        }
+        profiler->EndEvent();
     }
-    profiler->EndEvent();
 
     { // Allocate memory for debug lines
         int mem_needed = lines.AllocMemory(NULL);
@@ -377,7 +405,7 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
     MeshAsset mesh_assets[kNumMesh];
     for(int i=0; i<kNumMesh; ++i){
         LoadMeshAssetTxt(file_load_thread_data, &mesh_assets[i], 
-            asset_list[kStartStaticDrawMeshes+i+1], stack_allocator);
+            asset_list[kStartStaticDrawMeshes+i+1], stack_allocator, !headless);
     }
     profiler->EndEvent();
 
@@ -410,21 +438,24 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
     }
     profiler->EndEvent();
 
-    profiler->StartEvent("Loading textures");
-    int textures[kNumTex];
-    for(int i=0; i<kNumTex; ++i){
-        textures[i] = LoadCrnTexture(asset_list[kStartTextures+i+1], file_load_thread_data, 
-                                     stack_allocator);
-    }
-    profiler->EndEvent();
+    // Headless runs leave every texture and shader id as 0
+    int textures[kNumTex] = {0};
+    int shaders[kNumShaders] = {0};
+    if(!headless){
+        profiler->StartEvent("Loading textures");
+        for(int i=0; i<kNumTex; ++i){
+            textures[i] = LoadCrnTexture(asset_list[kStartTextures+i+1], file_load_thread_data, 
+                                         stack_allocator);
+        }
+        profiler->EndEvent();
 
-    profiler->StartEvent("Loading shaders");
-    int shaders[kNumShaders];
-    for(int i=0; i<kNumShaders; ++i){
-        shaders[i] = CreateProgramFromFile(graphics_context, file_load_thread_data, 
-                                           asset_list[kStartShaders+i+1]);
+        profiler->StartEvent("Loading shaders");
+        for(int i=0; i<kNumShaders; ++i){
+            shaders[i] = CreateProgramFromFile(graphics_context, file_load_thread_data, 
+                                               asset_list[kStartShaders+i+1]);
+        }
+        profiler->EndEvent();
     }
-    profiler->EndEvent();
             
     lamp_shadow_tex = textures[TexID(kTexLampShadow)];
                   
@@ -433,34 +464,44 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
     camera.rotation_y = 0.0f;
 
     editor_mode = false;
+    toggle_editor_held = false;
+    game_time = 0.0;
 
     lines.shader = shaders[ShaderID(kShaderDebugDraw)];
 
-    LoadTTF(asset_list[kFontDebug], &text_atlas, file_load_thread_data, 18.0f);
+    if(!headless){
+        LoadTTF(asset_list[kFontDebug], &text_atlas, file_load_thread_data, 18.0f);
+        CreateTextBuffers(&text_atlas);
+    }
     text_atlas.shader = shaders[ShaderID(kShaderDebugDrawText)];
-    text_atlas.vert_vbo = CreateVBO(kArrayVBO, kStreamVBO, NULL, 0);
-    text_atlas.index_vbo = CreateVBO(kElementVBO, kStreamVBO, NULL, 0);
     debug_text.Init(&text_atlas);
 
     lines.num_lines = 0;
     num_drawables = 0;
 
-    lines.vbo = CreateVBO(kArrayVBO, kStreamVBO, NULL, 
-                          DebugDrawLines::kMaxLines * 
-                          DebugDrawLines::kElementsPerPoint * 
-                          2 * sizeof(GLfloat));
+    lines.vbo = 0;
+    if(!headless){
+        lines.vbo = CreateVBO(kArrayVBO, kStreamVBO, NULL, 
+                              DebugDrawLines::kMaxLines * 
+                              DebugDrawLines::kElementsPerPoint * 
+                              2 * sizeof(GLfloat));
+    }
 
     profiler->StartEvent("Loading character assets");
     num_character_assets = 0;
     for(int i=0; i<kNumCharacterAssets; ++i){
         ParseMesh* parse_mesh = &character_assets[num_character_assets].parse_mesh;
         ParseTestFile(asset_list[kStartCharacterAssets+i+1], parse_mesh, stack_allocator);
-        character_assets[num_character_assets].vert_vbo = 
-            CreateVBO(kArrayVBO, kStaticVBO, parse_mesh->vert, 
-            parse_mesh->num_vert*sizeof(float)*16);
-        character_assets[num_character_assets].index_vbo = 
-            CreateVBO(kElementVBO, kStaticVBO, parse_mesh->indices, 
-            parse_mesh->num_index*sizeof(Uint32));
+        character_assets[num_character_assets].vert_vbo = 0;
+        character_assets[num_character_assets].index_vbo = 0;
+        if(!headless){
+            character_assets[num_character_assets].vert_vbo = 
+                CreateVBO(kArrayVBO, kStaticVBO, parse_mesh->vert, 
+                parse_mesh->num_vert*sizeof(float)*16);
+            character_assets[num_character_assets].index_vbo = 
+                CreateVBO(kElementVBO, kStaticVBO, parse_mesh->indices, 
+                parse_mesh->num_index*sizeof(Uint32));
+        }
         BoundingBoxFromParseMesh(parse_mesh, character_assets[num_character_assets].bounding_box);
         ++num_character_assets;
     }
@@ -468,65 +509,82 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
 
     for(int i=0; i<kMaxCharacters; ++i){
         characters[i].exists = false;
+        bodies.SetPosition(i, vec3(0.0f));
+        bodies.SetVelocity(i, vec3(0.0f));
+        bodies.SetTarget(i, vec3(0.0f));
+        bodies.rotation[i] = 0.0f;
+        bodies.turn_speed[i] = 0.0f;
+        bodies.walk_cycle_frame[i] = (float)CharacterMovement::kWalkCycleStart;
+        bodies.energy[i] = 0.0f;
+        bodies.nav_tri[i] = -1;
     }
 
+    if(num_characters < 1 || num_characters > kMaxCharacters){
+        FormattedError("Error", "Character count must be between 1 and %d, got %d", 
+                       kMaxCharacters, num_characters);
+        exit(1);
+    }
     static const bool kOnlyOneCharacter = false;
-    int num_chars = kOnlyOneCharacter?1:kMaxCharacters;
+    int num_chars = kOnlyOneCharacter?1:num_characters;
 
     profiler->StartEvent("Initializing characters");
+    // Level and character setup draw from stream 0, each character then 
+    // gets its own stream for rolls during play
+    RandomStream setup_random;
+    setup_random.Seed(random_seed, 0);
     for(int i=0; i<num_chars; ++i){
-        characters[i].rotation = 0.0f;
         characters[i].exists = true;
-        characters[i].nav_mesh_walker.tri = -1;
         characters[i].tether_target = -1;
+        characters[i].random.Seed(random_seed, i+1);
         if(i == 0){
-            characters[i].character_asset = &character_assets[0];
-            characters[i].transform.translation = vec3(kMapSize,0,kMapSize);
+            characters[i].character_asset = 0;
+            bodies.SetPosition(i, vec3(kMapSize,0,kMapSize));
             characters[i].mind.state = Mind::kPlayerControlled;
             characters[i].type = Character::kPlayer;
             characters[i].revealed = true;
+            bodies.turn_speed[i] = 10.0f;
         } else {
-            characters[i].character_asset = &character_assets[glm::linearRand(0,2)];
-            characters[i].transform.translation = vec3(rand()%(kMapSize*2),0,rand()%(kMapSize*2));
+            characters[i].character_asset = setup_random.Range(0,2);
+            bodies.SetPosition(i, vec3(setup_random.Range(0,kMapSize*2-1),0,
+                                       setup_random.Range(0,kMapSize*2-1)));
             characters[i].mind.state = Mind::kWander;
             characters[i].mind.wander_update_time = 0;
-            characters[i].type = (rand()%2==0)?Character::kRed:Character::kGreen;
+            characters[i].type = (setup_random.Range(0,1)==0)?Character::kRed:Character::kGreen;
             characters[i].revealed = false;
+            bodies.turn_speed[i] = 5.0f;
         }
-        characters[i].energy = 1.0f;
-        characters[i].walk_cycle_frame = (float)(rand()%100);
+        bodies.energy[i] = 1.0f;
+        bodies.walk_cycle_frame[i] = (float)setup_random.Range(0,99);
 
+        const CharacterAsset* asset = &character_assets[characters[i].character_asset];
         characters[i].drawable = num_drawables;
         drawables[num_drawables].vert_vbo = 
-            characters[i].character_asset->vert_vbo;
+            asset->vert_vbo;
         drawables[num_drawables].index_vbo = 
-            characters[i].character_asset->index_vbo;
+            asset->index_vbo;
         drawables[num_drawables].num_indices = 
-            characters[i].character_asset->parse_mesh.num_index;
+            asset->parse_mesh.num_index;
         drawables[num_drawables].vbo_layout = kInterleave_3V2T3N4I4W;
         drawables[num_drawables].transform = mat4();
-        if(characters[i].character_asset == &character_assets[0]){
+        if(characters[i].character_asset == 0){
             drawables[num_drawables].texture_id = textures[TexID(kTexChar)];
-        } else if(characters[i].character_asset == &character_assets[1]){
+        } else if(characters[i].character_asset == 1){
             drawables[num_drawables].texture_id = 
-                textures[TexID(glm::linearRand<int>(kTexWomanNPC1, kTexWomanNPC2))];
-        } else if(characters[i].character_asset == &character_assets[2]){
+                textures[TexID(setup_random.Range(kTexWomanNPC1, kTexWomanNPC2))];
+        } else if(characters[i].character_asset == 2){
             drawables[num_drawables].texture_id = 
-                textures[TexID(glm::linearRand<int>(kTexManNPC1, kTexManNPC2))];
+                textures[TexID(setup_random.Range(kTexManNPC1, kTexManNPC2))];
         }
         drawables[num_drawables].shader_id = shaders[ShaderID(kShader3DModelSkinned)];;
-        drawables[num_drawables].character = &characters[i];
+        drawables[num_drawables].character = i;
         drawables[num_drawables].bounding_sphere_center = 
-            (characters[i].character_asset->bounding_box[0]+characters[i].character_asset->bounding_box[1]) * 0.5f;
+            (asset->bounding_box[0]+asset->bounding_box[1]) * 0.5f;
         drawables[num_drawables].bounding_sphere_radius = 
-            length(characters[i].character_asset->bounding_box[1] - characters[i].character_asset->bounding_box[0])*0.5f;
+            length(asset->bounding_box[1] - asset->bounding_box[0])*0.5f;
         ++num_drawables;
     }
     profiler->EndEvent();
 
-    nav_mesh.num_verts = 0;
-    nav_mesh.num_indices = 0;
-
     enum TileType {
         kNothing,
         kFloor,
@@ -631,6 +689,24 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
     }
 
     profiler->StartEvent("Setting up tiles");
+    {
+        // Every tile adds at most one nav mesh asset, welding shrinks them
+        // down to the verts that are not shared
+        int max_asset_verts = 0;
+        int max_asset_indices = 0;
+        for(int i=0; i<kNumNavMesh; ++i){
+            max_asset_verts = max(max_asset_verts, nav_mesh_assets[i].num_verts);
+            max_asset_indices = max(max_asset_indices, nav_mesh_assets[i].num_indices);
+        }
+        int num_tiles = 0;
+        for(int i=0, len=kMapSize*kMapSize; i<len; ++i){
+            if(tiles[i] != kNothing){
+                ++num_tiles;
+            }
+        }
+        nav_mesh.AllocMemory(num_tiles * max_asset_verts, num_tiles * max_asset_indices / 3, 
+                             stack_allocator);
+    }
     for(int z=0; z<kMapSize; ++z){
         for(int x=0; x<kMapSize; ++x){
             int index = z*kMapSize + x;
@@ -686,11 +762,11 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
                 AddNavMeshAsset(&nav_mesh_assets[NavMeshID(kNavGardenTallCorner)], &nav_mesh, mat);
                 } break;
             case kFloor: {
-                int tex = glm::linearRand<int>(kTexFloor, kTexFloor4);
-                if(rand()%20 == 0){
+                int tex = setup_random.Range(kTexFloor, kTexFloor4);
+                if(setup_random.Range(0,19) == 0){
                     tex = kTexFloorManhole;
                 }
-                if(rand()%20 == 0){
+                if(setup_random.Range(0,19) == 0){
                     tex = kTexFloorGrate;
                 }
                 FillStaticDrawable(&drawables[num_drawables++], 
@@ -728,9 +804,15 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
     profiler->EndEvent();
     
     profiler->StartEvent("Creating nav mesh");
+    nav_mesh.WeldVerts(stack_allocator);
     nav_mesh.CalcNeighbors(stack_allocator);
-    nav_mesh.vert_vbo = CreateVBO(kArrayVBO, kStaticVBO, nav_mesh.verts, nav_mesh.num_verts*sizeof(vec3));
-    nav_mesh.index_vbo = CreateVBO(kElementVBO, kStaticVBO, nav_mesh.indices, nav_mesh.num_indices*sizeof(Uint32));
+    nav_mesh.CalcPlanes(stack_allocator);
+    nav_mesh.vert_vbo = 0;
+    nav_mesh.index_vbo = 0;
+    if(!headless){
+        nav_mesh.vert_vbo = CreateVBO(kArrayVBO, kStaticVBO, nav_mesh.verts, nav_mesh.num_verts*sizeof(vec3));
+        nav_mesh.index_vbo = CreateVBO(kElementVBO, kStaticVBO, nav_mesh.indices, nav_mesh.num_indices*sizeof(Uint32));
+    }
     nav_mesh.shader = shaders[ShaderID(kShaderNavMesh)];
     if(kDrawNavMesh) {
         for(int i=0; i<nav_mesh.num_indices; i+=3){
@@ -741,136 +823,264 @@ void GameState::Init(int* init_stage, GraphicsContext* graphics_context,
             }
         }
     }
-    for(int i=kNumNavMesh-1; i>=0; --i){
-        stack_allocator->Free(nav_mesh_assets[i].indices);
-        nav_mesh_assets[i].indices = NULL;
-        stack_allocator->Free(nav_mesh_assets[i].verts);
-        nav_mesh_assets[i].verts = NULL;
-    }
+    // The nav mesh assets stay allocated under the nav mesh, they only take a few KB
+    nav_mesh.BuildTriGrid(stack_allocator);
+    nav_pathfinder.Init(&nav_mesh, stack_allocator);
+    player_flow_field.Init(&nav_mesh, stack_allocator);
     profiler->EndEvent();
 
     profiler->StartEvent("Placing characters in nav mesh");
     for(int i=0; i<num_chars; ++i){
-        characters[i].nav_mesh_walker.tri = nav_mesh.ClosestTriToPoint(characters[i].transform.translation);
+        bodies.nav_tri[i] = nav_mesh.ClosestTriToPoint(bodies.GetPosition(i));
         vec3 tri_mid;
         for(int j=0; j<3; ++j){
-            int tri_index = characters[i].nav_mesh_walker.tri * 3;
+            int tri_index = bodies.nav_tri[i] * 3;
             tri_mid += nav_mesh.verts[nav_mesh.indices[tri_index]] / 3.0f;
         }
-        characters[i].transform.translation = tri_mid;
+        bodies.SetPosition(i, tri_mid);
+        characters[i].mind.active = true;
+        characters[i].mind.think_this_tick = true;
+        characters[i].mind.follow_path = false;
     }
+    next_inactive_mind = 0;
+    bodies.SavePreviousTransforms();
+    prev_camera = camera;
     profiler->EndEvent();
     profiler->EndEvent();
 
     *init_stage = -1;
 }
 
-static void UpdateCharacter(Character* character, vec3 target_dir, float time_step,
-                            const NavMesh& nav) 
-{
-    static const float char_speed = 2.0f;
-    static const float char_accel = 10.0f;
-    vec3 target_vel = target_dir * char_speed;
-    if(time_step != 0.0f){
-        vec3 rel_vel = target_vel - character->velocity;
-        rel_vel /= (char_accel * time_step);
-        if(length(rel_vel) > 1.0f){
-            rel_vel = normalize(rel_vel);
-        }
-        rel_vel *= (char_accel * time_step);
-        character->velocity += rel_vel;
-        SDL_assert(character->velocity == character->velocity);
-    }
-    character->transform.translation += 
-        character->velocity * char_speed * time_step;
+vec3 CharacterBodies::GetPosition(int index) const {
+    return vec3(pos_x[index], pos_y[index], pos_z[index]);
+}
 
-    {
-        NavMeshWalker& walker = character->nav_mesh_walker;
-        vec3 old_translation = character->transform.translation;
-        vec3 pos = character->transform.translation;
-        bool repeat;
-        do {
-            repeat = false;
-            vec3 tri_verts[3];
-            for(int i=0; i<3; ++i){
-                tri_verts[i] = nav.verts[nav.indices[walker.tri*3+i]];
-            }
-            int tri_history[] = {walker.tri, walker.tri};
-            vec3 tri_normal = normalize(cross(tri_verts[2] - tri_verts[0], tri_verts[1] - tri_verts[0]));
-            SDL_assert(tri_normal == tri_normal);
-            float char_norm_d = dot(pos, tri_normal);
-            float tri_norm_d = dot(tri_verts[0], tri_normal);
-            SDL_assert(pos == pos);
-            pos += tri_normal * (tri_norm_d - char_norm_d);
-            SDL_assert(pos == pos);
-            for(int i=0; i<3; ++i){
-                vec3 plane_n = normalize(cross(tri_verts[(i+1)%3] - tri_verts[(i+2)%3], tri_normal));
-                float plane_d = dot(tri_verts[(i+1)%3], plane_n);
-                float char_d = dot(pos, plane_n);
-                if(char_d > plane_d){
-                    int neighbor = nav.tri_neighbors[walker.tri*3+(i+1)%3];
-                    if(neighbor != -1){
-                        // Go to neighboring triangle if possible
-                        tri_history[1] = tri_history[0];
-                        tri_history[0] = walker.tri;
-                        walker.tri = neighbor/3;
-                        // Prevent infinite loops
-                        if(walker.tri != tri_history[0] && walker.tri != tri_history[1]){
-                            repeat = true;
-                        }
-                        break;
-                    } else {
-                        // Otherwise slide along wall
-                        pos -= plane_n * (char_d - plane_d);
-                        float char_vel_d = dot(character->velocity, plane_n);
-                        if(char_vel_d > 0.0f){
-                            character->velocity -= plane_n * (char_vel_d);
-                            SDL_assert(character->velocity == character->velocity);
-                        }
+void CharacterBodies::SetPosition(int index, const vec3& pos) {
+    pos_x[index] = pos[0];
+    pos_y[index] = pos[1];
+    pos_z[index] = pos[2];
+}
+
+vec3 CharacterBodies::GetVelocity(int index) const {
+    return vec3(vel_x[index], vel_y[index], vel_z[index]);
+}
+
+void CharacterBodies::SetVelocity(int index, const vec3& vel) {
+    vel_x[index] = vel[0];
+    vel_y[index] = vel[1];
+    vel_z[index] = vel[2];
+}
+
+void CharacterBodies::SetTarget(int index, const vec3& dir) {
+    target_x[index] = dir[0];
+    target_y[index] = dir[1];
+    target_z[index] = dir[2];
+}
+
+void CharacterBodies::SavePreviousTransforms() {
+    memcpy(prev_pos_x, pos_x, sizeof(pos_x));
+    memcpy(prev_pos_y, pos_y, sizeof(pos_y));
+    memcpy(prev_pos_z, pos_z, sizeof(pos_z));
+    memcpy(prev_rotation, rotation, sizeof(rotation));
+}
+
+vec3 CharacterBodies::GetInterpolatedPosition(int index, float interpolation) const {
+    vec3 prev_pos(prev_pos_x[index], prev_pos_y[index], prev_pos_z[index]);
+    return mix(prev_pos, GetPosition(index), interpolation);
+}
+
+float CharacterBodies::GetInterpolatedRotation(int index, float interpolation) const {
+    // Take the short way around
+    float rel_rotation = rotation[index] - prev_rotation[index];
+    rel_rotation -= two_pi<float>() * floorf(rel_rotation / two_pi<float>() + 0.5f);
+    return prev_rotation[index] + rel_rotation * interpolation;
+}
+
+CharacterMovement CharacterBodies::GetMovement(int count) {
+    CharacterMovement movement;
+    movement.count = count;
+    movement.pos_x = pos_x;
+    movement.pos_y = pos_y;
+    movement.pos_z = pos_z;
+    movement.vel_x = vel_x;
+    movement.vel_y = vel_y;
+    movement.vel_z = vel_z;
+    movement.target_x = target_x;
+    movement.target_y = target_y;
+    movement.target_z = target_z;
+    movement.rotation = rotation;
+    movement.turn_speed = turn_speed;
+    movement.walk_cycle_frame = walk_cycle_frame;
+    movement.nav_tri = nav_tri;
+    return movement;
+}
+
+// Characters are updated in batches of this many, a multiple of four so the
+// same characters take the SIMD and scalar paths whatever the thread count
+static const int kCharacterBatchSize = 64;
+
+struct CharacterUpdateJob {
+    GameState* game_state;
+    int game_milliseconds; // Simulation time, so wandering doesn't depend on frame timing
+    vec3 controls_target_dir;
+    float time_step;
+    CharacterMovement movement;
+};
+
+// Choose movement directions. Reads other characters but writes only the 
+// batch's own minds and targets, and rolls only their own random streams, 
+// so batches can run in any order.
+static void ThinkBatch(void* data, int start, int end) {
+    PROFILE_SCOPE("Character think");
+    CharacterUpdateJob* job = (CharacterUpdateJob*)data;
+    Character* characters = job->game_state->characters;
+    CharacterBodies* bodies = &job->game_state->bodies;
+    for(int i=start; i<end; ++i){
+        if(!characters[i].exists){
+            bodies->SetTarget(i, vec3(0.0f));
+            continue;
+        }
+        SDL_assert(bodies->GetPosition(i) == bodies->GetPosition(i));
+        Mind& mind = characters[i].mind;
+        if(!mind.think_this_tick){
+            // Keep heading the way it last decided
+            continue;
+        }
+        if(mind.state == Mind::kWander && job->game_milliseconds > mind.wander_update_time){
+            RandomStream& random = characters[i].random;
+            vec2 rand_dir = random.Circular(random.Range(0.0f,0.5f));
+            mind.dir = vec3(rand_dir[0], 0.0f, rand_dir[1]);
+            mind.wander_update_time = job->game_milliseconds + random.Range(1000,5000);
+        }
+        vec3 target_dir;
+        // Check AI to get target movement
+        switch(mind.state){
+        case Mind::kPlayerControlled:
+            target_dir = job->controls_target_dir;
+            break;
+        case Mind::kStand:
+            target_dir = vec3(0.0f);
+            break;
+        case Mind::kWander:
+            target_dir = mind.dir;
+            break;
+        case Mind::kSeekTarget:
+            if(characters[mind.seek_target].exists){
+                target_dir = bodies->GetPosition(i) - bodies->GetPosition(mind.seek_target);
+                if(mind.state == Mind::kSeekTarget){
+                    target_dir *= -1.0f;
+                }
+                float target_dir_len = length(target_dir);
+                if(target_dir_len > mind.seek_target_distance[1] &&
+                   target_dir_len > 0.001f)
+                {
+                    if(mind.follow_path){
+                        target_dir = mind.path_corner - bodies->GetPosition(i);
                     }
+                    target_dir = normalize(target_dir) * 0.5f;
+                } else if(target_dir_len < mind.seek_target_distance[0] &&
+                          target_dir_len > 0.001f)
+                {
+                    target_dir = normalize(target_dir) * -0.5f;                            
+                } else {
+                    target_dir = vec3(0.0f);
                 }
+                SDL_assert(target_dir == target_dir);
+            } else {
+                target_dir = vec3(0.0f);
             }
-            SDL_assert(pos == pos);
-        } while(repeat);
-
-        character->transform.translation = pos;
+            break;
+        }
+        bodies->SetTarget(i, target_dir);
     }
+}
 
-    float walk_anim_speed = 30.0f;
-    character->walk_cycle_frame += length(character->velocity) * walk_anim_speed * time_step;
-    // TODO: this could be done much more elegantly using modf or similar
-    while((int)character->walk_cycle_frame > Character::kWalkCycleEnd){
-        character->walk_cycle_frame -=
-            (float)(Character::kWalkCycleEnd - Character::kWalkCycleStart);
-    }
-    while((int)character->walk_cycle_frame < Character::kWalkCycleStart){
-        character->walk_cycle_frame +=
-            (float)(Character::kWalkCycleEnd - Character::kWalkCycleStart);
-    }
+static void MoveBatch(void* data, int start, int end) {
+    PROFILE_SCOPE("Character move");
+    CharacterUpdateJob* job = (CharacterUpdateJob*)data;
+    Character* characters = job->game_state->characters;
+    CharacterBodies* bodies = &job->game_state->bodies;
+    float time_step = job->time_step;
+    CharacterMovement movement = job->movement.Slice(start, end);
+    IntegrateCharacterVelocities(movement, time_step);
+    ConstrainCharactersToNavMesh(movement, job->game_state->nav_mesh);
+    AdvanceCharacterWalkCycles(movement, time_step);
 
-    character->color = vec4(1,1,1,1);
-    if(character->revealed){
-        switch(character->type){
-            case Character::kRed:
-                character->color = vec4(1,0,0,character->energy);
-                break;
-            case Character::kGreen:
-                character->color = vec4(0,1,0,character->energy);
-                break;
+    static const float kPlayerEnergyLossPerSecond = 0.01f;
+    for(int i=start; i<end; ++i){
+        if(characters[i].exists){
+            Character* character = &characters[i];
+            character->color = vec4(1,1,1,1);
+            if(character->revealed){
+                switch(character->type){
+                    case Character::kRed:
+                        character->color = vec4(1,0,0,bodies->energy[i]);
+                        break;
+                    case Character::kGreen:
+                        character->color = vec4(0,1,0,bodies->energy[i]);
+                        break;
+                }
+            }
+            if(character->type == Character::kPlayer){
+                bodies->energy[i] -= time_step * kPlayerEnergyLossPerSecond;
+            }
         }
     }
+}
 
-    static const float kPlayerEnergyLossPerSecond = 0.01f;
-    if(character->type == Character::kPlayer){
-        character->energy -= time_step * kPlayerEnergyLossPerSecond;
-    }
+static void TurnBatch(void* data, int start, int end) {
+    PROFILE_SCOPE("Character turn");
+    CharacterUpdateJob* job = (CharacterUpdateJob*)data;
+    TurnCharactersTowardVelocities(job->movement.Slice(start, end), job->time_step);
 }
 
 int OggTrackID(int val){
     return val - kOggDrone;
 }
 
-void GameState::Update(const vec2& mouse_rel, float time_step) {
+void ReadSimulationInput(SimulationInput* input, const vec2& mouse_rel) {
+    const Uint8 *state = SDL_GetKeyboardState(NULL);
+    input->buttons = 0;
+    if (state[SDL_SCANCODE_W]) {
+        input->buttons |= SimulationInput::kForward;
+    }
+    if (state[SDL_SCANCODE_S]) {
+        input->buttons |= SimulationInput::kBack;
+    }
+    if (state[SDL_SCANCODE_A]) {
+        input->buttons |= SimulationInput::kLeft;
+    }
+    if (state[SDL_SCANCODE_D]) {
+        input->buttons |= SimulationInput::kRight;
+    }
+    if (state[SDL_SCANCODE_SPACE]) {
+        input->buttons |= SimulationInput::kSlow;
+    }
+    if (state[SDL_SCANCODE_TAB]) {
+        input->buttons |= SimulationInput::kToggleEditor;
+    }
+    if (SDL_GetMouseState(NULL, NULL) & SDL_BUTTON_LEFT) {
+        input->buttons |= SimulationInput::kMouseLook;
+    }
+    input->mouse_rel = mouse_rel;
+}
+
+void GetScriptedInput(int tick, float tick_seconds, SimulationInput* input) {
+    static const float kSecondsPerStep = 2.0f;
+    static const Uint32 kSteps[] = {
+        SimulationInput::kForward, SimulationInput::kRight, 
+        SimulationInput::kBack, SimulationInput::kLeft, 0
+    };
+    static const int kNumSteps = sizeof(kSteps) / sizeof(kSteps[0]);
+    int step = (int)(tick * tick_seconds / kSecondsPerStep) % kNumSteps;
+    input->buttons = kSteps[step];
+    input->mouse_rel = glm::vec2(0.0f);
+}
+
+void GameState::Update(const SimulationInput& input, float time_step) {
+    bodies.SavePreviousTransforms();
+    prev_camera = camera;
+    game_time += time_step;
     for(int i=0; i<num_ogg_tracks; ++i) {
         ogg_track[i].target_gain = 0.0f;
     }
@@ -878,32 +1088,30 @@ void GameState::Update(const vec2& mouse_rel, float time_step) {
 
     lines.Update();
     float cam_speed = 10.0f;
-    const Uint8 *state = SDL_GetKeyboardState(NULL);
-    if (state[SDL_SCANCODE_SPACE]) {
+    if (input.buttons & SimulationInput::kSlow) {
         cam_speed *= 0.1f;
     }
     if(editor_mode){
         ogg_track[OggTrackID(kOggDrums2)].target_gain = 1.0f;
         vec3 offset;
-        if (state[SDL_SCANCODE_W]) {
+        if (input.buttons & SimulationInput::kForward) {
             offset -= vec3(0,0,1);
         }
-        if (state[SDL_SCANCODE_S]) {
+        if (input.buttons & SimulationInput::kBack) {
             offset += vec3(0,0,1);
         }
-        if (state[SDL_SCANCODE_A]) {
+        if (input.buttons & SimulationInput::kLeft) {
             offset -= vec3(1,0,0);
         }
-        if (state[SDL_SCANCODE_D]) {
+        if (input.buttons & SimulationInput::kRight) {
             offset += vec3(1,0,0);
         }
         camera.position += 
             camera.GetRotation() * offset * cam_speed * time_step;
         const float kMouseSensitivity = 0.003f;
-        Uint32 mouse_button_bitmask = SDL_GetMouseState(NULL, NULL);
-        if(mouse_button_bitmask & SDL_BUTTON_LEFT){
-            camera.rotation_x -= mouse_rel.y * kMouseSensitivity;
-            camera.rotation_y -= mouse_rel.x * kMouseSensitivity;
+        if(input.buttons & SimulationInput::kMouseLook){
+            camera.rotation_x -= input.mouse_rel.y * kMouseSensitivity;
+            camera.rotation_y -= input.mouse_rel.x * kMouseSensitivity;
         }
         camera_fov = 1.02f;
     } else {
@@ -916,16 +1124,16 @@ void GameState::Update(const vec2& mouse_rel, float time_step) {
 
         vec3 controls_target_dir;
         float target_speed = 0.0f;
-        if (state[SDL_SCANCODE_W]) {
+        if (input.buttons & SimulationInput::kForward) {
             controls_target_dir += cam_north;
         }
-        if (state[SDL_SCANCODE_S]) {
+        if (input.buttons & SimulationInput::kBack) {
             controls_target_dir -= cam_north;
         }
-        if (state[SDL_SCANCODE_D]) {
+        if (input.buttons & SimulationInput::kRight) {
             controls_target_dir += cam_east;
         }
-        if (state[SDL_SCANCODE_A]) {
+        if (input.buttons & SimulationInput::kLeft) {
             controls_target_dir -= cam_east;
         }
 
@@ -933,71 +1141,48 @@ void GameState::Update(const vec2& mouse_rel, float time_step) {
             controls_target_dir = normalize(controls_target_dir);
         }
 
-        int get_ticks = SDL_GetTicks();
-        for(int i=0; i<kMaxCharacters; ++i){
+        ScheduleMinds();
+        PlanPaths();
+
+        // Every character picks its target from the positions at the start 
+        // of the tick, then all of them move
+        CharacterUpdateJob job;
+        job.game_state = this;
+        job.game_milliseconds = (int)(game_time * 1000.0);
+        job.controls_target_dir = controls_target_dir;
+        job.time_step = time_step;
+        job.movement = bodies.GetMovement(num_characters);
+        job_system->ParallelFor(ThinkBatch, &job, num_characters, kCharacterBatchSize);
+        job_system->ParallelFor(MoveBatch, &job, num_characters, kCharacterBatchSize);
+
+        character_hash.Clear(kCharacterHashCellSize);
+        for(int i=0; i<num_characters; ++i){
             if(characters[i].exists){
-                SDL_assert(characters[i].transform.translation == characters[i].transform.translation);
-                vec3 target_dir;
-                // Check AI to get target movement
-                switch(characters[i].mind.state){
-                case Mind::kPlayerControlled:
-                    target_dir = controls_target_dir;
-                    break;
-                case Mind::kStand:
-                    target_dir = vec3(0.0f);
-                    break;
-                case Mind::kWander:
-                    if(get_ticks > characters[i].mind.wander_update_time){
-                        vec2 rand_dir = glm::circularRand(glm::linearRand(0.0f,0.5f));
-                        characters[i].mind.dir = vec3(rand_dir[0], 0.0f, rand_dir[1]);
-                        characters[i].mind.wander_update_time = get_ticks + glm::linearRand<int>(1000,5000);
-                    }
-                    target_dir = characters[i].mind.dir;
-                    break;
-                case Mind::kSeekTarget:
-                    if(characters[characters[i].mind.seek_target].exists){
-                        target_dir = characters[i].transform.translation - 
-                            characters[characters[i].mind.seek_target].transform.translation;
-                        if(characters[i].mind.state == Mind::kSeekTarget){
-                            target_dir *= -1.0f;
-                        }
-                        float target_dir_len = length(target_dir);
-                        if(target_dir_len > characters[i].mind.seek_target_distance[1] &&
-                           target_dir_len > 0.001f)
-                        {
-                            target_dir = normalize(target_dir) * 0.5f;
-                        } else if(target_dir_len < characters[i].mind.seek_target_distance[0] &&
-                                  target_dir_len > 0.001f)
-                        {
-                            target_dir = normalize(target_dir) * -0.5f;                            
-                        } else {
-                            target_dir = vec3(0.0f);
-                        }
-                        SDL_assert(target_dir == target_dir);
-                    } else {
-                        target_dir = vec3(0.0f);
-                    }
-                    break;
-                }
-                UpdateCharacter(&characters[i], target_dir, time_step, nav_mesh);
+                character_hash.Insert(i, bodies.GetPosition(i));
             }
         }
+        character_hash.Build();
 
         // Handle tethering
-        for(int i=0; i<kMaxCharacters; ++i){
+        for(int i=0; i<num_characters; ++i){
             if(characters[i].exists && characters[i].tether_target != -1 && characters[characters[i].tether_target].exists){
                 { // Characters can steal tethers if they are close to tether and closest to source
+                    static const float kStealDist = 0.4f;
                     float closest_dist = FLT_MAX;
                     int closest_tether = -1;
-                    for(int j=0; j<kMaxCharacters; ++j){
+                    int nearby[kMaxQueryResults];
+                    vec3 tether_start = bodies.GetPosition(i);
+                    vec3 tether_end = bodies.GetPosition(characters[i].tether_target);
+                    int num_nearby = character_hash.QuerySegment(tether_start, tether_end,
+                        kStealDist, nearby, kMaxQueryResults);
+                    for(int k=0; k<num_nearby; ++k){
+                        int j = nearby[k];
                         if(j != i && characters[j].exists){
-                            vec3 pos = characters[j].transform.translation;
-                            vec3 point = ClosestPointOnSegment(pos,
-                                characters[i].transform.translation,
-                                characters[characters[i].tether_target].transform.translation);
-                            if(distance2(point, pos) < 0.4f*0.4f) {
-                                float dist = distance2(characters[i].transform.translation, pos);
-                                if(dist < closest_dist){
+                            vec3 pos = bodies.GetPosition(j);
+                            vec3 point = ClosestPointOnSegment(pos, tether_start, tether_end);
+                            if(distance2(point, pos) < kStealDist*kStealDist) {
+                                float dist = distance2(tether_start, pos);
+                                if(dist < closest_dist || (dist == closest_dist && j < closest_tether)){
                                     closest_dist = dist;
                                     closest_tether = j;
                                 }
@@ -1010,48 +1195,51 @@ void GameState::Update(const vec2& mouse_rel, float time_step) {
                 }
                 // Draw tether
                 vec3 height_vec = vec3(0.0f,0.5f,0.0f);
-                lines.Add(characters[i].transform.translation + height_vec, 
-                          characters[characters[i].tether_target].transform.translation + height_vec,
-                          vec4(0,1,0,characters[i].energy), kUpdate, 1);
+                lines.Add(bodies.GetPosition(i) + height_vec, 
+                          bodies.GetPosition(characters[i].tether_target) + height_vec,
+                          vec4(0,1,0,bodies.energy[i]), kUpdate, 1);
                 // Transfer energy across tether if needed
-                float player_missing_energy = 1.0f-characters[characters[i].tether_target].energy;
+                float player_missing_energy = 1.0f-bodies.energy[characters[i].tether_target];
                 float amount_transferred = min(player_missing_energy, time_step);
-                characters[i].energy -= amount_transferred;
-                characters[characters[i].tether_target].energy += amount_transferred;
+                bodies.energy[i] -= amount_transferred;
+                bodies.energy[characters[i].tether_target] += amount_transferred;
             }
         }
 
         // Characters die if energy goes below zero
-        for(int i=0; i<kMaxCharacters; ++i){
-            if(characters[i].energy < 0.0f){
+        for(int i=0; i<num_characters; ++i){
+            if(characters[i].exists && bodies.energy[i] < 0.0f){
                 characters[i].exists = false;
+                // Keep the movement passes from moving the body
+                bodies.SetVelocity(i, vec3(0.0f));
+                bodies.nav_tri[i] = -1;
             }
         }
 
 
         bool player_alive = false;
         // Set camera to follow player
-        for(int i=0; i<kMaxCharacters; ++i){
+        for(int i=0; i<num_characters; ++i){
             if(characters[i].exists && characters[i].mind.state == Mind::kPlayerControlled){
-                camera.position = characters[i].transform.translation +
+                camera.position = bodies.GetPosition(i) +
                     camera.GetRotation() * vec3(0,0,1) * 10.0f;
                 player_alive = true;
                 num_lights = 2;
-                light_pos[0] = characters[i].transform.translation + vec3(0,1,0);
+                light_pos[0] = bodies.GetPosition(i) + vec3(0,1,0);
                 light_color[0] = vec3(5.0f,3.0f,0.0f);
-                light_color[0] *= characters[i].energy;    
+                light_color[0] *= bodies.energy[i];    
                 light_type[0] = 0;
                 light_pos[1] = vec3(13*2,2,13*2);
                 light_pos[1]+= vec3(-0.8,0,1.0);
                 light_color[1] = vec3(5.0f,3.0f,0.0f) * 10.0f;       
-                light_color[1] *= sin(SDL_GetTicks()/1000.0f)*0.5f+0.5f;      
+                light_color[1] *= (float)sin(game_time)*0.5f+0.5f;      
                 light_type[1] = 1;        
             }
         }
 
         int num_reds = 0;
         int num_greens = 0;
-        for(int i=0; i<kMaxCharacters; ++i){
+        for(int i=0; i<num_characters; ++i){
             if(characters[i].exists && characters[i].revealed){
                 if(characters[i].type == Character::kRed){
                     ++num_reds;
@@ -1082,49 +1270,18 @@ void GameState::Update(const vec2& mouse_rel, float time_step) {
 
         // Handle collisions between characters
         // Includes revealing character colors and combat
-        CharacterCollisions(characters, time_step);
+        CharacterCollisions(time_step);
 
         // Set rotation based on velocity
-        for(int i=0; i<kMaxCharacters; ++i){
-            if(characters[i].exists) {
-                Character* character = &characters[i];
-                vec3 target_dir = character->velocity;
-                float turn_speed = 5.0f;
-                if(character->type == Character::kPlayer){
-                    turn_speed = 10.0f;
-                }
-                if(length(target_dir) > 0.0f){
-                    if(length(target_dir) > 1.0f){
-                        target_dir = normalize(target_dir);
-                    }
-                    float target_rotation = -atan2f(target_dir[2], target_dir[0])+half_pi<float>();
-
-                    float rel_rotation = target_rotation - character->rotation;
-                    // TODO: Do this in a better way, maybe using modf
-                    while(rel_rotation > pi<float>()){
-                        rel_rotation -= two_pi<float>();
-                    }
-                    while(rel_rotation < -pi<float>()){
-                        rel_rotation += two_pi<float>();
-                    }
-                    if(fabsf(rel_rotation) < turn_speed * time_step){
-                        character->rotation += rel_rotation;
-                    } else {
-                        character->rotation += (rel_rotation>0.0f?1.0f:-1.0f) * turn_speed * time_step;
-                    }
-                    character->transform.rotation = angleAxis(character->rotation, vec3(0,1,0)); 
-                }
-            }
-        }
+        job_system->ParallelFor(TurnBatch, &job, num_characters, kCharacterBatchSize);
 
         camera_fov = 0.8f;
     }
-    // TODO: we don't really want non-const static variables like this V
-    static bool old_tab = false;
-    if (state[SDL_SCANCODE_TAB] && !old_tab) {
+    bool toggle_editor = (input.buttons & SimulationInput::kToggleEditor) != 0;
+    if (toggle_editor && !toggle_editor_held) {
         editor_mode = !editor_mode;
     }
-    old_tab = (state[SDL_SCANCODE_TAB] != 0);
+    toggle_editor_held = toggle_editor;
 }
 
 void DrawCoordinateGrid(GameState* game_state){
@@ -1155,10 +1312,13 @@ void DrawDrawable(float *frustum_planes, GameState* game_state,
             float* plane = &frustum_planes[i];
             float val = dot(test_pos, normalize(vec3(plane[0], plane[1], plane[2])));
             if(val > plane[3] + drawable->bounding_sphere_radius){
+                ++graphics_context->render_stats.drawables_culled;
                 return;
             }
         }
     }
+    RenderStats* stats = &graphics_context->render_stats;
+    ++stats->drawables_drawn;
     Shader *shader = &graphics_context->shaders[drawable->shader_id];
     CHECK_GL_ERROR();
     glUseProgram(shader->gl_id);
@@ -1176,14 +1336,18 @@ void DrawDrawable(float *frustum_planes, GameState* game_state,
     glUniform1f(shader->uniforms[Shader::kTime], SDL_GetTicks()/1000.0f);
     glUniform1i(shader->uniforms[Shader::kLampTexID], 1);
     CHECK_GL_ERROR();
+    ++stats->program_binds;
+    stats->uniform_uploads += 8;
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, drawable->texture_id);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, game_state->lamp_shadow_tex);
     CHECK_GL_ERROR();
+    stats->texture_binds += 2;
 
     glBindBuffer(GL_ARRAY_BUFFER, drawable->vert_vbo);
+    stats->buffer_binds += 2; // Vertices, then indices in each case below
     switch(drawable->vbo_layout){
     case kSimple_4V:
         glUniformMatrix4fv(shader->uniforms[Shader::kModelviewMat4], 1, false, (GLfloat*)&modelview_mat);
@@ -1194,6 +1358,7 @@ void DrawDrawable(float *frustum_planes, GameState* game_state,
         glDrawElements(GL_TRIANGLES, drawable->num_indices, GL_UNSIGNED_INT, 0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         glDisableVertexAttribArray(0);
+        stats->uniform_uploads += 2;
         break;
     case kInterleave_3V2T3N:
         glUniformMatrix4fv(shader->uniforms[Shader::kModelviewMat4], 1, false, (GLfloat*)&modelview_mat);
@@ -1211,13 +1376,15 @@ void DrawDrawable(float *frustum_planes, GameState* game_state,
         glDisableVertexAttribArray(2);
         glDisableVertexAttribArray(1);
         glDisableVertexAttribArray(0);
+        stats->uniform_uploads += 3;
         break;
     case kInterleave_3V2T3N4I4W: {
-        SDL_assert(drawable->character != NULL);
-        Character* character = drawable->character;
-        ParseMesh* parse_mesh = &character->character_asset->parse_mesh;
+        SDL_assert(drawable->character != -1);
+        Character* character = &game_state->characters[drawable->character];
+        ParseMesh* parse_mesh = &game_state->character_assets[character->character_asset].parse_mesh;
         int animation = 1;//1;
-        int frame = (int)character->walk_cycle_frame - parse_mesh->animations[animation].first_frame;
+        int frame = (int)game_state->bodies.walk_cycle_frame[drawable->character] - 
+                    parse_mesh->animations[animation].first_frame;
         int start_anim_transform = 
             parse_mesh->animations[animation].anim_transform_start +
             parse_mesh->num_bones * frame;
@@ -1272,10 +1439,13 @@ void DrawDrawable(float *frustum_planes, GameState* game_state,
         glDisableVertexAttribArray(1);
         CHECK_GL_ERROR();
         glDisableVertexAttribArray(0);
+        stats->uniform_uploads += 4;
         } break;
     }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glUseProgram(0);
+    ++stats->draw_calls;
+    stats->triangles += drawable->num_indices / 3;
 }
 
 // Adapted from http://www.iquilezles.org/www/articles/frustum/frustum.htm
@@ -1306,7 +1476,9 @@ void SetProjectionMatrix(mat4 *proj_mat, float* planes, float fovy, float aspect
     }
 }
 
-void GameState::Draw(GraphicsContext* context, int ticks, Profiler* profiler) {
+void GameState::Draw(GraphicsContext* context, int ticks, float interpolation, 
+                     Profiler* profiler) 
+{
     CHECK_GL_ERROR();
 
     fog_color = vec3(0.1,0.2,0.3);
@@ -1320,21 +1492,31 @@ void GameState::Draw(GraphicsContext* context, int ticks, Profiler* profiler) {
     mat4 proj_mat;
     float planes[24];
     SetProjectionMatrix(&proj_mat, planes, camera_fov, aspect_ratio, 0.1f, 100.0f);
-    mat4 view_mat = inverse(camera.GetMatrix());
+    Camera draw_camera;
+    draw_camera.position = mix(prev_camera.position, camera.position, interpolation);
+    draw_camera.rotation_x = mix(prev_camera.rotation_x, camera.rotation_x, interpolation);
+    draw_camera.rotation_y = mix(prev_camera.rotation_y, camera.rotation_y, interpolation);
+    mat4 view_mat = inverse(draw_camera.GetMatrix());
 
-    for(int i=0; i<kMaxCharacters; ++i){
+    for(int i=0; i<num_characters; ++i){
         if(characters[i].exists) {
-            drawables[characters[i].drawable].transform = characters[i].transform.GetCombination();
+            SeparableTransform transform;
+            transform.translation = bodies.GetInterpolatedPosition(i, interpolation);
+            transform.rotation = angleAxis(bodies.GetInterpolatedRotation(i, interpolation), 
+                                           vec3(0,1,0));
+            drawables[characters[i].drawable].transform = transform.GetCombination();
         }
     }
 
     profiler->StartEvent("Draw drawables");
+    context->gpu_profiler.StartZone("Draw drawables");
     for(int i=0; i<num_drawables; ++i){
         Drawable* drawable = &drawables[i];
         CHECK_GL_ERROR();
         DrawDrawable(planes, this, context, proj_mat, view_mat, drawable, profiler);
         CHECK_GL_ERROR();
     }
+    context->gpu_profiler.EndZone();
     profiler->EndEvent();
 
     static const bool draw_coordinate_grid = false;
@@ -1345,48 +1527,235 @@ void GameState::Draw(GraphicsContext* context, int ticks, Profiler* profiler) {
     }
     if(kDrawNavMesh){
         profiler->StartEvent("Draw nav mesh");
+        context->gpu_profiler.StartZone("Draw nav mesh");
         nav_mesh.Draw(context, proj_mat * view_mat);
         CHECK_GL_ERROR();
+        context->gpu_profiler.EndZone();
         profiler->EndEvent();
     }
     profiler->StartEvent("Draw debug lines");
+    context->gpu_profiler.StartZone("Draw debug lines");
     lines.Draw(context, profiler, proj_mat * view_mat);
+    context->gpu_profiler.EndZone();
     profiler->EndEvent();
     CHECK_GL_ERROR();
     debug_text.Draw(context, ticks/1000.0f);
     CHECK_GL_ERROR();
 }
 
-void GameState::CharacterCollisions(Character* characters, float time_step) {
-    // TODO: this is O(n^2), divide into grid or something
+void GameState::ScheduleMinds() {
+    PROFILE_SCOPE("Schedule minds");
+    // Minds near the player, or near the free camera in the editor, stay active
+    static const int kMaxCenters = 2;
+    vec3 centers[kMaxCenters];
+    int num_centers = 0;
+    for(int i=0; i<num_characters; ++i){
+        if(characters[i].exists && characters[i].mind.state == Mind::kPlayerControlled){
+            centers[num_centers++] = bodies.GetPosition(i);
+            break;
+        }
+    }
+    if(editor_mode || num_centers == 0){
+        centers[num_centers++] = camera.position;
+    }
+    int activations_left = kMaxMindActivationsPerTick;
+    for(int i=0; i<num_characters; ++i){
+        Mind& mind = characters[i].mind;
+        if(!characters[i].exists){
+            mind.think_this_tick = false;
+            continue;
+        }
+        float dist = mind.active ? kDeactivateMindDist : kActivateMindDist;
+        // Revealed characters are in the fight with the player and fight 
+        // each other, keep them active wherever they are
+        bool near = characters[i].revealed;
+        for(int j=0; j<num_centers; ++j){
+            if(distance2(bodies.GetPosition(i), centers[j]) < dist * dist){
+                near = true;
+            }
+        }
+        if(near && !mind.active){
+            if(activations_left > 0){
+                // Put it back on the nav mesh, the next nav pass slides it inside
+                bodies.nav_tri[i] = nav_mesh.ClosestTriToPoint(bodies.GetPosition(i));
+                --activations_left;
+            } else {
+                near = false;
+            }
+        } else if(!near && mind.active){
+            bodies.nav_tri[i] = -1;
+        }
+        mind.active = near;
+        mind.think_this_tick = near;
+    }
+    // Round robin over the inactive minds
+    int budget = kInactiveMindsPerTick;
+    for(int k=0; k<num_characters && budget > 0; ++k){
+        int i = (next_inactive_mind + k) % num_characters;
+        Mind& mind = characters[i].mind;
+        if(characters[i].exists && !mind.active){
+            mind.think_this_tick = true;
+            --budget;
+            next_inactive_mind = (i + 1) % num_characters;
+        }
+    }
+}
+
+void GameState::PlanPaths() {
+    PROFILE_SCOPE("Plan paths");
+    // Revealed characters all seek the player, so they share a flow field
+    // toward the player instead of searching a path each
+    int player = -1;
+    for(int i=0; i<num_characters; ++i){
+        if(characters[i].exists && characters[i].mind.state == Mind::kPlayerControlled){
+            player = i;
+            break;
+        }
+    }
+    bool player_flow_field_updated = false;
+    for(int i=0; i<num_characters; ++i){
+        Mind& mind = characters[i].mind;
+        if(!characters[i].exists || !mind.think_this_tick){
+            continue;
+        }
+        mind.follow_path = false;
+        int target = mind.seek_target;
+        if(mind.state != Mind::kSeekTarget || !characters[target].exists ||
+           bodies.nav_tri[i] == -1 || bodies.nav_tri[target] == -1)
+        {
+            continue;
+        }
+        vec3 pos = bodies.GetPosition(i);
+        vec3 target_pos = bodies.GetPosition(target);
+        // Close enough ones don't walk towards it, see ThinkBatch
+        if(distance(pos, target_pos) <= mind.seek_target_distance[1]){
+            continue;
+        }
+        vec3 corner;
+        bool found;
+        if(target == player){
+            if(!player_flow_field_updated){
+                player_flow_field.SetGoal(target_pos, bodies.nav_tri[target]);
+                player_flow_field_updated = true;
+            }
+            found = player_flow_field.GetWaypoint(bodies.nav_tri[i], &corner);
+        } else {
+            vec3 path[2];
+            found = nav_pathfinder.FindPath(pos, bodies.nav_tri[i], target_pos, bodies.nav_tri[target],
+                                            path, 2) == 2;
+            corner = path[1];
+        }
+        if(found && distance2(corner, pos) > 0.001f * 0.001f){
+            mind.path_corner = corner;
+            mind.follow_path = true;
+        }
+    }
+}
+
+int GameState::NumCharactersAlive() {
+    int num_alive = 0;
+    for(int i=0; i<num_characters; ++i){
+        if(characters[i].exists){
+            ++num_alive;
+        }
+    }
+    return num_alive;
+}
+
+int GameState::NumActiveMinds() {
+    int num_active = 0;
+    for(int i=0; i<num_characters; ++i){
+        if(characters[i].exists && characters[i].mind.active){
+            ++num_active;
+        }
+    }
+    return num_active;
+}
+
+// FNV-1a, continuing from hash
+static Uint32 HashBytes(Uint32 hash, const void* data, int size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(int i=0; i<size; ++i){
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+Uint32 GameState::CalcChecksum() const {
+    Uint32 hash = 2166136261u;
+    int float_bytes = num_characters * sizeof(float);
+    hash = HashBytes(hash, &game_time, sizeof(game_time));
+    hash = HashBytes(hash, bodies.pos_x, float_bytes);
+    hash = HashBytes(hash, bodies.pos_y, float_bytes);
+    hash = HashBytes(hash, bodies.pos_z, float_bytes);
+    hash = HashBytes(hash, bodies.vel_x, float_bytes);
+    hash = HashBytes(hash, bodies.vel_y, float_bytes);
+    hash = HashBytes(hash, bodies.vel_z, float_bytes);
+    hash = HashBytes(hash, bodies.rotation, float_bytes);
+    hash = HashBytes(hash, bodies.walk_cycle_frame, float_bytes);
+    hash = HashBytes(hash, bodies.energy, float_bytes);
+    hash = HashBytes(hash, bodies.nav_tri, num_characters * sizeof(int));
+    // Field by field, the padding in Character is uninitialized
+    for(int i=0; i<num_characters; ++i){
+        const Character& character = characters[i];
+        int seek_target = (character.mind.state == Mind::kSeekTarget) ? 
+                          character.mind.seek_target : -1;
+        int fields[] = {character.exists, character.revealed, character.tether_target,
+                        character.mind.state, seek_target};
+        hash = HashBytes(hash, fields, sizeof(fields));
+        hash = HashBytes(hash, &character.random.state, sizeof(character.random.state));
+    }
+    return hash;
+}
+
+void GameState::CharacterCollisions(float time_step) {
     static const float kCollideDist = 0.7f;
     static const float kCollideDist2 = kCollideDist * kCollideDist;
-    for(int i=0; i<kMaxCharacters; ++i){
-        for(int j=0; j<kMaxCharacters; ++j){
-            vec3 *translation[] = {&characters[i].transform.translation, 
-                                   &characters[j].transform.translation};
+    // character_hash holds positions from before this pass, and resolving a 
+    // collision moves both characters, so search a little wider than 
+    // kCollideDist and test the current positions below
+    static const float kQueryDist = kCollideDist * 2.0f;
+    // Inactive characters are only pushed around by active ones, so pairs 
+    // are visited from their active side
+    for(int i=0; i<num_characters; ++i){
+        if(!characters[i].exists || !characters[i].mind.active){
+            continue;
+        }
+        int nearby[kMaxQueryResults];
+        int num_nearby = character_hash.QueryRadius(bodies.GetPosition(i), 
+                                                    kQueryDist, nearby, kMaxQueryResults);
+        // Query order depends on the hash, visit pairs in index order like before
+        qsort(nearby, num_nearby, sizeof(int), CompareInts);
+        for(int k=0; k<num_nearby; ++k){
+            int j = nearby[k];
             Character* chars[] = {&characters[i], &characters[j]};
             int char_ids[] = {i, j};
-            if(i!=j && chars[0]->exists && chars[1]->exists &&
-               distance2(*translation[0], *translation[1]) < kCollideDist2)
+            if(i==j || !chars[0]->exists || !chars[1]->exists || 
+               (j<i && chars[1]->mind.active))
             {
-                vec3 mid = (*translation[0]+*translation[1]) * 0.5f;
-                vec3 dir = *translation[1]-*translation[0];
+                continue;
+            }
+            vec3 translation[] = {bodies.GetPosition(i), bodies.GetPosition(j)};
+            if(distance2(translation[0], translation[1]) < kCollideDist2) {
+                vec3 mid = (translation[0]+translation[1]) * 0.5f;
+                vec3 dir = translation[1]-translation[0];
                 if(length2(dir) > 0.01f){
                     dir = normalize(dir);
                 } else {
-                    vec2 circle = glm::circularRand(1.0f);
+                    vec2 circle = chars[0]->random.Circular(1.0f);
                     dir = vec3(circle[0], 0.0f, circle[1]);
                 }
                 vec3 new_translation[2];
                 new_translation[0] = mid - dir * kCollideDist * 0.5f;
                 new_translation[1] = mid + dir * kCollideDist * 0.5f;
                 if(time_step != 0.0f){
-                    characters[i].velocity += (new_translation[0] - *translation[0])/time_step;
-                    characters[j].velocity += (new_translation[1] - *translation[1])/time_step;
+                    bodies.SetVelocity(i, bodies.GetVelocity(i) + 
+                        (new_translation[0] - translation[0])/time_step);
+                    bodies.SetVelocity(j, bodies.GetVelocity(j) + 
+                        (new_translation[1] - translation[1])/time_step);
                 }
-                *translation[0] = new_translation[0];
-                *translation[1] = new_translation[1];
+                bodies.SetPosition(i, new_translation[0]);
+                bodies.SetPosition(j, new_translation[1]);
                 for(int k=0; k<2; ++k){
                     if(chars[k]->type == Character::kPlayer){
                         Character* other = chars[1-k];
@@ -1407,16 +1776,16 @@ void GameState::CharacterCollisions(Character* characters, float time_step) {
                         }
                         switch(other->type){
                         case Character::kRed:
-                            other->energy -= time_step;
-                            chars[k]->energy -= time_step;
+                            bodies.energy[char_ids[1-k]] -= time_step;
+                            bodies.energy[char_ids[k]] -= time_step;
                             break;
                         }
                     }
                     if(chars[k]->type == Character::kRed && chars[k]->revealed &&
                         chars[1-k]->type == Character::kGreen && chars[1-k]->revealed)
                     {
-                        chars[k]->energy -= time_step;
-                        chars[1-k]->energy -= time_step;
+                        bodies.energy[char_ids[k]] -= time_step;
+                        bodies.energy[char_ids[1-k]] -= time_step;
                     }                    
                 }
             }
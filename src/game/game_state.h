@@ -3,8 +3,13 @@
 #define GAME_GAME_STATE_H
 
 #include "glm/glm.hpp"
+#include "game/character_movement.h"
+#include "game/nav_flow_field.h"
 #include "game/nav_mesh.h"
+#include "game/nav_path.h"
+#include "internal/random.h"
 #include "internal/separable_transform.h"
+#include "internal/spatial_hash.h"
 #include "platform_sdl/blender_file_io.h"
 #include "platform_sdl/debug_draw.h"
 #include "platform_sdl/debug_text.h"
@@ -21,6 +26,7 @@ struct GraphicsContext;
 struct AudioContext;
 class ParseMesh;
 class Profiler;
+class JobSystem;
 
 struct CharacterAsset {
     ParseMesh parse_mesh;
@@ -41,8 +47,18 @@ struct Mind {
     float seek_target_distance[2];
     State state;
     glm::vec3 dir;
+    // Set by GameState::PlanPaths() for seekers on the nav mesh that are
+    // too far from their target: the next corner of the path to it
+    glm::vec3 path_corner;
+    bool follow_path;
+    // Near the player: thinks every tick and walks the nav mesh. Others only
+    // think when their turn comes round and move without the nav mesh.
+    bool active;
+    bool think_this_tick;
 };
 
+// Per-character data that is not touched every tick, the rest is in 
+// CharacterBodies
 struct Character {
     bool exists;
     enum Type {
@@ -51,22 +67,75 @@ struct Character {
         kRed
     };
     int drawable;
-    glm::vec3 velocity;
-    SeparableTransform transform;
-    NavMeshWalker nav_mesh_walker;
-    static const int kWalkCycleStart = 31;
-    static const int kWalkCycleEnd = 58;
-    float walk_cycle_frame;
-    CharacterAsset* character_asset;
-    float rotation;
+    int character_asset; // Index into GameState::character_assets
     Mind mind;
     glm::vec4 color;
     bool revealed;
     int tether_target;
     Type type;
-    float energy;
+    RandomStream random; // Only this character's own updates roll it
 };
 
+// Per-character state the simulation touches every tick, one array per 
+// component so passes over all characters only stream the fields they use.
+// Indexed the same as GameState::characters.
+struct CharacterBodies {
+    static const int kMaxCharacters = 4096;
+    float pos_x[kMaxCharacters];
+    float pos_y[kMaxCharacters];
+    float pos_z[kMaxCharacters];
+    float vel_x[kMaxCharacters];
+    float vel_y[kMaxCharacters];
+    float vel_z[kMaxCharacters];
+    float target_x[kMaxCharacters]; // Movement direction chosen this tick
+    float target_y[kMaxCharacters];
+    float target_z[kMaxCharacters];
+    float rotation[kMaxCharacters];
+    float turn_speed[kMaxCharacters];
+    float walk_cycle_frame[kMaxCharacters];
+    float energy[kMaxCharacters];
+    int nav_tri[kMaxCharacters];
+    // Transforms as of the previous tick, drawing blends from these
+    float prev_pos_x[kMaxCharacters];
+    float prev_pos_y[kMaxCharacters];
+    float prev_pos_z[kMaxCharacters];
+    float prev_rotation[kMaxCharacters];
+
+    glm::vec3 GetPosition(int index) const;
+    void SetPosition(int index, const glm::vec3& pos);
+    glm::vec3 GetVelocity(int index) const;
+    void SetVelocity(int index, const glm::vec3& vel);
+    void SetTarget(int index, const glm::vec3& dir);
+    void SavePreviousTransforms();
+    // Position and rotation blended from the previous tick, interpolation in [0,1]
+    glm::vec3 GetInterpolatedPosition(int index, float interpolation) const;
+    float GetInterpolatedRotation(int index, float interpolation) const;
+    // Movement view of the first count characters
+    CharacterMovement GetMovement(int count);
+};
+
+// Controls for one tick, read from the keyboard and mouse or generated by a 
+// script, so Update() never polls devices itself
+struct SimulationInput {
+    enum Button {
+        kForward = 1 << 0,
+        kBack = 1 << 1,
+        kLeft = 1 << 2,
+        kRight = 1 << 3,
+        kSlow = 1 << 4,
+        kToggleEditor = 1 << 5,
+        kMouseLook = 1 << 6
+    };
+    Uint32 buttons; // Bitmask of Button values held this tick
+    glm::vec2 mouse_rel; // Mouse motion since the previous tick
+};
+
+// Fill input from the current SDL keyboard and mouse button state
+void ReadSimulationInput(SimulationInput* input, const glm::vec2& mouse_rel);
+// Fill input for runs without a player: walk around a square, then stand 
+// still for a while
+void GetScriptedInput(int tick, float tick_seconds, SimulationInput* input);
+
 struct Camera {
     float rotation_x;
     float rotation_y;
@@ -89,15 +158,16 @@ struct Drawable {
     int shader_id;
     glm::vec3 bounding_sphere_center;
     float bounding_sphere_radius;
-    Character* character;
+    int character; // Index into GameState::characters, or -1
     VBO_Setup vbo_layout;
     glm::mat4 transform;
 };
 
 class GameState {
 public:
-    static const int kMaxDrawables = 1000;
-    static const int kMaxCharacters = 100;
+    static const int kMaxCharacters = CharacterBodies::kMaxCharacters;
+    static const int kMaxDrawables = 1000 + kMaxCharacters;
+    static const int kDefaultNumCharacters = 100;
     static const int kMaxCharacterAssets = 4;
     int num_character_assets;
     CharacterAsset character_assets[kMaxCharacterAssets];
@@ -106,12 +176,20 @@ public:
     DebugDrawLines lines;
     DebugText debug_text;
     float camera_fov;
+    int num_characters; // Set before Init(), slots in use up to kMaxCharacters
     Character characters[kMaxCharacters];
+    CharacterBodies bodies;
+    SpatialHash character_hash; // Rebuilt each Update() after characters move
     Camera camera;
+    Camera prev_camera; // As of the previous tick
     int char_drawable;
+    int next_inactive_mind; // Where the round robin of inactive minds resumes
     bool editor_mode;
+    bool toggle_editor_held; // As of the previous tick, so holding it only toggles once
     TextAtlas text_atlas;
     NavMesh nav_mesh;
+    NavPathfinder nav_pathfinder;
+    NavFlowField player_flow_field; // Toward the player, for everyone seeking them
     static const int kMaxOggTracks = 10;
     int num_ogg_tracks;
     OggTrack ogg_track[kMaxOggTracks];
@@ -126,12 +204,29 @@ public:
     static const int kMapSize = 30;
     int tile_height[kMapSize * kMapSize];
 
-    void Update(const glm::vec2& mouse_rel, float time_step);
+    double game_time; // Seconds of simulation since Init()
+    Uint32 random_seed; // Set before Init(), seeds every random stream
+    JobSystem* job_system; // Set before Init(), runs the per-character passes
+    bool headless; // Set before Init(), skips creating GPU and audio resources
+
+    int NumCharactersAlive();
+    int NumActiveMinds(); // See ScheduleMinds()
+    // Hash of the simulation state, equal for runs that stayed in sync
+    Uint32 CalcChecksum() const;
+
+    // Advance the simulation by one tick
+    void Update(const SimulationInput& input, float time_step);
     void Init(int* init_stage, GraphicsContext* graphics_context, AudioContext* audio_context, 
               Profiler* profiler, FileLoadThreadData* file_load_thread_data, 
               StackAllocator* stack_allocator);
-    void Draw(GraphicsContext* context, int ticks, Profiler* profiler);
-    void CharacterCollisions(Character* characters, float time_step);
+    // interpolation is the fraction of a tick since the last Update(), 
+    // characters and camera are drawn that far from the previous tick
+    void Draw(GraphicsContext* context, int ticks, float interpolation, Profiler* profiler);
+    void CharacterCollisions(float time_step);
+    // Decide which minds are active and which of the rest think this tick
+    void ScheduleMinds();
+    // Find the next path corner for the seeking minds that think this tick
+    void PlanPaths();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "game/input_recording.h"
+#include "game/game_state.h"
+#include "internal/memory.h"
+#include "platform_sdl/logger.h"
+#include <SDL.h>
+#include <cfloat>
+#include <cstring>
+
+static const Uint32 kRecordingMagic = 0x52494755; // "UGIR" little endian
+static const Uint32 kRecordingVersion = 1;
+static const int kHeaderSize = 5 * sizeof(Uint32);
+// Set in a tick's button byte when two mouse motion floats follow it
+static const Uint8 kHasMouseMotion = 0x80;
+
+static Uint32 FloatBits(float val) {
+    Uint32 bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+static Uint32 ReadLE32(const Uint8* data) {
+    Uint32 val;
+    memcpy(&val, data, sizeof(val));
+    return SDL_SwapLE32(val);
+}
+
+static float ReadFloatLE(const Uint8* data) {
+    Uint32 bits = ReadLE32(data);
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+bool InputRecorder::Start(const char* path, const InputRecordingHeader& header) {
+    num_ticks = 0;
+    file = SDL_RWFromFile(path, "wb");
+    if(!file){
+        LogMessage(kLogError, "Could not open %s for recording input: %s", path, SDL_GetError());
+        return false;
+    }
+    SDL_WriteLE32(file, kRecordingMagic);
+    SDL_WriteLE32(file, kRecordingVersion);
+    SDL_WriteLE32(file, header.random_seed);
+    SDL_WriteLE32(file, (Uint32)header.num_characters);
+    SDL_WriteLE32(file, FloatBits(header.tick_seconds));
+    LogMessage(kLogInfo, "Recording input to %s", path);
+    return true;
+}
+
+void InputRecorder::AddTick(const SimulationInput& input) {
+    // Buttons fit in the low seven bits
+    SDL_assert((input.buttons & ~0x7F) == 0);
+    Uint8 buttons = (Uint8)input.buttons;
+    bool has_mouse_motion = input.mouse_rel[0] != 0.0f || input.mouse_rel[1] != 0.0f;
+    if(has_mouse_motion){
+        buttons |= kHasMouseMotion;
+    }
+    SDL_WriteU8(file, buttons);
+    if(has_mouse_motion){
+        SDL_WriteLE32(file, FloatBits(input.mouse_rel[0]));
+        SDL_WriteLE32(file, FloatBits(input.mouse_rel[1]));
+    }
+    ++num_ticks;
+}
+
+void InputRecorder::Finish() {
+    SDL_RWclose(file);
+    file = NULL;
+    LogMessage(kLogInfo, "Recorded %d ticks of input", num_ticks);
+}
+
+bool InputPlayer::Load(const char* path, StackAllocator* stack_allocator) {
+    SDL_RWops* file = SDL_RWFromFile(path, "rb");
+    if(!file){
+        LogMessage(kLogError, "Could not open input recording %s: %s", path, SDL_GetError());
+        return false;
+    }
+    Sint64 size = SDL_RWsize(file);
+    if(size < kHeaderSize || size > 0x7FFFFFFF){
+        LogMessage(kLogError, "%s is not an input recording", path);
+        SDL_RWclose(file);
+        return false;
+    }
+    data_len = (int)size;
+    Uint8* mem = (Uint8*)stack_allocator->Alloc(data_len);
+    if(!mem){
+        LogMessage(kLogError, "Could not allocate %d bytes for input recording %s", data_len, path);
+        SDL_RWclose(file);
+        return false;
+    }
+    size_t bytes_read = SDL_RWread(file, mem, 1, data_len);
+    SDL_RWclose(file);
+    if((int)bytes_read != data_len || ReadLE32(&mem[0]) != kRecordingMagic ||
+       ReadLE32(&mem[4]) != kRecordingVersion)
+    {
+        LogMessage(kLogError, "%s is not an input recording of version %d", path, kRecordingVersion);
+        stack_allocator->Free(mem);
+        return false;
+    }
+    header.random_seed = ReadLE32(&mem[8]);
+    header.num_characters = (int)ReadLE32(&mem[12]);
+    header.tick_seconds = ReadFloatLE(&mem[16]);
+    // The tick rate is taken from here, so hold it to what --tick-rate
+    // accepts: above zero, and finite both ways round. Also catches NaN.
+    if(!(header.tick_seconds > 0.0f && header.tick_seconds <= FLT_MAX &&
+         1.0f / header.tick_seconds <= FLT_MAX))
+    {
+        LogMessage(kLogError, "%s has an invalid tick length of %g seconds", path, header.tick_seconds);
+        stack_allocator->Free(mem);
+        return false;
+    }
+    data = mem;
+
+    // Count the ticks, dropping a last one cut short by a crash
+    num_ticks = 0;
+    int pos = kHeaderSize;
+    while(pos < data_len){
+        int tick_size = (data[pos] & kHasMouseMotion) ? 9 : 1;
+        if(pos + tick_size > data_len){
+            break;
+        }
+        pos += tick_size;
+        ++num_ticks;
+    }
+    tick = 0;
+    read_pos = kHeaderSize;
+    LogMessage(kLogInfo, "Loaded %d ticks of input from %s", num_ticks, path);
+    return true;
+}
+
+bool InputPlayer::NextTick(SimulationInput* input) {
+    if(tick >= num_ticks){
+        return false;
+    }
+    Uint8 buttons = data[read_pos++];
+    input->buttons = buttons & ~kHasMouseMotion;
+    input->mouse_rel = glm::vec2(0.0f);
+    if(buttons & kHasMouseMotion){
+        input->mouse_rel[0] = ReadFloatLE(&data[read_pos]);
+        input->mouse_rel[1] = ReadFloatLE(&data[read_pos+4]);
+        read_pos += 8;
+    }
+    ++tick;
+    return true;
+}
+
+void InputPlayer::Seek(int target_tick) {
+    // Ticks vary in size, so count them from the start
+    tick = 0;
+    read_pos = kHeaderSize;
+    while(tick < target_tick && tick < num_ticks){
+        read_pos += (data[read_pos] & kHasMouseMotion) ? 9 : 1;
+        ++tick;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef GAME_INPUT_RECORDING_H
+#define GAME_INPUT_RECORDING_H
+
+#include <SDL.h>
+
+struct SimulationInput;
+class StackAllocator;
+
+// Everything besides the per-tick input needed to repeat a run exactly
+struct InputRecordingHeader {
+    Uint32 random_seed;
+    int num_characters;
+    float tick_seconds;
+};
+
+// Writes the input of every simulation tick to a file as it happens. Each
+// tick is one byte of buttons, plus the mouse motion on ticks that have any.
+class InputRecorder {
+public:
+    bool Start(const char* path, const InputRecordingHeader& header);
+    void AddTick(const SimulationInput& input);
+    void Finish();
+    int num_ticks;
+private:
+    SDL_RWops* file;
+};
+
+// Reads a whole recording into memory and hands back its ticks in order
+class InputPlayer {
+public:
+    // Returns false if the file is missing or not a recording
+    bool Load(const char* path, StackAllocator* stack_allocator);
+    // Returns false once every tick has been played
+    bool NextTick(SimulationInput* input);
+    // Make tick the next one NextTick() returns
+    void Seek(int tick);
+    InputRecordingHeader header;
+    int num_ticks;
+    int tick; // Next tick NextTick() returns
+private:
+    const Uint8* data;
+    int data_len;
+    int read_pos;
+};
+
+#endif
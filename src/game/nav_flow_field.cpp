@@ -0,0 +1,192 @@
+#include "game/nav_flow_field.h"
+#include "game/nav_mesh.h"
+#include "internal/memory.h"
+#include "platform_sdl/error.h"
+#include "glm/glm.hpp"
+#include "glm/gtx/norm.hpp"
+#include <SDL.h>
+
+using namespace glm;
+
+static const float kUnreachableCost = 1.0e30f;
+// Waypoints stay this far from the ends of their edge, so characters don't
+// cut corners into walls
+static const float kCornerClearance = 0.3f;
+
+void NavFlowField::Init(const NavMesh* p_nav, StackAllocator* stack_allocator) {
+    nav = p_nav;
+    num_tris = nav->num_indices / 3;
+    int mem_size = num_tris * (sizeof(float) + sizeof(int) + sizeof(vec3)) +
+                   (nav->num_indices + 2) * sizeof(HeapEntry);
+    void* mem = stack_allocator->Alloc(mem_size);
+    if(!mem){
+        FormattedError("Error", "Could not allocate a flow field for %d nav mesh triangles", num_tris);
+        exit(1);
+    }
+    cost = (float*)mem;
+    next_tri = (int*)(cost + num_tris);
+    waypoint = (vec3*)(next_tri + num_tris);
+    heap = (HeapEntry*)(waypoint + num_tris);
+    for(int i=0; i<num_tris; ++i){
+        cost[i] = kUnreachableCost;
+        next_tri[i] = -1;
+        waypoint[i] = vec3(0.0f);
+    }
+    heap_size = 0;
+    goal_tri = -1;
+    goal = vec3(0.0f);
+    num_incremental_updates = 0;
+}
+
+void NavFlowField::Dispose(StackAllocator* stack_allocator) {
+    stack_allocator->Free(cost);
+}
+
+// Ties go to the lower triangle
+bool NavFlowField::HeapLess(const HeapEntry& a, const HeapEntry& b) {
+    return a.cost < b.cost || (a.cost == b.cost && a.tri < b.tri);
+}
+
+void NavFlowField::HeapPush(float tri_cost, int tri) {
+    SDL_assert(heap_size < nav->num_indices + 2);
+    HeapEntry entry;
+    entry.cost = tri_cost;
+    entry.tri = tri;
+    int pos = heap_size++;
+    while(pos > 0){
+        int parent_pos = (pos - 1) / 2;
+        if(!HeapLess(entry, heap[parent_pos])){
+            break;
+        }
+        heap[pos] = heap[parent_pos];
+        pos = parent_pos;
+    }
+    heap[pos] = entry;
+}
+
+NavFlowField::HeapEntry NavFlowField::HeapPop() {
+    HeapEntry top = heap[0];
+    HeapEntry entry = heap[--heap_size];
+    int pos = 0;
+    while(true){
+        int child_pos = pos * 2 + 1;
+        if(child_pos >= heap_size){
+            break;
+        }
+        if(child_pos + 1 < heap_size && HeapLess(heap[child_pos+1], heap[child_pos])){
+            ++child_pos;
+        }
+        if(!HeapLess(heap[child_pos], entry)){
+            break;
+        }
+        heap[pos] = heap[child_pos];
+        pos = child_pos;
+    }
+    if(heap_size > 0){
+        heap[pos] = entry;
+    }
+    return top;
+}
+
+// Point on the edge from a to b nearest to target, kept clear of the ends
+static vec3 EdgePointNearest(const vec3& a, const vec3& b, const vec3& target) {
+    vec3 edge = b - a;
+    float edge_len2 = length2(edge);
+    if(edge_len2 == 0.0f){
+        return a;
+    }
+    float inset = min(0.5f, kCornerClearance / sqrtf(edge_len2));
+    float t = clamp(dot(target - a, edge) / edge_len2, inset, 1.0f - inset);
+    return a + edge * t;
+}
+
+void NavFlowField::Propagate() {
+    while(heap_size > 0){
+        HeapEntry entry = HeapPop();
+        int tri = entry.tri;
+        if(entry.cost > cost[tri]){
+            // Pushed again since with a lower cost
+            continue;
+        }
+        for(int i=0; i<3; ++i){
+            int neighbor_edge = nav->tri_neighbors[tri*3+i];
+            if(neighbor_edge == -1){
+                continue;
+            }
+            int neighbor = neighbor_edge / 3;
+            vec3 point = EdgePointNearest(nav->verts[nav->indices[tri*3+i]],
+                                          nav->verts[nav->indices[tri*3+(i+1)%3]], waypoint[tri]);
+            float neighbor_cost = entry.cost + distance(point, waypoint[tri]);
+            if(neighbor_cost < cost[neighbor]){
+                cost[neighbor] = neighbor_cost;
+                next_tri[neighbor] = tri;
+                waypoint[neighbor] = point;
+                HeapPush(neighbor_cost, neighbor);
+            }
+        }
+    }
+}
+
+void NavFlowField::Rebuild() {
+    for(int i=0; i<num_tris; ++i){
+        cost[i] = kUnreachableCost;
+        next_tri[i] = -1;
+    }
+    heap_size = 0;
+    cost[goal_tri] = 0.0f;
+    waypoint[goal_tri] = goal;
+    HeapPush(0.0f, goal_tri);
+    Propagate();
+    num_incremental_updates = 0;
+}
+
+void NavFlowField::SetGoal(const vec3& p_goal, int p_goal_tri) {
+    SDL_assert(p_goal_tri >= 0 && p_goal_tri < num_tris);
+    goal = p_goal;
+    if(p_goal_tri == goal_tri){
+        return;
+    }
+    int old_goal_tri = goal_tri;
+    goal_tri = p_goal_tri;
+    bool neighbors = false;
+    if(old_goal_tri != -1 && num_incremental_updates < kMaxIncrementalUpdates){
+        for(int i=0; i<3; ++i){
+            int neighbor_edge = nav->tri_neighbors[old_goal_tri*3+i];
+            if(neighbor_edge != -1 && neighbor_edge / 3 == goal_tri){
+                neighbors = true;
+            }
+        }
+    }
+    if(!neighbors){
+        Rebuild();
+        return;
+    }
+    // The old goal triangle gets a cost from the new one like any other.
+    // Triangles that only pass by the new goal on the way to the old one get
+    // cheaper and are updated; the others keep leading into the old goal
+    // triangle, which now leads on to the new one. Their costs are too low by
+    // up to how far the goal moved since the last rebuild.
+    ++num_incremental_updates;
+    cost[old_goal_tri] = kUnreachableCost;
+    heap_size = 0;
+    cost[goal_tri] = 0.0f;
+    next_tri[goal_tri] = -1;
+    waypoint[goal_tri] = goal;
+    HeapPush(0.0f, goal_tri);
+    Propagate();
+}
+
+bool NavFlowField::GetWaypoint(int tri, vec3* tri_waypoint) const {
+    if(goal_tri == -1){
+        return false;
+    }
+    if(tri == goal_tri){
+        *tri_waypoint = goal;
+        return true;
+    }
+    if(next_tri[tri] == -1){
+        return false;
+    }
+    *tri_waypoint = waypoint[tri];
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef GAME_NAV_FLOW_FIELD_H
+#define GAME_NAV_FLOW_FIELD_H
+
+#include "glm/glm.hpp"
+
+class NavMesh;
+class StackAllocator;
+
+// Where to head from every triangle of a nav mesh to reach one goal, for
+// crowds that share a target. One Dijkstra pass from the goal over
+// tri_neighbors fills the field, after which each character only looks up
+// its own triangle, so a crowd costs triangles plus characters instead of
+// one search each.
+class NavFlowField {
+public:
+    // Full rebuilds happen at least this often, see SetGoal()
+    static const int kMaxIncrementalUpdates = 8;
+
+    // Allocates the field for the mesh's triangles, call once the mesh is final
+    void Init(const NavMesh* nav, StackAllocator* stack_allocator);
+    void Dispose(StackAllocator* stack_allocator);
+    // Point the field at goal. Moving within goal_tri keeps the field as it
+    // is. Moving to a neighboring triangle only updates the triangles that
+    // get closer, the rest keep leading through the old goal triangle, until
+    // kMaxIncrementalUpdates of those call for a full rebuild.
+    void SetGoal(const glm::vec3& goal, int goal_tri);
+    // Where a character in tri should head next, false if the goal can't be
+    // reached from tri or there is no goal yet
+    bool GetWaypoint(int tri, glm::vec3* waypoint) const;
+
+    int num_tris;
+    int goal_tri; // -1 until SetGoal()
+    glm::vec3 goal;
+    int num_incremental_updates; // Since the last full rebuild
+    // Per triangle, one allocation
+    float* cost; // Walking distance to the goal, through the waypoints
+    int* next_tri; // Triangle the waypoint leads into, -1 for the goal and where it can't be reached
+    glm::vec3* waypoint; // Point on the edge into next_tri, the goal itself in goal_tri
+
+private:
+    struct HeapEntry {
+        float cost;
+        int tri;
+    };
+    void Rebuild();
+    // Dijkstra from the triangles already in the heap, only ever lowering costs
+    void Propagate();
+    static bool HeapLess(const HeapEntry& a, const HeapEntry& b);
+    void HeapPush(float tri_cost, int tri);
+    HeapEntry HeapPop();
+
+    const NavMesh* nav;
+    // Triangles can be pushed again when their cost drops, and stale entries
+    // are skipped when popped, so this has room for every edge
+    HeapEntry* heap;
+    int heap_size;
+};
+
+#endif
@@ -1,33 +1,22 @@
 #include "game/nav_mesh.h"
 #include "internal/memory.h"
 #include "internal/common.h"
-#include "internal/geometry.h"
 #include "platform_sdl/error.h"
 #include "platform_sdl/graphics.h"
+#include "platform_sdl/logger.h"
 #include "glm/glm.hpp"
 #include "glm/gtx/norm.hpp"
 #include <GL/glew.h>
+#include <SDL.h>
+#include <cstring>
 
-using namespace glm;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NAV_MESH_SSE2
+#include <emmintrin.h>
+#endif
 
+using namespace glm;
 
-// Compute barycentric coordinates (u, v, w) for
-// point p with respect to triangle (a, b, c)
-// Transcribed from Christer Ericson's Real-Time Collision Detection
-// http://gamedev.stackexchange.com/a/23745
-void Barycentric(vec3 p, vec3 a, vec3 b, vec3 c, vec3* bary)
-{
-    vec3 v0 = b - a, v1 = c - a, v2 = p - a;
-    float d00 = dot(v0, v0);
-    float d01 = dot(v0, v1);
-    float d11 = dot(v1, v1);
-    float d20 = dot(v2, v0);
-    float d21 = dot(v2, v1);
-    float denom = d00 * d11 - d01 * d01;
-    (*bary)[1] = (d11 * d20 - d01 * d21) / denom;
-    (*bary)[2] = (d00 * d21 - d01 * d20) / denom;
-    (*bary)[0] = 1.0f - (*bary)[1] - (*bary)[2];
-}
 
 void NavMesh::Draw(GraphicsContext* graphics_context, const mat4& proj_view_mat) {
     Shader* the_shader = &graphics_context->shaders[shader];
@@ -42,124 +31,472 @@ void NavMesh::Draw(GraphicsContext* graphics_context, const mat4& proj_view_mat)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glUseProgram(0);
+    RenderStats* stats = &graphics_context->render_stats;
+    stats->buffer_binds += 2;
+    ++stats->program_binds;
+    ++stats->uniform_uploads;
+    ++stats->draw_calls;
+    stats->triangles += num_indices / 3;
 }
 
-struct Vec3EdgeHash {
-    int hash;
-    int tri_index;
-    vec3 verts[2];
-};
+// Verts this close on every axis are merged by WeldVerts()
+static const float kWeldDist = 0.01f;
 
-int Vec3EdgeHashSort(const void* a_ptr, const void* b_ptr){
-    const Vec3EdgeHash* a = (const Vec3EdgeHash*)a_ptr;
-    const Vec3EdgeHash* b = (const Vec3EdgeHash*)b_ptr;
-    if(a->hash < b->hash) {
-        return -1;
-    } else if(a->hash == b->hash){
-        return 0;
-    } else {
-        return 1;
+// Open addressing tables for welding and adjacency hold ints, -1 when empty,
+// and are at most half full
+static int* AllocHashTable(int count, int* table_mask, StackAllocator* stack_allocator) {
+    int table_size = 1;
+    while(table_size < count * 2){
+        table_size *= 2;
+    }
+    int* table = (int*)stack_allocator->Alloc(table_size * sizeof(int));
+    if(!table){
+        FormattedError("Error", "Could not allocate memory for a nav mesh hash table of %d entries", table_size);
+        exit(1);
     }
+    memset(table, 0xFF, table_size * sizeof(int));
+    *table_mask = table_size - 1;
+    return table;
 }
 
-void NavMesh::CalcNeighbors(StackAllocator* stack_allocator) {
-    //TODO: just compare each vec3 value in turn instead of using hashes, no need to risk collisions if don't have to
-    static const int kMaxEdges = 10000;
-    int num_unique_edges = 0;
-    Vec3EdgeHash* unique_verts = (Vec3EdgeHash*)stack_allocator->Alloc(
-        sizeof(Vec3EdgeHash)*kMaxEdges);
-    if(!unique_verts){
-        FormattedError("Error", "Could not allocate memory for Navmesh::CalcNeighbors unique_verts");
+static Uint32 HashInts(int a, int b, int c) {
+    return ((Uint32)a * 73856093u) ^ ((Uint32)b * 19349663u) ^ ((Uint32)c * 83492791u);
+}
+
+static void WeldCell(const vec3& vert, int* cell) {
+    for(int i=0; i<3; ++i){
+        cell[i] = (int)floorf(vert[i] / kWeldDist);
     }
-    for(int i=0; i<num_indices; i+=3){
-        for(int j=0; j<3; ++j){
-            tri_neighbors[i+j] = -1;
-            vec3 edge_verts[2] = {verts[indices[i+j]], verts[indices[i+(j+1)%3]]};
-            for(int k=0; k<2; ++k){
-                for(int l=0; l<3; ++l){
-                    edge_verts[k][l] = glm::round<float>(edge_verts[k][l]*100.0f)/100.0f;
+}
+
+void NavMesh::AllocMemory(int p_max_verts, int max_tris, StackAllocator* stack_allocator) {
+    max_verts = p_max_verts;
+    max_indices = max_tris * 3;
+    verts = (vec3*)stack_allocator->Alloc(max_verts * sizeof(vec3));
+    indices = (uint32_t*)stack_allocator->Alloc(max_indices * sizeof(uint32_t));
+    tri_neighbors = (int*)stack_allocator->Alloc(max_indices * sizeof(int));
+    if(!verts || !indices || !tri_neighbors){
+        FormattedError("Error", "Could not allocate memory for a nav mesh of %d triangles", max_tris);
+        exit(1);
+    }
+    num_verts = 0;
+    num_indices = 0;
+}
+
+void NavMesh::WeldVerts(StackAllocator* stack_allocator) {
+    // Each welded vert goes in the table under its cell, so any vert within
+    // kWeldDist of it is found by looking through the 27 cells around it
+    int table_mask;
+    int* table = AllocHashTable(num_verts, &table_mask, stack_allocator);
+    int* welded_index = (int*)stack_allocator->Alloc(max(num_verts, 1) * sizeof(int));
+    if(!welded_index){
+        FormattedError("Error", "Could not allocate memory for welding %d nav mesh verts", num_verts);
+        exit(1);
+    }
+    int num_welded = 0;
+    for(int i=0; i<num_verts; ++i){
+        vec3 vert = verts[i];
+        int cell[3];
+        WeldCell(vert, cell);
+        int match = -1;
+        for(int j=0; j<27 && match == -1; ++j){
+            Uint32 slot = HashInts(cell[0]+j%3-1, cell[1]+j/3%3-1, cell[2]+j/9-1) & table_mask;
+            for(; table[slot] != -1; slot = (slot+1) & table_mask){
+                vec3 offset = abs(verts[table[slot]] - vert);
+                if(offset[0] <= kWeldDist && offset[1] <= kWeldDist && offset[2] <= kWeldDist){
+                    match = table[slot];
+                    break;
                 }
             }
-            // Make sure that identical edges have verts in the same order
-            int vec3_hash[2];
-            for(int k=0; k<2; ++k){
-                vec3_hash[k] = djb2_hash_len((unsigned char*)&edge_verts[k], sizeof(vec3));
+        }
+        if(match == -1){
+            // Welded verts are packed at the front, behind the ones still to read
+            match = num_welded++;
+            verts[match] = vert;
+            Uint32 slot = HashInts(cell[0], cell[1], cell[2]) & table_mask;
+            while(table[slot] != -1){
+                slot = (slot+1) & table_mask;
             }
-            if(vec3_hash[0] > vec3_hash[1]){
-                vec3 temp = edge_verts[0];
-                edge_verts[0] = edge_verts[1];
-                edge_verts[1] = temp;
+            table[slot] = match;
+        }
+        welded_index[i] = match;
+    }
+    num_verts = num_welded;
+    int num_kept_indices = 0;
+    for(int i=0; i<num_indices; i+=3){
+        uint32_t tri[3];
+        for(int j=0; j<3; ++j){
+            tri[j] = welded_index[indices[i+j]];
+        }
+        if(tri[0] != tri[1] && tri[1] != tri[2] && tri[2] != tri[0]){
+            for(int j=0; j<3; ++j){
+                indices[num_kept_indices++] = tri[j];
             }
-            unique_verts[num_unique_edges].hash = djb2_hash_len((unsigned char*)edge_verts, sizeof(vec3)*2);
-            for(int k=0; k<2; ++k){
-                unique_verts[num_unique_edges].verts[k] = edge_verts[k];
+        }
+    }
+    if(num_kept_indices != num_indices){
+        LogMessage(kLogWarning, "Welding the nav mesh collapsed %d triangles",
+                   (num_indices - num_kept_indices) / 3);
+    }
+    num_indices = num_kept_indices;
+    stack_allocator->Free(welded_index);
+    stack_allocator->Free(table);
+}
+
+static void EdgeVerts(const NavMesh& nav, int edge, uint32_t* edge_verts) {
+    int next = edge - edge%3 + (edge%3+1)%3;
+    edge_verts[0] = min(nav.indices[edge], nav.indices[next]);
+    edge_verts[1] = max(nav.indices[edge], nav.indices[next]);
+}
+
+void NavMesh::CalcNeighbors(StackAllocator* stack_allocator) {
+    // Each edge waits in the table until the other edge with its verts shows up
+    int table_mask;
+    int* table = AllocHashTable(num_indices, &table_mask, stack_allocator);
+    int num_overshared = 0;
+    for(int i=0; i<num_indices; ++i){
+        tri_neighbors[i] = -1;
+        uint32_t edge_verts[2];
+        EdgeVerts(*this, i, edge_verts);
+        Uint32 slot = HashInts(edge_verts[0], edge_verts[1], 0) & table_mask;
+        for(; table[slot] != -1; slot = (slot+1) & table_mask){
+            uint32_t other_verts[2];
+            EdgeVerts(*this, table[slot], other_verts);
+            if(other_verts[0] == edge_verts[0] && other_verts[1] == edge_verts[1]){
+                break;
             }
-            unique_verts[num_unique_edges].hash = djb2_hash_len((unsigned char*)edge_verts, sizeof(vec3)*2);
-            unique_verts[num_unique_edges].tri_index = i+j;
-            ++num_unique_edges;
-            if(num_unique_edges >= kMaxEdges) {
-                FormattedError("Error", "Too many edges for CalcNeighbors");
-                exit(1);
+        }
+        int other = table[slot];
+        if(other == -1){
+            table[slot] = i;
+        } else if(tri_neighbors[other] == -1){
+            tri_neighbors[other] = i;
+            tri_neighbors[i] = other;
+        } else {
+            // Only the first two triangles on an edge are linked
+            ++num_overshared;
+        }
+    }
+    if(num_overshared){
+        LogMessage(kLogWarning, "%d nav mesh edges have more than two triangles", num_overshared);
+    }
+    stack_allocator->Free(table);
+}
+
+void NavMesh::CalcPlanes(StackAllocator* stack_allocator) {
+    int num_tris = num_indices / 3;
+    // One block for all eight arrays, triangle planes first
+    float* planes = (float*)stack_allocator->Alloc(max((num_tris + num_indices) * 4, 1) * sizeof(float));
+    if(!planes){
+        FormattedError("Error", "Could not allocate memory for the planes of %d nav mesh triangles", num_tris);
+        exit(1);
+    }
+    tri_normal_x = planes;
+    tri_normal_y = tri_normal_x + num_tris;
+    tri_normal_z = tri_normal_y + num_tris;
+    tri_plane_d = tri_normal_z + num_tris;
+    edge_normal_x = tri_plane_d + num_tris;
+    edge_normal_y = edge_normal_x + num_indices;
+    edge_normal_z = edge_normal_y + num_indices;
+    edge_plane_d = edge_normal_z + num_indices;
+    for(int i=0; i<num_tris; ++i){
+        vec3 tri_verts[3];
+        for(int j=0; j<3; ++j){
+            tri_verts[j] = verts[indices[i*3+j]];
+        }
+        vec3 tri_normal = normalize(cross(tri_verts[2] - tri_verts[0], tri_verts[1] - tri_verts[0]));
+        tri_normal_x[i] = tri_normal[0];
+        tri_normal_y[i] = tri_normal[1];
+        tri_normal_z[i] = tri_normal[2];
+        tri_plane_d[i] = dot(tri_verts[0], tri_normal);
+        for(int j=0; j<3; ++j){
+            int edge = i*3+j;
+            vec3 edge_normal = normalize(cross(tri_verts[j] - tri_verts[(j+1)%3], tri_normal));
+            edge_normal_x[edge] = edge_normal[0];
+            edge_normal_y[edge] = edge_normal[1];
+            edge_normal_z[edge] = edge_normal[2];
+            edge_plane_d[edge] = dot(tri_verts[j], edge_normal);
+        }
+    }
+}
+
+// Cells are no bigger than this on either axis, however small the triangles
+static const int kMaxGridDim = 1024;
+
+static void TriBounds(const NavMesh& nav, int tri, vec2* tri_min, vec2* tri_max) {
+    *tri_min = vec2(FLT_MAX);
+    *tri_max = vec2(-FLT_MAX);
+    for(int i=0; i<3; ++i){
+        const vec3& vert = nav.verts[nav.indices[tri*3+i]];
+        *tri_min = glm::min(*tri_min, vec2(vert[0], vert[2]));
+        *tri_max = glm::max(*tri_max, vec2(vert[0], vert[2]));
+    }
+}
+
+static void TriCells(const NavMesh& nav, int tri, int* cell_min, int* cell_max) {
+    vec2 bounds[2];
+    TriBounds(nav, tri, &bounds[0], &bounds[1]);
+    for(int i=0; i<2; ++i){
+        cell_min[i] = clamp((int)((bounds[0][i] - nav.grid_min[i]) / nav.grid_cell_size), 0, nav.grid_dims[i]-1);
+        cell_max[i] = clamp((int)((bounds[1][i] - nav.grid_min[i]) / nav.grid_cell_size), 0, nav.grid_dims[i]-1);
+    }
+}
+
+static void SetBlockLane(const NavMesh& nav, int tri, NavTriBlock* block, int lane) {
+    vec3 tri_verts[3];
+    for(int i=0; i<3; ++i){
+        tri_verts[i] = nav.verts[nav.indices[tri*3+i]];
+        block->vert_x[i][lane] = tri_verts[i][0];
+        block->vert_y[i][lane] = tri_verts[i][1];
+        block->vert_z[i][lane] = tri_verts[i][2];
+    }
+    vec3 normal = cross(tri_verts[1] - tri_verts[0], tri_verts[2] - tri_verts[0]);
+    float normal_length = length(normal);
+    normal = normal_length > 0.0f ? normal / normal_length : vec3(0.0f);
+    block->normal_x[lane] = normal[0];
+    block->normal_y[lane] = normal[1];
+    block->normal_z[lane] = normal[2];
+    block->tri[lane] = tri;
+}
+
+void NavMesh::BuildTriGrid(StackAllocator* stack_allocator) {
+    int num_tris = num_indices / 3;
+    vec2 grid_max(0.0f);
+    grid_min = vec2(0.0f);
+    float total_extent = 0.0f;
+    for(int i=0; i<num_tris; ++i){
+        vec2 tri_min, tri_max;
+        TriBounds(*this, i, &tri_min, &tri_max);
+        grid_min = i ? glm::min(grid_min, tri_min) : tri_min;
+        grid_max = i ? glm::max(grid_max, tri_max) : tri_max;
+        total_extent += (tri_max[0] - tri_min[0]) + (tri_max[1] - tri_min[1]);
+    }
+    // About one triangle per cell if they were spread evenly, but no smaller
+    // than the average triangle so each one only lands in a few cells
+    vec2 size = grid_max - grid_min;
+    float cell_size = sqrtf(size[0] * size[1] / max(num_tris, 1));
+    cell_size = max(cell_size, total_extent / (2.0f * max(num_tris, 1)));
+    cell_size = max(cell_size, max(size[0], size[1]) / kMaxGridDim);
+    grid_cell_size = cell_size > 0.0f ? cell_size : 1.0f;
+    for(int i=0; i<2; ++i){
+        grid_dims[i] = min((int)(size[i] / grid_cell_size) + 1, kMaxGridDim);
+    }
+
+    // Count each cell's triangles, then turn the counts into block offsets
+    int num_cells = grid_dims[0] * grid_dims[1];
+    grid_cell_blocks = (int*)stack_allocator->Alloc((num_cells+1) * sizeof(int));
+    if(!grid_cell_blocks){
+        FormattedError("Error", "Could not allocate memory for %d nav mesh grid cells", num_cells);
+        exit(1);
+    }
+    memset(grid_cell_blocks, 0, (num_cells+1) * sizeof(int));
+    for(int i=0; i<num_tris; ++i){
+        int cell_min[2], cell_max[2];
+        TriCells(*this, i, cell_min, cell_max);
+        for(int z=cell_min[1]; z<=cell_max[1]; ++z){
+            for(int x=cell_min[0]; x<=cell_max[0]; ++x){
+                ++grid_cell_blocks[z*grid_dims[0]+x];
             }
         }
     }
-    qsort(unique_verts, num_unique_edges, sizeof(Vec3EdgeHash), Vec3EdgeHashSort);
-    for(int i=1; i<num_unique_edges; ++i){
-        if(unique_verts[i].hash == unique_verts[i-1].hash){
-            if(unique_verts[i].verts[0] != unique_verts[i].verts[0] ||
-                unique_verts[i].verts[1] != unique_verts[i].verts[1])
-            {
-                FormattedError("Error", "Hash collision in CalcNeighbors");
-                exit(1);
+    int num_blocks = 0;
+    for(int i=0; i<num_cells; ++i){
+        int cell_tris = grid_cell_blocks[i];
+        grid_cell_blocks[i] = num_blocks;
+        num_blocks += (cell_tris + 3) / 4;
+    }
+    grid_cell_blocks[num_cells] = num_blocks;
+    grid_blocks = (NavTriBlock*)stack_allocator->Alloc(max(num_blocks, 1) * sizeof(NavTriBlock));
+    int* cell_tris = (int*)stack_allocator->Alloc(num_cells * sizeof(int));
+    if(!grid_blocks || !cell_tris){
+        FormattedError("Error", "Could not allocate memory for %d nav mesh grid blocks", num_blocks);
+        exit(1);
+    }
+
+    memset(cell_tris, 0, num_cells * sizeof(int));
+    for(int i=0; i<num_tris; ++i){
+        int cell_min[2], cell_max[2];
+        TriCells(*this, i, cell_min, cell_max);
+        for(int z=cell_min[1]; z<=cell_max[1]; ++z){
+            for(int x=cell_min[0]; x<=cell_max[0]; ++x){
+                int cell = z*grid_dims[0]+x;
+                int slot = cell_tris[cell]++;
+                SetBlockLane(*this, i, &grid_blocks[grid_cell_blocks[cell] + slot/4], slot%4);
             }
-            tri_neighbors[unique_verts[i].tri_index] = unique_verts[i-1].tri_index;
-            tri_neighbors[unique_verts[i-1].tri_index] = unique_verts[i].tri_index;
         }
     }
-    stack_allocator->Free(unique_verts);
+    for(int i=0; i<num_cells; ++i){
+        int slot = cell_tris[i];
+        if(slot % 4 != 0){
+            NavTriBlock* block = &grid_blocks[grid_cell_blocks[i] + slot/4];
+            for(int lane=slot%4; lane<4; ++lane){
+                SetBlockLane(*this, block->tri[slot%4 - 1], block, lane);
+            }
+        }
+    }
+    stack_allocator->Free(cell_tris);
+}
+
+// Prefer the lower triangle index on ties, so the result doesn't depend on
+// the order the grid visits triangles in
+static void KeepCloser(float dist2, int tri, float* closest_dist2, int* closest_tri) {
+    if(dist2 < *closest_dist2 || (dist2 == *closest_dist2 && tri < *closest_tri)){
+        *closest_dist2 = dist2;
+        *closest_tri = tri;
+    }
+}
+
+// Squared distance from pos to a triangle is to its plane if pos is over
+// the triangle, otherwise to its closest edge. The SSE2 version below does
+// the same operations in the same order, so both give the same bits.
+#ifndef NAV_MESH_SSE2
+static float TriDistance2(const NavTriBlock& block, int lane, const vec3& pos) {
+    float normal_x = block.normal_x[lane];
+    float normal_y = block.normal_y[lane];
+    float normal_z = block.normal_z[lane];
+    bool over_tri = normal_x*normal_x + normal_y*normal_y + normal_z*normal_z > 0.0f;
+    float edge_dist2 = FLT_MAX;
+    for(int i=0; i<3; ++i){
+        int next = (i+1)%3;
+        float to_pos_x = pos[0] - block.vert_x[i][lane];
+        float to_pos_y = pos[1] - block.vert_y[i][lane];
+        float to_pos_z = pos[2] - block.vert_z[i][lane];
+        float edge_x = block.vert_x[next][lane] - block.vert_x[i][lane];
+        float edge_y = block.vert_y[next][lane] - block.vert_y[i][lane];
+        float edge_z = block.vert_z[next][lane] - block.vert_z[i][lane];
+        float edge_length2 = edge_x*edge_x + edge_y*edge_y + edge_z*edge_z;
+        float t = (to_pos_x*edge_x + to_pos_y*edge_y + to_pos_z*edge_z) / max(edge_length2, FLT_MIN);
+        t = min(max(t, 0.0f), 1.0f);
+        float offset_x = to_pos_x - edge_x*t;
+        float offset_y = to_pos_y - edge_y*t;
+        float offset_z = to_pos_z - edge_z*t;
+        edge_dist2 = min(edge_dist2, offset_x*offset_x + offset_y*offset_y + offset_z*offset_z);
+        // Positive when pos is on the inside of this edge, seen along the normal
+        float side_x = edge_y*to_pos_z - edge_z*to_pos_y;
+        float side_y = edge_z*to_pos_x - edge_x*to_pos_z;
+        float side_z = edge_x*to_pos_y - edge_y*to_pos_x;
+        if(normal_x*side_x + normal_y*side_y + normal_z*side_z < 0.0f){
+            over_tri = false;
+        }
+    }
+    if(over_tri){
+        float plane_dist = normal_x*(pos[0] - block.vert_x[0][lane]) +
+                           normal_y*(pos[1] - block.vert_y[0][lane]) +
+                           normal_z*(pos[2] - block.vert_z[0][lane]);
+        return plane_dist * plane_dist;
+    }
+    return edge_dist2;
+}
+#endif
+
+#ifdef NAV_MESH_SSE2
+// Where mask is set take a, otherwise b
+static __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
 }
 
-float Distance2FromPointToTriangle(const vec3& point, const vec3 tri[]) {
-    vec3 norm = normalize(cross(tri[2]-tri[0], tri[1]-tri[0]));
-    float tri_d = dot(norm, tri[0]);
-    float point_d = dot(norm, point);
-    vec3 proj_point = point - norm * (point_d - tri_d);
-    vec3 bary;
-    Barycentric(proj_point, tri[0], tri[1], tri[2], &bary);
-    bool in_tri = true;
+static __m128 Dot(__m128 a_x, __m128 a_y, __m128 a_z, __m128 b_x, __m128 b_y, __m128 b_z) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a_x, b_x), _mm_mul_ps(a_y, b_y)), _mm_mul_ps(a_z, b_z));
+}
+
+static __m128 TriDistance2(const NavTriBlock& block, __m128 pos_x, __m128 pos_y, __m128 pos_z) {
+    __m128 normal_x = _mm_loadu_ps(block.normal_x);
+    __m128 normal_y = _mm_loadu_ps(block.normal_y);
+    __m128 normal_z = _mm_loadu_ps(block.normal_z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 over_tri = _mm_cmpgt_ps(Dot(normal_x, normal_y, normal_z, normal_x, normal_y, normal_z), zero);
+    __m128 edge_dist2 = _mm_set1_ps(FLT_MAX);
     for(int i=0; i<3; ++i){
-        if(bary[i] < 0.0f){
-            in_tri = false;
-        }
-    }
-    if(in_tri){
-        return glm::abs(point_d - tri_d);
-    } else {
-        float closest_dist = FLT_MAX;
-        for(int i=0; i<3; ++i){
-            vec3 closest = ClosestPointOnSegment(point, tri[i], tri[(i+1)%3]);
-            float dist = distance2(point, closest);
-            if(dist < closest_dist){
-                closest_dist = dist;
-            }
+        int next = (i+1)%3;
+        __m128 vert_x = _mm_loadu_ps(block.vert_x[i]);
+        __m128 vert_y = _mm_loadu_ps(block.vert_y[i]);
+        __m128 vert_z = _mm_loadu_ps(block.vert_z[i]);
+        __m128 to_pos_x = _mm_sub_ps(pos_x, vert_x);
+        __m128 to_pos_y = _mm_sub_ps(pos_y, vert_y);
+        __m128 to_pos_z = _mm_sub_ps(pos_z, vert_z);
+        __m128 edge_x = _mm_sub_ps(_mm_loadu_ps(block.vert_x[next]), vert_x);
+        __m128 edge_y = _mm_sub_ps(_mm_loadu_ps(block.vert_y[next]), vert_y);
+        __m128 edge_z = _mm_sub_ps(_mm_loadu_ps(block.vert_z[next]), vert_z);
+        __m128 edge_length2 = Dot(edge_x, edge_y, edge_z, edge_x, edge_y, edge_z);
+        __m128 t = _mm_div_ps(Dot(to_pos_x, to_pos_y, to_pos_z, edge_x, edge_y, edge_z),
+                              _mm_max_ps(edge_length2, _mm_set1_ps(FLT_MIN)));
+        t = _mm_min_ps(_mm_max_ps(t, zero), _mm_set1_ps(1.0f));
+        __m128 offset_x = _mm_sub_ps(to_pos_x, _mm_mul_ps(edge_x, t));
+        __m128 offset_y = _mm_sub_ps(to_pos_y, _mm_mul_ps(edge_y, t));
+        __m128 offset_z = _mm_sub_ps(to_pos_z, _mm_mul_ps(edge_z, t));
+        edge_dist2 = _mm_min_ps(edge_dist2, Dot(offset_x, offset_y, offset_z, offset_x, offset_y, offset_z));
+        __m128 side_x = _mm_sub_ps(_mm_mul_ps(edge_y, to_pos_z), _mm_mul_ps(edge_z, to_pos_y));
+        __m128 side_y = _mm_sub_ps(_mm_mul_ps(edge_z, to_pos_x), _mm_mul_ps(edge_x, to_pos_z));
+        __m128 side_z = _mm_sub_ps(_mm_mul_ps(edge_x, to_pos_y), _mm_mul_ps(edge_y, to_pos_x));
+        over_tri = _mm_andnot_ps(_mm_cmplt_ps(Dot(normal_x, normal_y, normal_z, side_x, side_y, side_z), zero),
+                                 over_tri);
+    }
+    __m128 plane_dist = Dot(normal_x, normal_y, normal_z,
+                            _mm_sub_ps(pos_x, _mm_loadu_ps(block.vert_x[0])),
+                            _mm_sub_ps(pos_y, _mm_loadu_ps(block.vert_y[0])),
+                            _mm_sub_ps(pos_z, _mm_loadu_ps(block.vert_z[0])));
+    return Select(over_tri, _mm_mul_ps(plane_dist, plane_dist), edge_dist2);
+}
+#endif
+
+static void TestTriBlocks(const NavTriBlock* blocks, int num_blocks, const vec3& pos,
+                          float* closest_dist2, int* closest_tri)
+{
+#ifdef NAV_MESH_SSE2
+    __m128 pos_x = _mm_set1_ps(pos[0]);
+    __m128 pos_y = _mm_set1_ps(pos[1]);
+    __m128 pos_z = _mm_set1_ps(pos[2]);
+    for(int i=0; i<num_blocks; ++i){
+        float dist2[4];
+        _mm_storeu_ps(dist2, TriDistance2(blocks[i], pos_x, pos_y, pos_z));
+        for(int lane=0; lane<4; ++lane){
+            KeepCloser(dist2[lane], blocks[i].tri[lane], closest_dist2, closest_tri);
+        }
+    }
+#else
+    for(int i=0; i<num_blocks; ++i){
+        for(int lane=0; lane<4; ++lane){
+            KeepCloser(TriDistance2(blocks[i], lane, pos), blocks[i].tri[lane],
+                       closest_dist2, closest_tri);
         }
-        return closest_dist;
     }
+#endif
 }
 
-int NavMesh::ClosestTriToPoint(const vec3& pos) {
-    //TODO: use a spatial structure to make this O(logN) instead of O(N)
-    float closest_dist = FLT_MAX;
+int NavMesh::ClosestTriToPoint(const vec3& pos) const {
+    SDL_assert(grid_cell_blocks);
+    // Points off the grid search from just outside it, every cell is at
+    // least as far from them as from there
+    float cell_x = clamp((pos[0] - grid_min[0]) / grid_cell_size, -1.0f, (float)grid_dims[0]);
+    float cell_z = clamp((pos[2] - grid_min[1]) / grid_cell_size, -1.0f, (float)grid_dims[1]);
+    int center_x = (int)floorf(cell_x);
+    int center_z = (int)floorf(cell_z);
+    int max_ring = max(max(center_x, grid_dims[0]-1-center_x), max(center_z, grid_dims[1]-1-center_z));
+    float closest_dist2 = FLT_MAX;
     int closest = -1;
-    for(int i=0; i<num_indices; i+=3){
-        vec3 tri_verts[3];
-        for(int j=0; j<3; ++j){
-            tri_verts[j] = verts[indices[i+j]];
+    // Test square rings of cells around pos until the nearest triangle found
+    // is closer than anything the next ring could hold
+    for(int ring=0; ring<=max_ring; ++ring){
+        int ring_min[2] = {center_x - ring, center_z - ring};
+        int ring_max[2] = {center_x + ring, center_z + ring};
+        for(int z=max(ring_min[1], 0); z<=min(ring_max[1], grid_dims[1]-1); ++z){
+            // Inner rows only have cells at the two ends
+            bool full_row = (z == ring_min[1] || z == ring_max[1]);
+            int step = full_row ? 1 : max(ring_max[0] - ring_min[0], 1);
+            for(int x=ring_min[0]; x<=ring_max[0]; x+=step){
+                if(x < 0 || x >= grid_dims[0]){
+                    continue;
+                }
+                int cell = z*grid_dims[0]+x;
+                TestTriBlocks(&grid_blocks[grid_cell_blocks[cell]],
+                              grid_cell_blocks[cell+1] - grid_cell_blocks[cell],
+                              pos, &closest_dist2, &closest);
+            }
         }
-        float dist = Distance2FromPointToTriangle(pos, tri_verts);
-        if(dist < closest_dist){
-            closest_dist = dist;
-            closest = i/3;
+        float gap = min(min(cell_x - ring_min[0], ring_max[0] + 1 - cell_x),
+                        min(cell_z - ring_min[1], ring_max[1] + 1 - cell_z)) * grid_cell_size;
+        if(closest_dist2 < gap * gap){
+            break;
         }
     }
     return closest;
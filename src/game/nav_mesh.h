@@ -8,27 +8,69 @@
 class StackAllocator;
 struct GraphicsContext;
 
+// Corners and normals of four triangles, laid out to test them together.
+// Lanes past the end of a cell's triangles repeat its last one.
+struct NavTriBlock {
+    float vert_x[3][4];
+    float vert_y[3][4];
+    float vert_z[3][4];
+    float normal_x[4]; // Zero for triangles without area
+    float normal_y[4];
+    float normal_z[4];
+    int tri[4];
+};
+
 class NavMesh {
 public:
-    static const int kMaxNavMeshVerts = 10000;
-    static const int kMaxNavMeshTris = 10000;
     int num_verts;
-    glm::vec3 verts[kMaxNavMeshVerts];
+    int max_verts;
+    glm::vec3* verts;
     int num_indices;
-    uint32_t indices[kMaxNavMeshTris*3];
+    int max_indices;
+    uint32_t* indices;
     int vert_vbo;
     int index_vbo;
     int shader;
-    int tri_neighbors[kMaxNavMeshTris*3];
+    // Edge i runs from vert i to the next one in its triangle, its neighbor
+    // is the other triangle's edge between the same verts, or -1
+    int* tri_neighbors;
+    // Planes from CalcPlanes(), one array per component so walkers can
+    // gather them for several characters at once. Points on triangle t have
+    // dot(pos, tri_normal) == tri_plane_d[t]. Edge planes are indexed like
+    // tri_neighbors, face out of their triangle, and points past edge e
+    // have dot(pos, edge_normal) > edge_plane_d[e].
+    float* tri_normal_x;
+    float* tri_normal_y;
+    float* tri_normal_z;
+    float* tri_plane_d;
+    float* edge_normal_x;
+    float* edge_normal_y;
+    float* edge_normal_z;
+    float* edge_plane_d;
+
+    // Uniform grid over the XZ plane for ClosestTriToPoint(), each cell
+    // holds every triangle whose bounds overlap it
+    glm::vec2 grid_min;
+    float grid_cell_size;
+    int grid_dims[2];
+    int* grid_cell_blocks; // Cell i's triangles are blocks [grid_cell_blocks[i], grid_cell_blocks[i+1])
+    NavTriBlock* grid_blocks;
 
+    // Make room for max_tris triangles and their verts, and empty the mesh
+    void AllocMemory(int max_verts, int max_tris, StackAllocator* stack_allocator);
+    // Merge verts that are within a centimeter of each other, so pieces of
+    // the mesh that meet share verts, and drop triangles that collapse
+    void WeldVerts(StackAllocator* stack_allocator);
+    // Link edges that share both verts, call after WeldVerts()
     void CalcNeighbors(StackAllocator* stack_allocator);
+    // Allocate and fill the triangle and edge planes, once the mesh is final
+    void CalcPlanes(StackAllocator* stack_allocator);
+    // Allocates the grid, call again if the triangles change
+    void BuildTriGrid(StackAllocator* stack_allocator);
     void Draw(GraphicsContext* graphics_context, const glm::mat4& proj_view_mat);
-    int ClosestTriToPoint(const glm::vec3& pos);
-};
-
-class NavMeshWalker {
-public:
-    int tri;
+    // Searches the grid outward from pos, so nearby triangles are found
+    // without looking at distant ones
+    int ClosestTriToPoint(const glm::vec3& pos) const;
 };
 
 #endif
\ No newline at end of file
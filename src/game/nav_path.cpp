@@ -0,0 +1,351 @@
+#include "game/nav_path.h"
+#include "game/nav_mesh.h"
+#include "internal/memory.h"
+#include "platform_sdl/error.h"
+#include "glm/glm.hpp"
+#include "glm/gtx/norm.hpp"
+#include <SDL.h>
+#include <cstring>
+
+using namespace glm;
+
+// Points closer than this count as the same funnel corner
+static const float kSamePointDist = 0.001f;
+
+void NavPathfinder::Init(const NavMesh* p_nav, StackAllocator* stack_allocator) {
+    nav = p_nav;
+    num_tris = nav->num_indices / 3;
+    cache_ring_size = kMinCacheRingSize;
+    while(cache_ring_size < (Uint32)num_tris * 4){
+        cache_ring_size *= 2;
+    }
+    int mem_size = num_tris * (2 * sizeof(vec3) + sizeof(Uint32) + 2 * sizeof(float) + 4 * sizeof(int)) +
+                   kCacheSize * sizeof(CacheEntry) + cache_ring_size * sizeof(int);
+    void* mem = stack_allocator->Alloc(mem_size);
+    if(!mem){
+        FormattedError("Error", "Could not allocate path finding memory for %d nav mesh triangles", num_tris);
+        exit(1);
+    }
+    tri_center = (vec3*)mem;
+    entry_pos = tri_center + num_tris;
+    visit_stamp = (Uint32*)(entry_pos + num_tris);
+    cost = (float*)(visit_stamp + num_tris);
+    estimate = cost + num_tris;
+    parent = (int*)(estimate + num_tris);
+    heap_pos = parent + num_tris;
+    heap = heap_pos + num_tris;
+    corridor = heap + num_tris;
+    cache = (CacheEntry*)(corridor + num_tris);
+    cache_ring = (int*)(cache + kCacheSize);
+    for(int i=0; i<num_tris; ++i){
+        vec3 center;
+        for(int j=0; j<3; ++j){
+            center += nav->verts[nav->indices[i*3+j]];
+        }
+        tri_center[i] = center / 3.0f;
+    }
+    memset(visit_stamp, 0, num_tris * sizeof(Uint32));
+    search_stamp = 0;
+    heap_size = 0;
+    for(int i=0; i<kCacheSize; ++i){
+        cache[i].start_tri = -1;
+    }
+    cache_ring_end = 0;
+    ResetStats();
+}
+
+void NavPathfinder::Dispose(StackAllocator* stack_allocator) {
+    stack_allocator->Free(tri_center);
+}
+
+void NavPathfinder::ResetStats() {
+    num_queries = 0;
+    num_searches = 0;
+}
+
+// Ties go to the triangle further along, which heads straight for the goal
+// instead of widening the search across equally good routes, and then to
+// the lower triangle, so the order triangles were pushed in doesn't matter
+bool NavPathfinder::HeapLess(int a, int b) const {
+    if(estimate[a] != estimate[b]){
+        return estimate[a] < estimate[b];
+    }
+    if(cost[a] != cost[b]){
+        return cost[a] > cost[b];
+    }
+    return a < b;
+}
+
+void NavPathfinder::HeapSiftUp(int pos) {
+    int tri = heap[pos];
+    while(pos > 0){
+        int parent_pos = (pos - 1) / 2;
+        if(!HeapLess(tri, heap[parent_pos])){
+            break;
+        }
+        heap[pos] = heap[parent_pos];
+        heap_pos[heap[pos]] = pos;
+        pos = parent_pos;
+    }
+    heap[pos] = tri;
+    heap_pos[tri] = pos;
+}
+
+void NavPathfinder::HeapSiftDown(int pos) {
+    int tri = heap[pos];
+    while(true){
+        int child_pos = pos * 2 + 1;
+        if(child_pos >= heap_size){
+            break;
+        }
+        if(child_pos + 1 < heap_size && HeapLess(heap[child_pos+1], heap[child_pos])){
+            ++child_pos;
+        }
+        if(!HeapLess(heap[child_pos], tri)){
+            break;
+        }
+        heap[pos] = heap[child_pos];
+        heap_pos[heap[pos]] = pos;
+        pos = child_pos;
+    }
+    heap[pos] = tri;
+    heap_pos[tri] = pos;
+}
+
+void NavPathfinder::HeapPush(int tri) {
+    heap[heap_size] = tri;
+    ++heap_size;
+    HeapSiftUp(heap_size - 1);
+}
+
+int NavPathfinder::HeapPop() {
+    int tri = heap[0];
+    heap_pos[tri] = -1;
+    --heap_size;
+    if(heap_size > 0){
+        heap[0] = heap[heap_size];
+        HeapSiftDown(0);
+    }
+    return tri;
+}
+
+// Where the line from from to goal crosses the edge from a to b on the XZ
+// plane, or the nearer end of the edge if it misses
+static vec3 CrossingPoint(const vec3& a, const vec3& b, const vec3& from, const vec3& goal) {
+    vec3 edge = b - a;
+    vec3 dir = goal - from;
+    float denom = edge[0] * dir[2] - edge[2] * dir[0];
+    float t = 0.5f;
+    if(denom != 0.0f){
+        t = ((from[0] - a[0]) * dir[2] - (from[2] - a[2]) * dir[0]) / denom;
+        t = clamp(t, 0.0f, 1.0f);
+    }
+    return a + edge * t;
+}
+
+int NavPathfinder::Search(int start_tri, int goal_tri) {
+    ++search_stamp;
+    if(search_stamp == 0){
+        // Wrapped around, old stamps could look current
+        memset(visit_stamp, 0, num_tris * sizeof(Uint32));
+        search_stamp = 1;
+    }
+    vec3 goal_center = tri_center[goal_tri];
+    heap_size = 0;
+    visit_stamp[start_tri] = search_stamp;
+    entry_pos[start_tri] = tri_center[start_tri];
+    cost[start_tri] = 0.0f;
+    estimate[start_tri] = distance(entry_pos[start_tri], goal_center);
+    parent[start_tri] = -1;
+    HeapPush(start_tri);
+    while(heap_size > 0){
+        int tri = HeapPop();
+        if(tri == goal_tri){
+            int len = 0;
+            for(int i=tri; i!=-1; i=parent[i]){
+                ++len;
+            }
+            int pos = len;
+            for(int i=tri; i!=-1; i=parent[i]){
+                corridor[--pos] = i;
+            }
+            return len;
+        }
+        // Costs run between the points where each edge crossed meets the
+        // line from the previous one to the goal, so where nothing is in the
+        // way they add up to the straight distance, the estimate is exact and
+        // few triangles off the path get opened. Closed triangles stay closed.
+        for(int i=0; i<3; ++i){
+            int neighbor_edge = nav->tri_neighbors[tri*3+i];
+            if(neighbor_edge == -1){
+                continue;
+            }
+            int neighbor = neighbor_edge / 3;
+            vec3 crossing = CrossingPoint(nav->verts[nav->indices[tri*3+i]],
+                                          nav->verts[nav->indices[tri*3+(i+1)%3]],
+                                          entry_pos[tri], goal_center);
+            float neighbor_cost = cost[tri] + distance(entry_pos[tri], crossing);
+            bool open = false;
+            if(visit_stamp[neighbor] != search_stamp){
+                visit_stamp[neighbor] = search_stamp;
+                open = true;
+            } else if(heap_pos[neighbor] == -1 || neighbor_cost >= cost[neighbor]){
+                continue;
+            }
+            entry_pos[neighbor] = crossing;
+            cost[neighbor] = neighbor_cost;
+            estimate[neighbor] = neighbor_cost + distance(crossing, goal_center);
+            parent[neighbor] = tri;
+            if(open){
+                HeapPush(neighbor);
+            } else {
+                HeapSiftUp(heap_pos[neighbor]);
+            }
+        }
+    }
+    return 0;
+}
+
+int NavPathfinder::FindCorridor(int start_tri, int goal_tri, const int** tris) {
+    SDL_assert(start_tri >= 0 && start_tri < num_tris && goal_tri >= 0 && goal_tri < num_tris);
+    ++num_queries;
+    // Each key can go in either entry of a pair
+    int slot = (int)(((Uint32)start_tri * 73856093u ^ (Uint32)goal_tri * 19349663u) & (kCacheSize - 2));
+    for(int i=slot; i<slot+2; ++i){
+        const CacheEntry& entry = cache[i];
+        if(entry.start_tri == start_tri && entry.goal_tri == goal_tri &&
+           cache_ring_end - entry.ring_start <= cache_ring_size)
+        {
+            *tris = &cache_ring[entry.ring_start % cache_ring_size];
+            return entry.corridor_len;
+        }
+    }
+    ++num_searches;
+    int len = Search(start_tri, goal_tri);
+    *tris = corridor;
+    if(cache_ring_end > 0xFFFFFFFFu - 2 * cache_ring_size){
+        // Before the write count wraps around and old entries look current
+        for(int i=0; i<kCacheSize; ++i){
+            cache[i].start_tri = -1;
+        }
+        cache_ring_end = 0;
+    }
+    // Corridors don't wrap around the end of the ring
+    if(cache_ring_end % cache_ring_size + (Uint32)len > cache_ring_size){
+        cache_ring_end += cache_ring_size - cache_ring_end % cache_ring_size;
+    }
+    // Fill an empty entry of the pair, or else replace the older one
+    if(cache[slot].start_tri != -1 && (cache[slot+1].start_tri == -1 ||
+       cache[slot+1].ring_start < cache[slot].ring_start))
+    {
+        ++slot;
+    }
+    CacheEntry& entry = cache[slot];
+    entry.start_tri = start_tri;
+    entry.goal_tri = goal_tri;
+    entry.corridor_len = len;
+    entry.ring_start = cache_ring_end;
+    memcpy(&cache_ring[cache_ring_end % cache_ring_size], corridor, len * sizeof(int));
+    cache_ring_end += len;
+    return len;
+}
+
+int NavPathfinder::EdgeTo(int tri, int next_tri) const {
+    for(int i=0; i<3; ++i){
+        int neighbor_edge = nav->tri_neighbors[tri*3+i];
+        if(neighbor_edge != -1 && neighbor_edge / 3 == next_tri){
+            return tri*3+i;
+        }
+    }
+    SDL_assert(false);
+    return tri*3;
+}
+
+// Twice the signed area of abc on the XZ plane
+static float TriArea2(const vec3& a, const vec3& b, const vec3& c) {
+    float ab_x = b[0] - a[0];
+    float ab_z = b[2] - a[2];
+    float ac_x = c[0] - a[0];
+    float ac_z = c[2] - a[2];
+    return ac_x * ab_z - ab_x * ac_z;
+}
+
+void NavPathfinder::GetPortal(const int* tris, int index, vec3* left, vec3* right) const {
+    int edge = EdgeTo(tris[index-1], tris[index]);
+    *left = nav->verts[nav->indices[edge]];
+    *right = nav->verts[nav->indices[edge - edge%3 + (edge%3+1)%3]];
+    if(TriArea2(tri_center[tris[index-1]], *left, *right) < 0.0f){
+        vec3 temp = *left;
+        *left = *right;
+        *right = temp;
+    }
+}
+
+int NavPathfinder::FindPath(const vec3& start, int start_tri, const vec3& goal, int goal_tri,
+                            vec3* points, int max_points)
+{
+    SDL_assert(max_points >= 2);
+    const int* tris;
+    int num_tris_crossed = FindCorridor(start_tri, goal_tri, &tris);
+    if(num_tris_crossed == 0){
+        return 0;
+    }
+    // Portal 0 is the start, portal i is the edge from tris[i-1] into
+    // tris[i], and the last portal is the goal
+    int num_portals = num_tris_crossed + 1;
+    // Simple stupid funnel: tighten the funnel from the apex one portal at
+    // a time, and when a side crosses over the other, that corner is on the
+    // path and becomes the new apex
+    int num_points = 0;
+    vec3 apex = start;
+    vec3 funnel_left = start;
+    vec3 funnel_right = start;
+    int apex_index = 0;
+    int left_index = 0;
+    int right_index = 0;
+    points[num_points++] = apex;
+    for(int i=1; i<num_portals && num_points < max_points; ++i){
+        vec3 left = goal;
+        vec3 right = goal;
+        if(i < num_portals - 1){
+            GetPortal(tris, i, &left, &right);
+        }
+        if(TriArea2(apex, funnel_right, right) <= 0.0f){
+            if(distance2(apex, funnel_right) < kSamePointDist * kSamePointDist ||
+               TriArea2(apex, funnel_left, right) > 0.0f)
+            {
+                funnel_right = right;
+                right_index = i;
+            } else {
+                // Right crossed over left, so the left corner is on the path
+                apex = funnel_left;
+                apex_index = left_index;
+                points[num_points++] = apex;
+                funnel_left = funnel_right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+        if(TriArea2(apex, funnel_left, left) >= 0.0f){
+            if(distance2(apex, funnel_left) < kSamePointDist * kSamePointDist ||
+               TriArea2(apex, funnel_right, left) < 0.0f)
+            {
+                funnel_left = left;
+                left_index = i;
+            } else {
+                apex = funnel_right;
+                apex_index = right_index;
+                points[num_points++] = apex;
+                funnel_left = funnel_right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+    }
+    if(num_points < max_points){
+        points[num_points++] = goal;
+    }
+    return num_points;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef GAME_NAV_PATH_H
+#define GAME_NAV_PATH_H
+
+#include "glm/glm.hpp"
+#include <SDL.h>
+
+class NavMesh;
+class StackAllocator;
+
+// Finds paths over a nav mesh: A* from triangle to triangle through
+// tri_neighbors gives the corridor, then string pulling through the edges
+// the corridor crosses gives the corners to walk between. Searches run from
+// the start triangle's center to the goal triangle's center, so a corridor
+// depends on nothing but its start and goal triangles, and recent corridors
+// are cached under those. Not safe to query from more than one thread at a
+// time.
+class NavPathfinder {
+public:
+    static const int kCacheSize = 4096; // Must be a power of two
+    // Cached corridors are stored one after the other in a ring of at least
+    // this many triangles, and entries whose triangles were written over miss
+    static const int kMinCacheRingSize = 65536; // Must be a power of two
+
+    // Allocates scratch memory for the mesh's triangles, call once the mesh is final
+    void Init(const NavMesh* nav, StackAllocator* stack_allocator);
+    void Dispose(StackAllocator* stack_allocator);
+    // Triangles crossed going from start_tri to goal_tri, both included.
+    // Returns their number, or 0 if goal_tri can't be reached. The corridor
+    // stays valid until the next call.
+    int FindCorridor(int start_tri, int goal_tri, const int** tris);
+    // Corners of the shortest path from start to goal through the corridor
+    // between their triangles, starting with start and ending with goal.
+    // Returns the number written, or 0 if there is no path. When max_points
+    // cuts the path short, the last point written is still a corner of it.
+    int FindPath(const glm::vec3& start, int start_tri, const glm::vec3& goal, int goal_tri,
+                 glm::vec3* points, int max_points);
+    // Reset with ResetStats()
+    int num_queries;
+    int num_searches; // Queries that missed the cache
+    void ResetStats();
+
+private:
+    struct CacheEntry {
+        int start_tri; // -1 when empty
+        int goal_tri;
+        int corridor_len; // 0 if unreachable
+        Uint32 ring_start; // Where its triangles were written, counting every write
+    };
+    int Search(int start_tri, int goal_tri);
+    bool HeapLess(int a, int b) const;
+    void HeapPush(int tri);
+    int HeapPop();
+    void HeapSiftUp(int pos);
+    void HeapSiftDown(int pos);
+    // Edge of tri that crosses into next_tri
+    int EdgeTo(int tri, int next_tri) const;
+    // Ends of the edge from tris[index-1] into tris[index], split into left
+    // and right as seen from the triangle it leaves
+    void GetPortal(const int* tris, int index, glm::vec3* left, glm::vec3* right) const;
+
+    const NavMesh* nav;
+    int num_tris;
+    // All of the below are one allocation
+    glm::vec3* tri_center;
+    // Per-triangle search state, only valid where visit_stamp == search_stamp
+    glm::vec3* entry_pos; // Where it was reached, on the edge it was reached through
+    Uint32* visit_stamp;
+    float* cost; // Along the entry positions from the start center
+    float* estimate; // cost plus straight distance to the goal center
+    int* parent; // Triangle it was reached from, -1 for the start
+    int* heap_pos; // Index into heap, -1 once closed
+    int* heap; // Open triangles, least estimate first
+    int heap_size;
+    int* corridor; // Result of the last Search()
+    CacheEntry* cache;
+    int* cache_ring;
+    Uint32 cache_ring_size; // Four times the triangles or more, a power of two
+    Uint32 cache_ring_end; // Triangles written to cache_ring so far
+    Uint32 search_stamp;
+};
+
+#endif
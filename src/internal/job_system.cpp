@@ -0,0 +1,180 @@
+#include "internal/job_system.h"
+#include "platform_sdl/error.h"
+#include "platform_sdl/logger.h"
+#include "platform_sdl/profiler.h"
+#include <cstdlib>
+
+static int PackRange(int next, int end) {
+    return next | (end << 16);
+}
+
+static int RangeNext(int range) {
+    return range & 0xFFFF;
+}
+
+static int RangeEnd(int range) {
+    return (range >> 16) & 0xFFFF;
+}
+
+void JobSystem::Init(int p_num_workers) {
+    num_workers = 0;
+    work_sem = NULL;
+    SDL_AtomicSet(&num_workers_busy, 0);
+    SDL_AtomicSet(&wants_to_quit, 0);
+    for(int i=0; i<kMaxWorkers+1; ++i){
+        SDL_AtomicSet(&shares[i].range, 0);
+    }
+#ifdef HAVE_THREADS
+    if(p_num_workers < 0){
+        p_num_workers = SDL_GetCPUCount() - 1;
+    }
+    if(p_num_workers > kMaxWorkers){
+        p_num_workers = kMaxWorkers;
+    }
+    if(p_num_workers <= 0){
+        return;
+    }
+    work_sem = SDL_CreateSemaphore(0);
+    if(!work_sem){
+        LogMessage(kLogWarning, "Could not create job semaphore, running jobs on one thread: %s", 
+                   SDL_GetError());
+        return;
+    }
+    for(int i=0; i<p_num_workers; ++i){
+        worker_info[i].job_system = this;
+        worker_info[i].participant = i+1;
+        threads[i] = SDL_CreateThread(RunWorkerThread, "JobWorkerThread", &worker_info[i]);
+        if(!threads[i]){
+            LogMessage(kLogWarning, "Could not create job worker thread: %s", SDL_GetError());
+            break;
+        }
+        ++num_workers;
+    }
+    LogMessage(kLogInfo, "Job system running with %d worker threads", num_workers);
+#else
+    (void)p_num_workers;
+#endif
+}
+
+void JobSystem::Dispose() {
+    SDL_AtomicSet(&wants_to_quit, 1);
+    for(int i=0; i<num_workers; ++i){
+        SDL_SemPost(work_sem);
+    }
+    for(int i=0; i<num_workers; ++i){
+        SDL_WaitThread(threads[i], NULL);
+    }
+    num_workers = 0;
+    if(work_sem){
+        SDL_DestroySemaphore(work_sem);
+        work_sem = NULL;
+    }
+}
+
+// Take the next batch from the front of our own share
+bool JobSystem::TakeBatch(int participant, int* batch) {
+    SDL_atomic_t* range = &shares[participant].range;
+    while(true){
+        int old_range = SDL_AtomicGet(range);
+        int next = RangeNext(old_range);
+        int end = RangeEnd(old_range);
+        if(next >= end){
+            return false;
+        }
+        if(SDL_AtomicCAS(range, old_range, PackRange(next+1, end))){
+            *batch = next;
+            return true;
+        }
+    }
+}
+
+// Move the back half of another share into our empty one, returns false 
+// once no share has batches left to take
+bool JobSystem::StealBatches(int participant) {
+    int num_participants = num_workers+1;
+    bool found_work = true;
+    while(found_work){
+        found_work = false;
+        for(int i=1; i<num_participants; ++i){
+            SDL_atomic_t* victim = &shares[(participant+i)%num_participants].range;
+            int old_range = SDL_AtomicGet(victim);
+            int next = RangeNext(old_range);
+            int end = RangeEnd(old_range);
+            if(next >= end){
+                continue;
+            }
+            found_work = true;
+            int new_end = end - (end - next + 1) / 2;
+            if(SDL_AtomicCAS(victim, old_range, PackRange(next, new_end))){
+                // Nobody else writes to an empty share, so no CAS needed
+                SDL_AtomicSet(&shares[participant].range, PackRange(new_end, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void JobSystem::RunBatches(int participant) {
+    do {
+        int batch;
+        while(TakeBatch(participant, &batch)){
+            int start = batch * batch_size;
+            int end = start + batch_size;
+            func(data, start, end < count ? end : count);
+        }
+    } while(StealBatches(participant));
+}
+
+void JobSystem::ParallelFor(BatchFunc p_func, void* p_data, int p_count, int p_batch_size) {
+    int num_batches = (p_count + p_batch_size - 1) / p_batch_size;
+    if(num_workers == 0 || num_batches <= 1){
+        for(int start=0; start<p_count; start+=p_batch_size){
+            int end = start + p_batch_size;
+            p_func(p_data, start, end < p_count ? end : p_count);
+        }
+        return;
+    }
+    if(num_batches > kMaxBatches){
+        FormattedError("JobSystem::ParallelFor failed", "Too many batches: %d, max is %d", 
+                       num_batches, kMaxBatches);
+        exit(1);
+    }
+    func = p_func;
+    data = p_data;
+    count = p_count;
+    batch_size = p_batch_size;
+    int num_participants = num_workers+1;
+    for(int i=0; i<num_participants; ++i){
+        SDL_AtomicSet(&shares[i].range, PackRange(num_batches * i / num_participants, 
+                                                  num_batches * (i+1) / num_participants));
+    }
+    SDL_AtomicSet(&num_workers_busy, num_workers);
+    for(int i=0; i<num_workers; ++i){
+        SDL_SemPost(work_sem);
+    }
+    RunBatches(0);
+    // Workers may still be finishing stolen batches, or not awake yet
+    while(SDL_AtomicGet(&num_workers_busy) != 0){
+        SDL_Delay(0);
+    }
+    SDL_MemoryBarrierAcquire();
+}
+
+int JobSystem::RunWorker(int participant) {
+    PROFILE_THREAD_NAME("JobWorkerThread");
+    while(true){
+        SDL_SemWait(work_sem);
+        if(SDL_AtomicGet(&wants_to_quit)){
+            break;
+        }
+        RunBatches(participant);
+        SDL_AtomicAdd(&num_workers_busy, -1);
+    }
+    return 0;
+}
+
+int JobSystem::RunWorkerThread(void* worker_info) {
+    WorkerInfo* info = (WorkerInfo*)worker_info;
+    return info->job_system->RunWorker(info->participant);
+}
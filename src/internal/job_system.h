@@ -0,0 +1,53 @@
+#pragma once
+#ifndef INTERNAL_JOB_SYSTEM_H
+#define INTERNAL_JOB_SYSTEM_H
+
+#include <SDL.h>
+
+// Runs the batches of a parallel loop on worker threads. The calling thread 
+// and each worker start with an equal share of the batches and take them 
+// from the front of their share; once a share runs dry its owner steals the
+// back half of whichever share still has work. Without threads or workers 
+// the batches run in order on the calling thread, so callers whose batches
+// are independent get the same results either way.
+class JobSystem {
+public:
+    typedef void (*BatchFunc)(void* data, int start, int end);
+    static const int kMaxWorkers = 15;
+    static const int kMaxBatches = 65535;
+    // Starts num_workers threads besides the caller's, -1 for one per extra core
+    void Init(int num_workers);
+    void Dispose();
+    // Calls func on [start, end) pieces of [0, count), batch_size at a time,
+    // and returns once every batch has finished. Only call from one thread.
+    void ParallelFor(BatchFunc func, void* data, int count, int batch_size);
+    int num_workers;
+
+private:
+    struct Share {
+        SDL_atomic_t range; // Batches not yet taken, next | end << 16
+        char padding[60]; // Keep each share on its own cache line
+    };
+    struct WorkerInfo {
+        JobSystem* job_system;
+        int participant;
+    };
+    bool TakeBatch(int participant, int* batch);
+    bool StealBatches(int participant);
+    void RunBatches(int participant);
+    int RunWorker(int participant);
+    static int RunWorkerThread(void* worker_info);
+
+    Share shares[kMaxWorkers+1]; // The calling thread is participant 0
+    BatchFunc func;
+    void* data;
+    int count;
+    int batch_size;
+    SDL_atomic_t num_workers_busy;
+    SDL_atomic_t wants_to_quit;
+    SDL_sem* work_sem;
+    SDL_Thread* threads[kMaxWorkers];
+    WorkerInfo worker_info[kMaxWorkers];
+};
+
+#endif
@@ -7,6 +7,7 @@
 void* StackAllocator::Alloc(int requested_size) {
     if(stack_block_pts[stack_blocks] + requested_size < size && stack_blocks < kMaxBlocks-2){
         ++stack_blocks;
+        ++total_allocs;
         stack_block_pts[stack_blocks] = stack_block_pts[stack_blocks-1] + requested_size;
         return (void*)((int)mem + stack_block_pts[stack_blocks-1]);
     } else {
@@ -24,9 +25,26 @@ void StackAllocator::Free(void* ptr) {
     }
 }
 
+int StackAllocator::GetUsedBytes() {
+    return stack_block_pts[stack_blocks];
+}
+
+int StackAllocator::GetSize() {
+    return size;
+}
+
+int StackAllocator::GetNumBlocks() {
+    return stack_blocks;
+}
+
+int StackAllocator::GetTotalAllocs() {
+    return total_allocs;
+}
+
 void StackAllocator::Init(void* p_mem, int p_size) {
     stack_block_pts[0] = 0;
     mem = p_mem;
     size = p_size;
     stack_blocks = 0;
+    total_allocs = 0;
 }
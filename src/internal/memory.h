@@ -7,6 +7,10 @@ public:
     void Init(void* mem, int size);
     void* Alloc(int size);
     void Free(void* ptr);
+    int GetUsedBytes();
+    int GetSize();
+    int GetNumBlocks();
+    int GetTotalAllocs(); // Successful Alloc() calls since Init()
     void* mem;
 
 private:
@@ -14,6 +18,7 @@ private:
     int stack_block_pts[kMaxBlocks];
     int stack_blocks;
     int size;
+    int total_allocs;
 };
 
 #endif
\ No newline at end of file
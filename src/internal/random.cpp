@@ -0,0 +1,36 @@
+#include "internal/random.h"
+#include "glm/gtc/constants.hpp"
+#include <cmath>
+
+void RandomStream::Seed(Uint64 seed, Uint64 stream_id) {
+    state = 0;
+    increment = (stream_id << 1) | 1;
+    Next();
+    state += seed;
+    Next();
+}
+
+Uint32 RandomStream::Next() {
+    Uint64 old_state = state;
+    state = old_state * 6364136223846793005ULL + increment;
+    Uint32 xor_shifted = (Uint32)(((old_state >> 18) ^ old_state) >> 27);
+    Uint32 rotation = (Uint32)(old_state >> 59);
+    return (xor_shifted >> rotation) | (xor_shifted << ((32 - rotation) & 31));
+}
+
+int RandomStream::Range(int min, int max) {
+    // Scale into the range with a multiply instead of a modulo
+    Uint32 range = (Uint32)(max - min) + 1;
+    return min + (int)(((Uint64)Next() * range) >> 32);
+}
+
+float RandomStream::Range(float min, float max) {
+    // Top 24 bits, as many as a float holds exactly
+    float unit = (Next() >> 8) * (1.0f / 16777216.0f);
+    return min + (max - min) * unit;
+}
+
+glm::vec2 RandomStream::Circular(float radius) {
+    float angle = Range(0.0f, glm::two_pi<float>());
+    return glm::vec2(cosf(angle), sinf(angle)) * radius;
+}
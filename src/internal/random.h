@@ -0,0 +1,26 @@
+#pragma once
+#ifndef INTERNAL_RANDOM_H
+#define INTERNAL_RANDOM_H
+
+#include <SDL.h>
+#include "glm/glm.hpp"
+
+// PCG32 generator (pcg-random.org). Each stream is a few bytes of state with
+// no locks, so every character or job can own one. Streams seeded with the
+// same seed but different stream ids give independent sequences, so one 
+// world seed can drive them all.
+struct RandomStream {
+    Uint64 state;
+    Uint64 increment; // Always odd, picks the stream
+
+    void Seed(Uint64 seed, Uint64 stream_id);
+    Uint32 Next();
+    // Uniform in [min, max], inclusive like glm::linearRand
+    int Range(int min, int max);
+    // Uniform in [min, max)
+    float Range(float min, float max);
+    // Random point on a circle of the given radius, like glm::circularRand
+    glm::vec2 Circular(float radius);
+};
+
+#endif
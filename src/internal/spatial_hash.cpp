@@ -0,0 +1,148 @@
+#include "internal/spatial_hash.h"
+#include "platform_sdl/error.h"
+#include <SDL.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace glm;
+
+void SpatialHash::Clear(float p_cell_size) {
+    cell_size = p_cell_size;
+    inv_cell_size = 1.0f / p_cell_size;
+    num_entries = 0;
+    query_stamp = 0;
+    memset(bucket_query_stamp, 0, sizeof(bucket_query_stamp));
+}
+
+int SpatialHash::CellCoord(float val) {
+    return (int)floorf(val * inv_cell_size);
+}
+
+int SpatialHash::BucketIndex(int cell_x, int cell_z) {
+    // Unsigned so that negative cells wrap instead of overflowing
+    Uint32 hash = ((Uint32)cell_x * 73856093u) ^ ((Uint32)cell_z * 19349663u);
+    return (int)(hash & (kNumBuckets-1));
+}
+
+void SpatialHash::Insert(int id, const vec3& p) {
+    if(num_entries >= kMaxEntries){
+        FormattedError("SpatialHash::Insert failed", "Too many entries, max is %d", kMaxEntries);
+        exit(1);
+    }
+    insert_ids[num_entries] = id;
+    insert_pos[num_entries] = vec2(p[0], p[2]);
+    insert_bucket[num_entries] = BucketIndex(CellCoord(p[0]), CellCoord(p[2]));
+    ++num_entries;
+}
+
+void SpatialHash::Build() {
+    // Counting sort by bucket so each bucket is one contiguous run
+    memset(bucket_start, 0, sizeof(bucket_start));
+    for(int i=0; i<num_entries; ++i){
+        ++bucket_start[insert_bucket[i]+1];
+    }
+    for(int i=0; i<kNumBuckets; ++i){
+        bucket_start[i+1] += bucket_start[i];
+    }
+    int bucket_fill[kNumBuckets];
+    memcpy(bucket_fill, bucket_start, sizeof(bucket_fill));
+    for(int i=0; i<num_entries; ++i){
+        int index = bucket_fill[insert_bucket[i]]++;
+        ids[index] = insert_ids[i];
+        pos[index] = insert_pos[i];
+    }
+}
+
+static float DistanceToSegment2(const vec2& point, const vec2& segment_start, 
+                                const vec2& segment_end) 
+{
+    vec2 segment_start_to_end = segment_end - segment_start;
+    float len2 = dot(segment_start_to_end, segment_start_to_end);
+    float t = 0.0f;
+    if(len2 > 0.0f){
+        t = clamp(dot(point - segment_start, segment_start_to_end) / len2, 0.0f, 1.0f);
+    }
+    vec2 offset = point - (segment_start + t * segment_start_to_end);
+    return dot(offset, offset);
+}
+
+void SpatialHash::ScanBucket(int bucket, const vec2& segment_start, const vec2& segment_end,
+                             float radius, int* results, int max_results, int* num_results) 
+{
+    if(bucket_query_stamp[bucket] == query_stamp){
+        return;
+    }
+    bucket_query_stamp[bucket] = query_stamp;
+    float radius2 = radius * radius;
+    for(int i=bucket_start[bucket], end=bucket_start[bucket+1]; 
+        i<end && *num_results < max_results; ++i)
+    {
+        if(DistanceToSegment2(pos[i], segment_start, segment_end) <= radius2){
+            results[(*num_results)++] = ids[i];
+        }
+    }
+}
+
+int SpatialHash::QueryRadius(const vec3& center, float radius, int* results, int max_results) {
+    ++query_stamp;
+    int num_results = 0;
+    vec2 point(center[0], center[2]);
+    int x_min = CellCoord(point[0] - radius);
+    int x_max = CellCoord(point[0] + radius);
+    int z_min = CellCoord(point[1] - radius);
+    int z_max = CellCoord(point[1] + radius);
+    for(int z=z_min; z<=z_max; ++z){
+        for(int x=x_min; x<=x_max; ++x){
+            ScanBucket(BucketIndex(x, z), point, point, radius, 
+                       results, max_results, &num_results);
+        }
+    }
+    return num_results;
+}
+
+int SpatialHash::QuerySegment(const vec3& segment_start, const vec3& segment_end, 
+                              float radius, int* results, int max_results) 
+{
+    ++query_stamp;
+    int num_results = 0;
+    vec2 a(segment_start[0], segment_start[2]);
+    vec2 b(segment_end[0], segment_end[2]);
+    int z_min = CellCoord(min(a[1], b[1]) - radius);
+    int z_max = CellCoord(max(a[1], b[1]) + radius);
+    // Walk each row of cells, only visiting the columns the swept segment 
+    // can touch, so long segments don't scan their whole bounding box
+    for(int z=z_min; z<=z_max; ++z){
+        float row_min = z * cell_size - radius;
+        float row_max = (z+1) * cell_size + radius;
+        float seg_x_min, seg_x_max;
+        float dz = b[1] - a[1];
+        if(fabsf(dz) < 0.00001f){
+            seg_x_min = min(a[0], b[0]);
+            seg_x_max = max(a[0], b[0]);
+        } else {
+            float t0 = (row_min - a[1]) / dz;
+            float t1 = (row_max - a[1]) / dz;
+            if(t0 > t1){
+                float temp = t0;
+                t0 = t1;
+                t1 = temp;
+            }
+            t0 = max(t0, 0.0f);
+            t1 = min(t1, 1.0f);
+            if(t0 > t1){
+                continue;
+            }
+            float x0 = a[0] + (b[0] - a[0]) * t0;
+            float x1 = a[0] + (b[0] - a[0]) * t1;
+            seg_x_min = min(x0, x1);
+            seg_x_max = max(x0, x1);
+        }
+        int x_max = CellCoord(seg_x_max + radius);
+        for(int x=CellCoord(seg_x_min - radius); x<=x_max; ++x){
+            ScanBucket(BucketIndex(x, z), a, b, radius, 
+                       results, max_results, &num_results);
+        }
+    }
+    return num_results;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef INTERNAL_SPATIAL_HASH_H
+#define INTERNAL_SPATIAL_HASH_H
+
+#include "glm/glm.hpp"
+
+// Uniform grid over the XZ plane, hashed into a fixed number of buckets so 
+// the world does not need bounds. Rebuild it whenever the points move: call
+// Clear(), Insert() each point and then Build(). Queries return every id 
+// whose XZ position was within the radius at Build() time; callers do their 
+// own exact test on the results.
+class SpatialHash {
+public:
+    static const int kMaxEntries = 8192;
+    static const int kNumBuckets = 4096; // Must be a power of two
+
+    void Clear(float cell_size);
+    void Insert(int id, const glm::vec3& pos);
+    void Build();
+    // Return the number of ids written to results, at most max_results
+    int QueryRadius(const glm::vec3& center, float radius, int* results, int max_results);
+    int QuerySegment(const glm::vec3& segment_start, const glm::vec3& segment_end, 
+                     float radius, int* results, int max_results);
+    int num_entries;
+
+private:
+    int CellCoord(float val);
+    int BucketIndex(int cell_x, int cell_z);
+    // Append the bucket's entries that pass the distance test, once per query
+    void ScanBucket(int bucket, const glm::vec2& segment_start, const glm::vec2& segment_end,
+                    float radius, int* results, int max_results, int* num_results);
+
+    float cell_size;
+    float inv_cell_size;
+    // Filled by Insert()
+    int insert_ids[kMaxEntries];
+    glm::vec2 insert_pos[kMaxEntries];
+    int insert_bucket[kMaxEntries];
+    // Entries sorted by bucket, bucket i is [bucket_start[i], bucket_start[i+1])
+    int bucket_start[kNumBuckets+1];
+    int ids[kMaxEntries];
+    glm::vec2 pos[kMaxEntries];
+    // Buckets can be reached from more than one cell, this stops double counting
+    int bucket_query_stamp[kNumBuckets];
+    int query_stamp;
+};
+
+#endif
@@ -5,18 +5,53 @@
 #include "platform_sdl/error.h"
 #include "platform_sdl/file_io.h"
 #include "platform_sdl/graphics.h"
+#include "platform_sdl/hitch_detector.h"
+#include "platform_sdl/logger.h"
+#include "platform_sdl/perf_overlay.h"
+#include "platform_sdl/perf_counters.h"
 #include "platform_sdl/profiler.h"
+#include "platform_sdl/sampling_profiler.h"
 #include "internal/common.h"
+#include "internal/job_system.h"
 #include "internal/memory.h"
+#include "game/batch_runner.h"
+#include "game/character_benchmark.h"
+#include "game/game_snapshot.h"
 #include "game/game_state.h"
+#include "game/input_recording.h"
+#include <cmath>
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
 #include <sys/stat.h>
 #include <new>
 #ifdef EMSCRIPTEN
 #include <emscripten/emscripten.h>
 #endif
 
+// Settings shared by the windowed and headless runs
+struct SimulationOptions {
+    float ticks_per_second;
+    int num_characters;
+    Uint32 random_seed;
+    InputRecorder* recorder; // Saves each tick's input if not NULL
+    InputPlayer* player; // Supplies each tick's input instead of the devices if not NULL
+    const GameSnapshot* start_snapshot; // Replaces the state Init() sets up if not NULL
+    const char* save_snapshot_path; // Gets the starting state if not NULL
+};
+
+// Snapshots taken every so often during a replay, so seeking only has to 
+// simulate forward from the nearest one before the target
+struct ReplaySnapshots {
+    static const int kMaxSnapshots = 32;
+    static const int kMemoryBudget = 1024*1024*8;
+    static const int kIntervalTicks = 600;
+    int num_snapshots;
+    GameSnapshot snapshots[kMaxSnapshots];
+    int ticks[kMaxSnapshots]; // Replay tick each was taken before, -1 if unused
+    int next_snapshot; // Slot to overwrite next
+};
+
 // GameLoop is split into a void func(void* data) function for Emscripten
 
 struct GameLoopParams {
@@ -26,10 +61,76 @@ struct GameLoopParams {
     GraphicsContext* graphics_context;
     AudioContext* audio_context;
     GameState* game_state;
+    PerfOverlay* perf_overlay;
+    HitchDetector* hitch_detector;
+    const char* write_dir;
     bool *game_running;
-    int *last_ticks;
+    float tick_seconds; // Length of one simulation tick
+    double *tick_accumulator; // Seconds of real time not yet simulated
+    glm::vec2 *pending_mouse_rel; // Mouse motion since the last tick
+    InputRecorder* recorder; // Saves each tick's input if not NULL
+    InputPlayer* player; // Supplies each tick's input instead of the devices if not NULL
+    const GameSnapshot* round_start; // Restored to restart the round
+    ReplaySnapshots* replay_snapshots; // Only used with a player
+    Uint64 *last_update_counter;
+    Uint64 *last_frame_counter;
+    int *last_total_allocs;
 };
 
+// Run one replay tick, snapshotting the state beforehand now and then
+static bool ReplayTick(GameLoopParams* params) {
+    InputPlayer* player = params->player;
+    ReplaySnapshots* replay = params->replay_snapshots;
+    if(player->tick % ReplaySnapshots::kIntervalTicks == 0 && player->tick > 0){
+        bool have_snapshot = false;
+        for(int i=0; i<replay->num_snapshots; ++i){
+            if(replay->ticks[i] == player->tick){
+                have_snapshot = true;
+            }
+        }
+        if(!have_snapshot){
+            int slot = replay->next_snapshot;
+            replay->snapshots[slot].Save(*params->game_state);
+            replay->ticks[slot] = player->tick;
+            replay->next_snapshot = (slot + 1) % replay->num_snapshots;
+        }
+    }
+    SimulationInput input;
+    if(!player->NextTick(&input)){
+        return false;
+    }
+    if(params->recorder){
+        params->recorder->AddTick(input);
+    }
+    params->game_state->Update(input, params->tick_seconds);
+    return true;
+}
+
+// Jump the replay to target_tick, from the latest snapshot at or before it
+static void SeekReplay(GameLoopParams* params, int target_tick) {
+    InputPlayer* player = params->player;
+    ReplaySnapshots* replay = params->replay_snapshots;
+    target_tick = max(0, min(target_tick, player->num_ticks));
+    const GameSnapshot* start = params->round_start;
+    int start_tick = 0;
+    for(int i=0; i<replay->num_snapshots; ++i){
+        if(replay->ticks[i] <= target_tick && replay->ticks[i] > start_tick){
+            start = &replay->snapshots[i];
+            start_tick = replay->ticks[i];
+        }
+    }
+    params->profiler->StartEvent("Replay seek");
+    // Carry on from where the replay is if that's closer
+    if(target_tick < player->tick || start_tick > player->tick){
+        start->Restore(params->game_state);
+        player->Seek(start_tick);
+    }
+    while(player->tick < target_tick && ReplayTick(params)){
+    }
+    params->profiler->EndEvent();
+    LogMessage(kLogInfo, "Replay at tick %d of %d", player->tick, player->num_ticks);
+}
+
 void GameLoop(void* game_loop_params_ptr) {
     GameLoopParams* params = (GameLoopParams*)game_loop_params_ptr;
     Profiler* profiler = params->profiler;
@@ -38,12 +139,41 @@ void GameLoop(void* game_loop_params_ptr) {
     GraphicsContext* graphics_context = params->graphics_context;
     AudioContext* audio_context = params->audio_context;
     GameState* game_state = params->game_state;
+    PerfOverlay* perf_overlay = params->perf_overlay;
     bool* game_running = params->game_running;
-    int* last_ticks = params->last_ticks;
 
+    // Time the previous frame, whose profiler zones have just been flushed
+    Uint64 frame_counter = SDL_GetPerformanceCounter();
+    float frame_milliseconds = (float)((frame_counter - *params->last_frame_counter) * 1000.0 /
+                                       (double)SDL_GetPerformanceFrequency());
+    *params->last_frame_counter = frame_counter;
+    perf_overlay->AddFrameTime(frame_milliseconds);
+    int total_allocs = stack_allocator->GetTotalAllocs();
+    if(params->hitch_detector->AddFrame(frame_milliseconds, profiler)){
+        HitchContext context;
+        context.game_time = game_state->game_time;
+        context.characters_alive = game_state->NumCharactersAlive();
+        context.active_minds = game_state->NumActiveMinds();
+        context.pending_file_requests = 0;
+#ifdef HAVE_THREADS
+        if (SDL_LockMutex(file_load_thread_data->mutex) == 0) {
+            context.pending_file_requests = file_load_thread_data->queue.NumPending();
+            SDL_UnlockMutex(file_load_thread_data->mutex);
+        }
+#endif
+        context.audio_update_microseconds = audio_context->last_update_microseconds;
+        context.memory_used = stack_allocator->GetUsedBytes();
+        context.memory_size = stack_allocator->GetSize();
+        context.allocator_blocks = stack_allocator->GetNumBlocks();
+        context.allocations_this_frame = total_allocs - *params->last_total_allocs;
+        params->hitch_detector->WriteCapture(params->write_dir, context);
+    }
+    *params->last_total_allocs = total_allocs;
+
+    profiler->MarkFrame();
     profiler->StartEvent("Game loop");
     SDL_Event event;
-    glm::vec2 mouse_rel;
+    glm::vec2& mouse_rel = *params->pending_mouse_rel;
     while(SDL_PollEvent(&event)){
         switch(event.type){
         case SDL_QUIT:
@@ -53,16 +183,92 @@ void GameLoop(void* game_loop_params_ptr) {
             mouse_rel[0] += event.motion.xrel;
             mouse_rel[1] += event.motion.yrel;
             break;
+        case SDL_KEYDOWN:
+            if(event.key.repeat){
+                break;
+            }
+            if(event.key.keysym.scancode == SDL_SCANCODE_F3){
+                perf_overlay->visible = !perf_overlay->visible;
+            }
+            if(event.key.keysym.scancode == SDL_SCANCODE_F5){
+                // A recording has to match the game from the start
+                if(params->recorder){
+                    LogMessage(kLogWarning, "Can't restart while recording input");
+                } else if(params->player){
+                    SeekReplay(params, 0);
+                } else {
+                    params->round_start->Restore(game_state);
+                    LogMessage(kLogInfo, "Restarted round");
+                }
+            }
+            if(params->player && !params->recorder){
+                static const int kSeekSeconds = 10;
+                int seek_ticks = (int)(kSeekSeconds / params->tick_seconds);
+                if(event.key.keysym.scancode == SDL_SCANCODE_F6){
+                    SeekReplay(params, params->player->tick - seek_ticks);
+                }
+                if(event.key.keysym.scancode == SDL_SCANCODE_F7){
+                    SeekReplay(params, params->player->tick + seek_ticks);
+                }
+            }
+            break;
         }
     }
     profiler->StartEvent("Update");
+    // Run as many fixed ticks as real time has covered, up to a limit so a
+    // slow frame doesn't snowball into ever more ticks to catch up on
+    static const int kMaxTicksPerFrame = 5;
     float time_scale = 1.0f;// 0.1f;
-    int ticks = SDL_GetTicks();
-    game_state->Update(mouse_rel, (ticks - *last_ticks) / 1000.0f * time_scale);
-    *last_ticks = ticks;
+    Uint64 update_counter = SDL_GetPerformanceCounter();
+    *params->tick_accumulator += (update_counter - *params->last_update_counter) / 
+        (double)SDL_GetPerformanceFrequency() * time_scale;
+    *params->last_update_counter = update_counter;
+    int num_ticks = 0;
+    while(*params->tick_accumulator >= params->tick_seconds && num_ticks < kMaxTicksPerFrame){
+        if(params->player){
+            if(!ReplayTick(params)){
+                LogMessage(kLogInfo, "Replay finished after %d ticks, checksum %08x", 
+                           params->player->num_ticks, game_state->CalcChecksum());
+                *game_running = false;
+                break;
+            }
+        } else {
+            SimulationInput input;
+            ReadSimulationInput(&input, mouse_rel);
+            if(params->recorder){
+                params->recorder->AddTick(input);
+            }
+            game_state->Update(input, params->tick_seconds);
+        }
+        mouse_rel = glm::vec2(0.0f);
+        *params->tick_accumulator -= params->tick_seconds;
+        ++num_ticks;
+    }
+    if(*params->tick_accumulator >= params->tick_seconds){
+        // Too far behind, drop the whole ticks but keep the fraction
+        *params->tick_accumulator = fmod(*params->tick_accumulator, (double)params->tick_seconds);
+    }
+    float interpolation = (float)(*params->tick_accumulator / params->tick_seconds);
     profiler->EndEvent();
+    AudioStats audio_stats;
+    GetAudioStats(audio_context, &audio_stats);
     profiler->StartEvent("Draw");
-    game_state->Draw(graphics_context, SDL_GetTicks(), profiler);
+    graphics_context->render_stats.Clear();
+    graphics_context->gpu_profiler.StartFrame(profiler);
+    graphics_context->gpu_profiler.StartZone("Draw");
+    game_state->Draw(graphics_context, SDL_GetTicks(), interpolation, profiler);
+    if(perf_overlay->visible){
+        PerfOverlayStats stats;
+        stats.memory_used = stack_allocator->GetUsedBytes();
+        stats.memory_size = stack_allocator->GetSize();
+        stats.characters_alive = game_state->NumCharactersAlive();
+        stats.num_drawables = game_state->num_drawables;
+        stats.audio_buffer_fill = audio_stats.buffer_fill;
+        stats.audio_underruns = audio_stats.num_underruns;
+        stats.audio_latency_milliseconds = audio_stats.latency_milliseconds;
+        perf_overlay->Draw(graphics_context, profiler, stats);
+    }
+    graphics_context->gpu_profiler.EndZone();
     profiler->EndEvent();
     profiler->StartEvent("Audio");
     UpdateAudio(audio_context, stack_allocator);
@@ -71,11 +277,19 @@ void GameLoop(void* game_loop_params_ptr) {
     SDL_GL_SwapWindow(graphics_context->window);
     profiler->EndEvent();
     profiler->EndEvent();
+    profiler->RecordCounter("Memory used (bytes)", stack_allocator->GetUsedBytes());
+    profiler->RecordCounter("Characters alive", game_state->NumCharactersAlive());
+    profiler->RecordCounter("Simulation ticks", num_ticks);
+    RecordRenderCounters(graphics_context->render_stats, profiler);
+    RecordAudioCounters(audio_context, audio_stats, profiler);
 }
 
-static void RunGame(Profiler* profiler, FileLoadThreadData* file_load_thread_data, 
-                    StackAllocator* stack_allocator, GraphicsContext* graphics_context,
-                    AudioContext* audio_context) 
+// Allocate and initialize the game, headless if graphics_context is NULL,
+// and leave round_start holding its starting state
+static GameState* CreateGameState(Profiler* profiler, FileLoadThreadData* file_load_thread_data, 
+                                  StackAllocator* stack_allocator, GraphicsContext* graphics_context,
+                                  AudioContext* audio_context, JobSystem* job_system, 
+                                  const SimulationOptions& options, GameSnapshot* round_start)
 {
     GameState* game_state;
     game_state = new((GameState*)stack_allocator->Alloc(sizeof(GameState))) GameState();
@@ -83,18 +297,82 @@ static void RunGame(Profiler* profiler, FileLoadThreadData* file_load_thread_dat
         FormattedError("Error", "Could not alloc memory for game state");
         exit(1);
     }
+    game_state->job_system = job_system;
+    game_state->num_characters = options.num_characters;
+    game_state->random_seed = options.random_seed;
+    game_state->headless = (graphics_context == NULL);
+
+    int init_stage = 0;
+    while(init_stage != -1) {
+        game_state->Init(&init_stage, graphics_context, audio_context, profiler, 
+                         file_load_thread_data, stack_allocator);
+    }
+    if(options.start_snapshot && !options.start_snapshot->Restore(game_state)){
+        FormattedError("Error", "Game snapshot does not match the game");
+        exit(1);
+    }
+    if(!round_start->Init(*game_state, stack_allocator)){
+        FormattedError("Error", "Could not alloc memory for game snapshot");
+        exit(1);
+    }
+    round_start->Save(*game_state);
+    if(options.save_snapshot_path && round_start->WriteFile(options.save_snapshot_path)){
+        LogMessage(kLogInfo, "Saved game snapshot to %s", options.save_snapshot_path);
+    }
+    return game_state;
+}
 
+static void RunGame(Profiler* profiler, FileLoadThreadData* file_load_thread_data, 
+                    StackAllocator* stack_allocator, GraphicsContext* graphics_context,
+                    AudioContext* audio_context, JobSystem* job_system, 
+                    const char* write_dir, float hitch_threshold_factor, 
+                    const SimulationOptions& options, int replay_seek_ticks) 
+{
     glViewport(0, 0, graphics_context->screen_dims[0], graphics_context->screen_dims[1]);
     glClearColor(0,0,0,1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     SDL_GL_SwapWindow(graphics_context->window);
 
-    int init_stage = 0;
-    while(init_stage != -1) {
-        game_state->Init(&init_stage, graphics_context, audio_context, profiler, 
-                         file_load_thread_data, stack_allocator);
+    GameSnapshot round_start;
+    GameState* game_state = CreateGameState(profiler, file_load_thread_data, stack_allocator,
+                                            graphics_context, audio_context, job_system, 
+                                            options, &round_start);
+    PerfOverlay* perf_overlay = (PerfOverlay*)stack_allocator->Alloc(sizeof(PerfOverlay));
+    if(!perf_overlay){
+        FormattedError("Error", "Could not alloc memory for perf overlay");
+        exit(1);
     }
-    int last_ticks = SDL_GetTicks();
+    perf_overlay->Init(game_state->lines.shader, &game_state->text_atlas, stack_allocator);
+
+    // Static since the log writer thread may still be writing a capture from
+    // it after the game loop ends
+    static HitchDetector hitch_detector;
+    hitch_detector.Init(hitch_threshold_factor);
+
+    ReplaySnapshots* replay_snapshots = NULL;
+    if(options.player){
+        replay_snapshots = (ReplaySnapshots*)stack_allocator->Alloc(sizeof(ReplaySnapshots));
+        if(!replay_snapshots){
+            FormattedError("Error", "Could not alloc memory for replay snapshots");
+            exit(1);
+        }
+        int num_snapshots = ReplaySnapshots::kMemoryBudget / GameSnapshot::CalcSize(*game_state);
+        replay_snapshots->num_snapshots = max(1, min(num_snapshots, ReplaySnapshots::kMaxSnapshots));
+        replay_snapshots->next_snapshot = 0;
+        for(int i=0; i<replay_snapshots->num_snapshots; ++i){
+            replay_snapshots->ticks[i] = -1;
+            if(!replay_snapshots->snapshots[i].Init(*game_state, stack_allocator)){
+                FormattedError("Error", "Could not alloc memory for replay snapshots");
+                exit(1);
+            }
+        }
+    }
+
+    double tick_accumulator = 0.0;
+    glm::vec2 pending_mouse_rel;
+    Uint64 last_update_counter = SDL_GetPerformanceCounter();
+    Uint64 last_frame_counter = SDL_GetPerformanceCounter();
+    int last_total_allocs = stack_allocator->GetTotalAllocs();
     bool game_running = true;
 
     GameLoopParams params;
@@ -104,8 +382,24 @@ static void RunGame(Profiler* profiler, FileLoadThreadData* file_load_thread_dat
     params.graphics_context = graphics_context;
     params.audio_context = audio_context;
     params.game_state = game_state;
+    params.perf_overlay = perf_overlay;
+    params.hitch_detector = &hitch_detector;
+    params.write_dir = write_dir;
+    params.last_total_allocs = &last_total_allocs;
     params.game_running = &game_running;
-    params.last_ticks = &last_ticks;
+    params.tick_seconds = 1.0f / options.ticks_per_second;
+    params.tick_accumulator = &tick_accumulator;
+    params.pending_mouse_rel = &pending_mouse_rel;
+    params.recorder = options.recorder;
+    params.player = options.player;
+    params.round_start = &round_start;
+    params.replay_snapshots = replay_snapshots;
+    params.last_update_counter = &last_update_counter;
+    params.last_frame_counter = &last_frame_counter;
+    if(options.player && replay_seek_ticks > 0){
+        // Fast-forward through the start of the replay without drawing
+        SeekReplay(&params, replay_seek_ticks);
+    }
 #ifdef EMSCRIPTEN
     emscripten_set_main_loop_arg(GameLoop, &params, 0, 1);
 #else
@@ -115,9 +409,208 @@ static void RunGame(Profiler* profiler, FileLoadThreadData* file_load_thread_dat
 #endif
 }
 
+static int CompareFloats(const void* a, const void* b) {
+    float val[] = {*(const float*)a, *(const float*)b};
+    return (val[0] > val[1]) - (val[0] < val[1]);
+}
+
+// Run the simulation with no window, GPU or audio, as fast as it will go, 
+// feeding it scripted or replayed input, and log how long each tick took and
+// a checksum of where it ended up. Runs with the same seed, character count
+// and input should end with the same checksum.
+static void RunHeadless(Profiler* profiler, FileLoadThreadData* file_load_thread_data, 
+                        StackAllocator* stack_allocator, JobSystem* job_system,
+                        int num_ticks, const SimulationOptions& options)
+{
+    InputRecorder* recorder = options.recorder;
+    InputPlayer* player = options.player;
+    float ticks_per_second = options.ticks_per_second;
+
+    if(player && player->num_ticks < num_ticks){
+        num_ticks = player->num_ticks;
+    }
+    // A recording with only a header, or a first tick cut short, has nothing to run
+    if(num_ticks == 0){
+        LogMessage(kLogWarning, "Headless: input recording has no ticks, nothing to run");
+        return;
+    }
+    GameSnapshot round_start;
+    GameState* game_state = CreateGameState(profiler, file_load_thread_data, stack_allocator,
+                                            NULL, NULL, job_system, options, &round_start);
+    float* tick_milliseconds = (float*)stack_allocator->Alloc(num_ticks * sizeof(float));
+    if(!tick_milliseconds){
+        FormattedError("Error", "Could not alloc memory for %d tick times", num_ticks);
+        exit(1);
+    }
+    LogMessage(kLogInfo, "Headless: running %d ticks of %d characters at %.1f ticks per second", 
+               num_ticks, options.num_characters, ticks_per_second);
+    // Log progress now and then, so long soak runs show where they diverge
+    static const int kReportInterval = 3600;
+    float tick_seconds = 1.0f / ticks_per_second;
+    double total_milliseconds = 0.0;
+    for(int tick=0; tick<num_ticks; ++tick){
+        profiler->MarkFrame();
+        SimulationInput input;
+        if(player){
+            player->NextTick(&input);
+        } else {
+            GetScriptedInput(tick, tick_seconds, &input);
+        }
+        if(recorder){
+            recorder->AddTick(input);
+        }
+        Uint64 start = SDL_GetPerformanceCounter();
+        game_state->Update(input, tick_seconds);
+        Uint64 end = SDL_GetPerformanceCounter();
+        tick_milliseconds[tick] = (float)((end - start) * 1000.0 / 
+                                          (double)SDL_GetPerformanceFrequency());
+        total_milliseconds += tick_milliseconds[tick];
+        profiler->RecordCounter("Characters alive", game_state->NumCharactersAlive());
+        if((tick+1) % kReportInterval == 0){
+            LogMessage(kLogInfo, "Headless: tick %d, %d characters alive, checksum %08x", 
+                       tick+1, game_state->NumCharactersAlive(), game_state->CalcChecksum());
+        }
+    }
+
+    qsort(tick_milliseconds, num_ticks, sizeof(float), CompareFloats);
+    LogMessage(kLogInfo, "Headless: tick ms mean %.3f, median %.3f, 99th percentile %.3f, max %.3f, total %.1f", 
+               total_milliseconds / num_ticks, tick_milliseconds[num_ticks/2], 
+               tick_milliseconds[num_ticks*99/100], tick_milliseconds[num_ticks-1], 
+               total_milliseconds);
+    LogMessage(kLogInfo, "Headless: finished at %.2f seconds of game time, %d characters alive, checksum %08x", 
+               game_state->game_time, game_state->NumCharactersAlive(), game_state->CalcChecksum());
+    stack_allocator->Free(tick_milliseconds);
+}
+
 int main(int argc, char* argv[]) {
-    Profiler profiler;
+    static Profiler profiler; // Too big for the stack
     profiler.Init();
+    SetGlobalProfiler(&profiler);
+
+    // Frames taking this many times longer than the recent average get a hitch capture
+    float hitch_threshold_factor = 2.0f;
+    bool sample_profile = false;
+    bool use_perf_counters = false;
+    bool bench_characters = false;
+    int num_job_threads = -1; // Worker threads besides the main thread, -1 for one per extra core
+    float ticks_per_second = 60.0f; // Simulation rate, independent of the frame rate
+    int num_characters = GameState::kDefaultNumCharacters;
+    int headless_ticks = 0; // Run this many ticks without a window instead of the game
+    // Headless runs are seeded the same every time unless asked otherwise, 
+    // so their checksums can be compared
+    Uint32 random_seed = 1;
+    bool has_random_seed = false;
+    const char* record_path = NULL;
+    const char* replay_path = NULL;
+    int replay_seek_ticks = 0; // Replay ticks to simulate before the first frame
+    const char* load_snapshot_path = NULL;
+    const char* save_snapshot_path = NULL;
+    // Batch runs are every seed from random_seed on at every character count
+    int batch_seeds = 0;
+    BatchSettings batch_settings;
+    batch_settings.num_character_counts = 0;
+    const char* batch_output_path = NULL;
+    for(int i=1; i<argc; ++i){
+        if(strcmp(argv[i], "--hitch-factor") == 0 && i+1 < argc){
+            hitch_threshold_factor = (float)atof(argv[++i]);
+        } else if(strcmp(argv[i], "--sample-profile") == 0){
+            sample_profile = true;
+        } else if(strcmp(argv[i], "--perf-counters") == 0){
+            use_perf_counters = true;
+        } else if(strcmp(argv[i], "--bench-characters") == 0){
+            bench_characters = true;
+        } else if(strcmp(argv[i], "--job-threads") == 0 && i+1 < argc){
+            num_job_threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--tick-rate") == 0 && i+1 < argc){
+            ticks_per_second = (float)atof(argv[++i]);
+            if(ticks_per_second <= 0.0f){
+                FormattedError("Invalid tick rate", "--tick-rate must be above zero, got %s", argv[i]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--characters") == 0 && i+1 < argc){
+            num_characters = atoi(argv[++i]);
+            if(num_characters < 1 || num_characters > GameState::kMaxCharacters){
+                FormattedError("Invalid character count", "--characters must be between 1 and %d, got %s", 
+                               GameState::kMaxCharacters, argv[i]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--headless") == 0 && i+1 < argc){
+            headless_ticks = atoi(argv[++i]);
+            if(headless_ticks <= 0){
+                FormattedError("Invalid tick count", "--headless must be above zero, got %s", argv[i]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc){
+            random_seed = (Uint32)strtoul(argv[++i], NULL, 10);
+            has_random_seed = true;
+        } else if(strcmp(argv[i], "--record") == 0 && i+1 < argc){
+            record_path = argv[++i];
+        } else if(strcmp(argv[i], "--replay") == 0 && i+1 < argc){
+            replay_path = argv[++i];
+        } else if(strcmp(argv[i], "--replay-seek") == 0 && i+1 < argc){
+            replay_seek_ticks = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--load-snapshot") == 0 && i+1 < argc){
+            load_snapshot_path = argv[++i];
+        } else if(strcmp(argv[i], "--save-snapshot") == 0 && i+1 < argc){
+            save_snapshot_path = argv[++i];
+        } else if(strcmp(argv[i], "--batch") == 0 && i+1 < argc){
+            batch_seeds = atoi(argv[++i]);
+            if(batch_seeds <= 0){
+                FormattedError("Invalid seed count", "--batch must be above zero, got %s", argv[i]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--batch-characters") == 0 && i+1 < argc){
+            // Comma separated list of character counts
+            const char* list = argv[++i];
+            while(*list){
+                int count = atoi(list);
+                if(count < 1 || count > GameState::kMaxCharacters || 
+                   batch_settings.num_character_counts == BatchSettings::kMaxCharacterCounts)
+                {
+                    FormattedError("Invalid character counts", "--batch-characters takes up to %d counts "
+                                   "between 1 and %d, got %s", BatchSettings::kMaxCharacterCounts, 
+                                   GameState::kMaxCharacters, argv[i]);
+                    return 1;
+                }
+                batch_settings.character_counts[batch_settings.num_character_counts++] = count;
+                while(*list && *list != ','){
+                    ++list;
+                }
+                if(*list == ','){
+                    ++list;
+                }
+            }
+        } else if(strcmp(argv[i], "--batch-out") == 0 && i+1 < argc){
+            batch_output_path = argv[++i];
+        }
+    }
+    if(batch_seeds > 0 && (record_path || replay_path || load_snapshot_path)){
+        FormattedError("Invalid arguments", "--batch can't be combined with --record, --replay "
+                       "or --load-snapshot, batch games use scripted input from a fresh start");
+        return 1;
+    }
+    if(load_snapshot_path && (record_path || replay_path)){
+        FormattedError("Invalid arguments", "--load-snapshot can't be combined with --record or --replay, "
+                       "recordings start from a fresh game");
+        return 1;
+    }
+    static JobSystem job_system; // Too big for the stack
+    if(bench_characters){
+        job_system.Init(num_job_threads);
+        RunCharacterMovementBenchmark(&job_system);
+        job_system.Dispose();
+        return 0;
+    }
+    // Counts main thread events only, the counters follow the thread that opens them
+    PerfCounters perf_counters;
+    if(use_perf_counters && perf_counters.Init()){
+        profiler.SetPerfCounters(&perf_counters);
+    }
+    SamplingProfiler sampling_profiler;
+    if(sample_profile){
+        static const int kSamplesPerSecond = 500;
+        sampling_profiler.Start(&profiler, kSamplesPerSecond);
+    }
 
     profiler.StartEvent("Allocate game memory block");
         static const int kGameMemSize = 1024*1024*32;
@@ -129,15 +622,74 @@ int main(int argc, char* argv[]) {
         }
     profiler.EndEvent();
 
+    // A replay brings the seed, character count and tick rate it was recorded with
+    InputPlayer input_player;
+    if(replay_path){
+        if(!input_player.Load(replay_path, &stack_allocator)){
+            FormattedError("Replay failed", "Could not load input recording %s", replay_path);
+            return 1;
+        }
+        random_seed = input_player.header.random_seed;
+        has_random_seed = true;
+        num_characters = input_player.header.num_characters;
+        ticks_per_second = 1.0f / input_player.header.tick_seconds;
+    }
+    // So does a snapshot, besides the tick rate
+    GameSnapshot start_snapshot;
+    if(load_snapshot_path){
+        if(!start_snapshot.ReadFile(load_snapshot_path, &stack_allocator)){
+            FormattedError("Loading snapshot failed", "Could not load game snapshot %s", load_snapshot_path);
+            return 1;
+        }
+        random_seed = start_snapshot.random_seed;
+        has_random_seed = true;
+        num_characters = start_snapshot.num_characters;
+    }
+
+    bool headless = headless_ticks > 0 || batch_seeds > 0;
     profiler.StartEvent("Initializing SDL");
-        if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO) < 0) {
+        Uint32 sdl_subsystems = headless ? 0 : (SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO);
+        if(SDL_Init(sdl_subsystems) < 0) {
             FormattedError("SDL_Init failed", "Could not initialize SDL: %s", SDL_GetError());
             return 1;
         }
-        srand((unsigned)SDL_GetPerformanceCounter()); // Set seed for simple rand()
+        if(!headless && !has_random_seed){
+            random_seed = (Uint32)SDL_GetPerformanceCounter();
+        }
         char* write_dir = SDL_GetPrefPath("Wolfire", "UnderGlass");
     profiler.EndEvent();
 
+    static Logger logger; // Too big for the stack
+    {
+        static const int kMaxPathSize = 4096;
+        char path[kMaxPathSize];
+        FormatString(path, kMaxPathSize, "%slog.txt", write_dir);
+        if(logger.Init(path)){
+            SetGlobalLogger(&logger);
+        }
+    }
+    job_system.Init(num_job_threads);
+
+    InputRecorder input_recorder;
+    if(record_path){
+        InputRecordingHeader header;
+        header.random_seed = random_seed;
+        header.num_characters = num_characters;
+        header.tick_seconds = 1.0f / ticks_per_second;
+        if(!input_recorder.Start(record_path, header)){
+            FormattedError("Recording failed", "Could not open %s to record input", record_path);
+            return 1;
+        }
+    }
+    SimulationOptions options;
+    options.ticks_per_second = ticks_per_second;
+    options.num_characters = num_characters;
+    options.random_seed = random_seed;
+    options.recorder = record_path ? &input_recorder : NULL;
+    options.player = replay_path ? &input_player : NULL;
+    options.start_snapshot = load_snapshot_path ? &start_snapshot : NULL;
+    options.save_snapshot_path = save_snapshot_path;
+
     profiler.StartEvent("Checking for assets folder");
     {
         struct stat st;
@@ -206,31 +758,70 @@ int main(int argc, char* argv[]) {
 #endif
     profiler.EndEvent();
 
-    profiler.StartEvent("Set up graphics context");
-        GraphicsContext graphics_context;
-        InitGraphicsContext(&graphics_context);
-    profiler.EndEvent();
-
+    GraphicsContext graphics_context;
     AudioContext audio_context;
-    InitAudio(&audio_context, &stack_allocator);
+    if(batch_seeds > 0){
+        static const int kDefaultBatchTicks = 3600;
+        static const int kMaxPathSize = 4096;
+        char batch_path[kMaxPathSize];
+        if(!batch_output_path){
+            FormatString(batch_path, kMaxPathSize, "%sbatch_results.json", write_dir);
+            batch_output_path = batch_path;
+        }
+        batch_settings.num_seeds = batch_seeds;
+        batch_settings.first_seed = random_seed;
+        if(batch_settings.num_character_counts == 0){
+            batch_settings.character_counts[batch_settings.num_character_counts++] = num_characters;
+        }
+        batch_settings.num_ticks = headless_ticks > 0 ? headless_ticks : kDefaultBatchTicks;
+        batch_settings.ticks_per_second = ticks_per_second;
+        batch_settings.output_path = batch_output_path;
+        RunBatch(batch_settings, &profiler, &file_load_thread_data, &job_system);
+    } else if(headless){
+        RunHeadless(&profiler, &file_load_thread_data, &stack_allocator, &job_system,
+                    headless_ticks, options);
+    } else {
+        profiler.StartEvent("Set up graphics context");
+            InitGraphicsContext(&graphics_context);
+        profiler.EndEvent();
 
-    RunGame(&profiler, &file_load_thread_data, &stack_allocator, 
-            &graphics_context, &audio_context);
+        InitAudio(&audio_context, &stack_allocator);
+
+        RunGame(&profiler, &file_load_thread_data, &stack_allocator, 
+                &graphics_context, &audio_context, &job_system, write_dir, 
+                hitch_threshold_factor, options, replay_seek_ticks);
+    }
+    if(options.recorder){
+        options.recorder->Finish();
+    }
 
     {
         static const int kMaxPathSize = 4096;
         char path[kMaxPathSize];
         FormatString(path, kMaxPathSize, "%sprofile_data.txt", write_dir);
         profiler.Export(path);
+        FormatString(path, kMaxPathSize, "%sprofile_trace.json", write_dir);
+        profiler.ExportChromeTrace(path);
+        if(sample_profile){
+            sampling_profiler.Stop();
+            FormatString(path, kMaxPathSize, "%sprofile_samples.folded", write_dir);
+            sampling_profiler.ExportFoldedStacks(path);
+        }
+        if(use_perf_counters){
+            profiler.SetPerfCounters(NULL);
+            perf_counters.Dispose();
+        }
     }
 
-    // Wait for the audio to fade out
-    // TODO: handle this better -- e.g. force audio fade immediately
-    SDL_Delay(200);
-    // We can probably just skip most of this if we want to quit faster
-    SDL_CloseAudioDevice(audio_context.device_id);
-    SDL_GL_DeleteContext(graphics_context.gl_context);  
-    SDL_DestroyWindow(graphics_context.window);
+    if(!headless){
+        // Wait for the audio to fade out
+        // TODO: handle this better -- e.g. force audio fade immediately
+        SDL_Delay(200);
+        // We can probably just skip most of this if we want to quit faster
+        SDL_CloseAudioDevice(audio_context.device_id);
+        SDL_GL_DeleteContext(graphics_context.gl_context);  
+        SDL_DestroyWindow(graphics_context.window);
+    }
     // Cleanly shut down file load thread 
 #ifdef HAVE_THREADS
     if (SDL_LockMutex(file_load_thread_data.mutex) == 0) {
@@ -242,6 +833,9 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
 #endif
+    job_system.Dispose();
+    SetGlobalLogger(NULL);
+    logger.Dispose();
     SDL_free(write_dir);
     SDL_Quit();
     free(stack_allocator.mem);
@@ -1,8 +1,10 @@
 #include "platform_sdl/audio.h"
 #include "platform_sdl/error.h"
+#include "platform_sdl/profiler.h"
 #include "internal/memory.h"
 #include "internal/common.h"
 #include <SDL.h>
+#include <cmath>
 #ifdef USE_STB_VORBIS
     #include "stb_vorbis.c"
 #else
@@ -77,7 +79,20 @@ long OGVmemoryTell(void* data) {
 
 // TODO: handle audio fade-in/out here?
 static void MyAudioCallback (void* userdata, Uint8* stream, int len) {
+    PROFILE_THREAD_NAME("Audio callback thread");
+    PROFILE_SCOPE("Audio callback");
     AudioContext* audio_context = (AudioContext*)userdata;
+    // Callbacks should arrive once per device buffer, late ones risk dropouts
+    Uint64 counter = SDL_GetPerformanceCounter();
+    if(audio_context->num_callbacks > 0){
+        const SDL_AudioSpec& spec = audio_context->audio_spec;
+        double interval = (counter - audio_context->last_callback_counter) * 1000.0 / SDL_GetPerformanceFrequency();
+        double expected_interval = len / (double)(spec.size / spec.samples) * 1000.0 / spec.freq;
+        audio_context->max_callback_jitter_milliseconds = max(audio_context->max_callback_jitter_milliseconds, 
+                                                              (float)fabs(interval - expected_interval));
+    }
+    audio_context->last_callback_counter = counter;
+    ++audio_context->num_callbacks;
     int fill_index = audio_context->buffer_read_byte;
     int fill_amount = min(len, audio_context->buffer_size - audio_context->buffer_read_byte);
     for(int i=0; i<fill_amount; ++i){
@@ -86,6 +101,11 @@ static void MyAudioCallback (void* userdata, Uint8* stream, int len) {
     for(int i=fill_amount; i<len; ++i){
         stream[i] = 0;
     }
+    if(fill_amount < len && !audio_context->shutting_down){
+        ++audio_context->num_underruns;
+        const SDL_AudioSpec& spec = audio_context->audio_spec;
+        audio_context->underrun_frames += (len - fill_amount) / (spec.size / spec.samples);
+    }
     audio_context->buffer_read_byte += fill_amount;
 }
 
@@ -93,6 +113,7 @@ static const float kMasterGain = 1.0f;
 static const float kMusicGain = 1.0f;
 
 void UpdateAudio(AudioContext* audio_context, StackAllocator* stack_allocator) {
+    Uint64 start_counter = SDL_GetPerformanceCounter();
     // Get playback position in buffer
     SDL_LockAudioDevice(audio_context->device_id);
     int temp_buffer_read_byte = audio_context->buffer_read_byte;
@@ -134,6 +155,7 @@ void UpdateAudio(AudioContext* audio_context, StackAllocator* stack_allocator) {
                     ++index;                    
                 }
             }
+            Uint64 decode_start_counter = SDL_GetPerformanceCounter();
 #ifdef USE_STB_VORBIS
             int vorbis_samples_read = 
                 stb_vorbis_get_samples_float_interleaved(ogg_track->vorbis, 
@@ -150,6 +172,8 @@ void UpdateAudio(AudioContext* audio_context, StackAllocator* stack_allocator) {
 #else
             SDL_assert(false); // Need to implement non-stb-vorbis equivalent
 #endif
+            ogg_track->decode_microseconds = (int)((SDL_GetPerformanceCounter() - decode_start_counter) * 1000000 / 
+                                                   SDL_GetPerformanceFrequency());
             ogg_track->read_pos += samples_read;
             if(ogg_track->read_pos > ogg_track->samples){
                 ogg_track->read_pos -= ogg_track->samples;
@@ -168,11 +192,19 @@ void UpdateAudio(AudioContext* audio_context, StackAllocator* stack_allocator) {
     swap(audio_context->curr_buffer, audio_context->back_buffer);
     audio_context->buffer_read_byte -= temp_buffer_read_byte;
     SDL_UnlockAudioDevice(audio_context->device_id);
+    audio_context->last_update_microseconds = (int)((SDL_GetPerformanceCounter() - start_counter) * 1000000 / 
+                                                    SDL_GetPerformanceFrequency());
 }
 
 void InitAudio(AudioContext* context, StackAllocator *stack_allocator) {
     context->num_ogg_tracks = 0;
     context->shutting_down = false;
+    context->last_update_microseconds = 0;
+    context->num_callbacks = 0;
+    context->num_underruns = 0;
+    context->underrun_frames = 0;
+    context->last_callback_counter = 0;
+    context->max_callback_jitter_milliseconds = 0.0f;
     SDL_AudioSpec target_audio_spec;
     SDL_zero(target_audio_spec);
     target_audio_spec.freq = 48000;
@@ -210,7 +242,54 @@ void InitAudio(AudioContext* context, StackAllocator *stack_allocator) {
     SDL_PauseAudioDevice(context->device_id, 0);  // start audio playing.
 }
 
+void GetAudioStats(AudioContext* audio_context, AudioStats* stats) {
+    const SDL_AudioSpec& spec = audio_context->audio_spec;
+    int sample_size = spec.size / spec.samples;
+    SDL_LockAudioDevice(audio_context->device_id);
+    int buffer_read_byte = audio_context->buffer_read_byte;
+    stats->num_callbacks = audio_context->num_callbacks;
+    stats->num_underruns = audio_context->num_underruns;
+    int underrun_frames = audio_context->underrun_frames;
+    stats->max_callback_jitter_milliseconds = audio_context->max_callback_jitter_milliseconds;
+    audio_context->max_callback_jitter_milliseconds = 0.0f;
+    SDL_UnlockAudioDevice(audio_context->device_id);
+    stats->underrun_milliseconds = underrun_frames * 1000.0f / spec.freq;
+    stats->buffer_fill = 1.0f - buffer_read_byte / (float)audio_context->buffer_size;
+    // Newly decoded audio goes at the end of the mix buffer, so it plays after
+    // the unplayed part of that and then the device's own buffer
+    int queued_frames = (audio_context->buffer_size - buffer_read_byte) / sample_size + spec.samples;
+    stats->latency_milliseconds = queued_frames * 1000.0f / spec.freq;
+    stats->update_microseconds = audio_context->last_update_microseconds;
+}
+
+// Fixed stats plus one decode time per track. The rest of the frame records
+// 11 more, and all of it has to fit in the profiler's per-frame share so
+// buffer fill is recorded for every frame of a trace.
+static const int kMaxAudioCounters = 6 + AudioContext::kMaxOggTracks;
+SDL_COMPILE_TIME_ASSERT(audio_counters_fit_frame, kMaxAudioCounters + 11 <= Profiler::kMaxCountersPerFrame);
+
+void RecordAudioCounters(AudioContext* audio_context, const AudioStats& stats, Profiler* profiler) {
+    // Counters are grouped by label, so each track needs its own string
+    static const char* kDecodeLabels[AudioContext::kMaxOggTracks] = {
+        "Audio decode track 0 (us)", "Audio decode track 1 (us)",
+        "Audio decode track 2 (us)", "Audio decode track 3 (us)",
+        "Audio decode track 4 (us)", "Audio decode track 5 (us)",
+        "Audio decode track 6 (us)", "Audio decode track 7 (us)",
+        "Audio decode track 8 (us)", "Audio decode track 9 (us)"
+    };
+    profiler->RecordCounter("Audio buffer fill", stats.buffer_fill);
+    profiler->RecordCounter("Audio underruns", stats.num_underruns);
+    profiler->RecordCounter("Audio underrun silence (ms)", stats.underrun_milliseconds);
+    profiler->RecordCounter("Audio callback jitter (ms)", stats.max_callback_jitter_milliseconds);
+    profiler->RecordCounter("Audio latency (ms)", stats.latency_milliseconds);
+    profiler->RecordCounter("Audio update (us)", stats.update_microseconds);
+    for(int i=0; i<audio_context->num_ogg_tracks; ++i){
+        profiler->RecordCounter(kDecodeLabels[i], audio_context->ogg_tracks[i]->decode_microseconds);
+    }
+}
+
 void AudioContext::AddOggTrack(OggTrack* ogg_track) {
+    ogg_track->decode_microseconds = 0;
     ogg_tracks[num_ogg_tracks] = ogg_track;
     ++num_ogg_tracks;
 }
@@ -22,6 +22,7 @@ struct tOGVMemoryReader {
 #endif
 
 class StackAllocator;
+class Profiler;
 
 struct OggTrack {
     void* mem;
@@ -38,6 +39,18 @@ struct OggTrack {
     float target_gain;
     float gain;
     float transition_speed; // gain change per sample
+    int decode_microseconds; // Time spent decoding in the last UpdateAudio call
+};
+
+// Snapshot of audio pipeline health, see GetAudioStats
+struct AudioStats {
+    int num_callbacks;
+    int num_underruns; // Callbacks that ran out of mixed audio and padded with silence
+    float underrun_milliseconds; // Total silence inserted by underruns
+    float max_callback_jitter_milliseconds; // Since the previous GetAudioStats call
+    float buffer_fill; // Fraction of the mix buffer not yet played
+    float latency_milliseconds; // Estimated time from decoding a sample to it leaving the device
+    int update_microseconds;
 };
 
 struct AudioContext {
@@ -49,6 +62,13 @@ struct AudioContext {
     int buffer_read_byte;
     int buffer_size;
     int buffer_samples;
+    int last_update_microseconds; // Time spent in the last UpdateAudio call
+    // Written by the audio callback, read with the device locked
+    int num_callbacks;
+    int num_underruns;
+    int underrun_frames;
+    Uint64 last_callback_counter;
+    float max_callback_jitter_milliseconds;
     static const int kMaxOggTracks = 10;
     int num_ogg_tracks;
     OggTrack* ogg_tracks[kMaxOggTracks];
@@ -58,5 +78,9 @@ struct AudioContext {
 
 void UpdateAudio(AudioContext* audio_context, StackAllocator* stack_allocator);
 void InitAudio(AudioContext* context, StackAllocator *stack_memory_block);
+// Also resets the callback jitter, so call once per frame
+void GetAudioStats(AudioContext* audio_context, AudioStats* stats);
+// Add the stats and per-track decode times as profiler counter tracks
+void RecordAudioCounters(AudioContext* audio_context, const AudioStats& stats, Profiler* profiler);
 
 #endif
\ No newline at end of file
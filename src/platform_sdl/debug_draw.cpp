@@ -67,6 +67,11 @@ void DebugDrawLines::Draw(GraphicsContext* graphics_context, Profiler* profiler,
     glDisableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glUseProgram(0);
+    RenderStats* stats = &graphics_context->render_stats;
+    ++stats->buffer_binds;
+    ++stats->program_binds;
+    ++stats->uniform_uploads;
+    ++stats->draw_calls;
     profiler->EndEvent();
 
     profiler->StartEvent("checking draw lifetime");
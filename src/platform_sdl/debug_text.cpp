@@ -7,50 +7,35 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "internal/common.h"
 
-void DrawText(TextAtlas *text_atlas, GraphicsContext* context, float x, float y, char *text) {
-    CHECK_GL_ERROR();
-    static const int kMaxDrawStringLength = 1024;
-    GLfloat vert_data[kMaxDrawStringLength*16]; // Four verts per character, 2V 2T per vert
-    GLuint index_data[kMaxDrawStringLength*6]; // Two tris per character
-    int num_draw_chars = 0;
-    int vert_index=0, index_index=0;
-    for(char* text_iter = text; *text_iter != '\0'; ++text_iter) {
-        if (*text_iter >= 32 && (*text_iter & 0x7f) && num_draw_chars < kMaxDrawStringLength) {
-            int vert_ref = num_draw_chars*4;
-            ++num_draw_chars;
-            stbtt_aligned_quad q;
-            stbtt_GetBakedQuad(text_atlas->cdata, 512, 512, *text_iter-32, &x, &y, &q, 1);
-            vert_data[vert_index++] = q.x0;
-            vert_data[vert_index++] = q.y0;
-            vert_data[vert_index++] = q.s0;
-            vert_data[vert_index++] = q.t0;
-
-            vert_data[vert_index++] = q.x1;
-            vert_data[vert_index++] = q.y0;
-            vert_data[vert_index++] = q.s1;
-            vert_data[vert_index++] = q.t0;
-
-            vert_data[vert_index++] = q.x1;
-            vert_data[vert_index++] = q.y1;
-            vert_data[vert_index++] = q.s1;
-            vert_data[vert_index++] = q.t1;
-
-            vert_data[vert_index++] = q.x0;
-            vert_data[vert_index++] = q.y1;
-            vert_data[vert_index++] = q.s0;
-            vert_data[vert_index++] = q.t1;
-
-            index_data[index_index++] = vert_ref + 0;
-            index_data[index_index++] = vert_ref + 1;
-            index_data[index_index++] = vert_ref + 2;
-
-            index_data[index_index++] = vert_ref + 0;
-            index_data[index_index++] = vert_ref + 2;
-            index_data[index_index++] = vert_ref + 3;
-        }
+// Glyph quads waiting to be drawn, text is only drawn from the main thread
+static GLfloat text_vert_data[TextAtlas::kMaxDrawChars*16]; // Four verts per character, 2V 2T per vert
+
+void CreateTextBuffers(TextAtlas* text_atlas) {
+    text_atlas->vert_vbo = CreateVBO(kArrayVBO, kStreamVBO, NULL, sizeof(text_vert_data));
+    // Every batch uses the same two tris per character, so upload them once
+    GLuint index_data[TextAtlas::kMaxDrawChars*6];
+    for(int i=0; i<TextAtlas::kMaxDrawChars; ++i){
+        GLuint vert_ref = i*4;
+        index_data[i*6+0] = vert_ref + 0;
+        index_data[i*6+1] = vert_ref + 1;
+        index_data[i*6+2] = vert_ref + 2;
+        index_data[i*6+3] = vert_ref + 0;
+        index_data[i*6+4] = vert_ref + 2;
+        index_data[i*6+5] = vert_ref + 3;
     }
-    CHECK_GL_ERROR();
+    text_atlas->index_vbo = CreateVBO(kElementVBO, kStaticVBO, index_data, sizeof(index_data));
+}
+
+static void DrawTextBatch(GraphicsContext* context, int num_draw_chars) {
+    glBufferData(GL_ARRAY_BUFFER, num_draw_chars*sizeof(GLfloat)*16, text_vert_data, GL_STREAM_DRAW);
+    glDrawElements(GL_TRIANGLES, num_draw_chars*6, GL_UNSIGNED_INT, 0);
+    RenderStats* stats = &context->render_stats;
+    ++stats->draw_calls;
+    stats->triangles += num_draw_chars*2;
+}
 
+void DrawText(TextAtlas *text_atlas, GraphicsContext* context, float x, float y, char *text) {
+    CHECK_GL_ERROR();
     Shader* shader = &context->shaders[text_atlas->shader];
 
     glm::mat4 proj_mat = glm::ortho(0.0f, (float)context->screen_dims[0], 
@@ -68,20 +53,64 @@ void DrawText(TextAtlas *text_atlas, GraphicsContext* context, float x, float y,
     CHECK_GL_ERROR();
 
     glBindBuffer(GL_ARRAY_BUFFER, text_atlas->vert_vbo);
-    glBufferData(GL_ARRAY_BUFFER, num_draw_chars*sizeof(GLfloat)*16, vert_data, GL_STREAM_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, text_atlas->index_vbo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, num_draw_chars*sizeof(GLuint)*6, index_data, GL_STREAM_DRAW);
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2*sizeof(GLfloat)));
-    glDrawElements(GL_TRIANGLES, num_draw_chars*6, GL_UNSIGNED_INT, 0);
+
+    // Long strings are drawn kMaxDrawChars glyphs at a time
+    int num_draw_chars = 0;
+    int vert_index = 0;
+    float line_start_x = x;
+    for(char* text_iter = text; *text_iter != '\0'; ++text_iter) {
+        if (*text_iter == '\n') {
+            x = line_start_x;
+            y += text_atlas->pixel_height * 1.15f;
+        } else if (*text_iter >= 32 && (*text_iter & 0x7f)) {
+            if(num_draw_chars == TextAtlas::kMaxDrawChars){
+                DrawTextBatch(context, num_draw_chars);
+                num_draw_chars = 0;
+                vert_index = 0;
+            }
+            ++num_draw_chars;
+            stbtt_aligned_quad q;
+            stbtt_GetBakedQuad(text_atlas->cdata, 512, 512, *text_iter-32, &x, &y, &q, 1);
+            text_vert_data[vert_index++] = q.x0;
+            text_vert_data[vert_index++] = q.y0;
+            text_vert_data[vert_index++] = q.s0;
+            text_vert_data[vert_index++] = q.t0;
+
+            text_vert_data[vert_index++] = q.x1;
+            text_vert_data[vert_index++] = q.y0;
+            text_vert_data[vert_index++] = q.s1;
+            text_vert_data[vert_index++] = q.t0;
+
+            text_vert_data[vert_index++] = q.x1;
+            text_vert_data[vert_index++] = q.y1;
+            text_vert_data[vert_index++] = q.s1;
+            text_vert_data[vert_index++] = q.t1;
+
+            text_vert_data[vert_index++] = q.x0;
+            text_vert_data[vert_index++] = q.y1;
+            text_vert_data[vert_index++] = q.s0;
+            text_vert_data[vert_index++] = q.t1;
+        }
+    }
+    if(num_draw_chars > 0){
+        DrawTextBatch(context, num_draw_chars);
+    }
     glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glUseProgram(0);
     CHECK_GL_ERROR();
+    RenderStats* stats = &context->render_stats;
+    ++stats->program_binds;
+    stats->uniform_uploads += 2;
+    ++stats->texture_binds;
+    stats->buffer_binds += 2;
 }
 
 void DebugText::Draw(GraphicsContext* context, float time) {
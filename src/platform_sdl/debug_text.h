@@ -8,6 +8,8 @@
 struct GraphicsContext;
 
 struct TextAtlas {
+    // Glyphs per draw call, longer strings take more than one
+    static const int kMaxDrawChars = 1024;
     stbtt_bakedchar cdata[96]; // ASCII 32..126 is 95 glyphs
     int texture;
     int shader;
@@ -39,6 +41,8 @@ public:
     void Draw(GraphicsContext* context, float time);
 };
 
+// Creates vert_vbo and index_vbo, which every DrawText call reuses
+void CreateTextBuffers(TextAtlas* text_atlas);
 void DrawText(TextAtlas *text_atlas, GraphicsContext* context, float x, float y, char *text);
 
 #endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "platform_sdl/file_io.h"
 #include "platform_sdl/error.h"
+#include "platform_sdl/logger.h"
+#include "platform_sdl/profiler.h"
 #include "internal/common.h"
 #include <SDL.h>
 #include <sys/stat.h>
@@ -101,6 +103,7 @@ bool FileLoadThreadData::LoadFile(const char* path, void* memory, int* memory_le
 }
 
 int FileLoadThreadData::Run() {
+    PROFILE_THREAD_NAME("FileLoaderThread");
     bool is_running = true;
     while(is_running){
         SDL_Delay(1);
@@ -108,12 +111,13 @@ int FileLoadThreadData::Run() {
             err = false;
             FileRequest* request = queue.PopFrontRequest();
             if(request){
-                SDL_Log("File loader thread processing request \"%s\"", request->path);
+                PROFILE_SCOPE("Load file");
+                LogMessage(kLogInfo, "File loader thread processing request \"%s\"", request->path);
                 err = !LoadFile(request->path, memory, &memory_len,
                                 err_title, err_msg);
                 SDL_CondSignal(request->condition);
                 if(!err){
-                    SDL_Log("File \"%s\" loaded into RAM", request->path);
+                    LogMessage(kLogInfo, "File \"%s\" loaded into RAM", request->path);
                 }
             }
             is_running = !err && !wants_to_quit;
@@ -158,6 +162,10 @@ FileRequest* FileRequestQueue::PopFrontRequest() {
     return request;
 }
 
+int FileRequestQueue::NumPending() {
+    return (end - start + kMaxFileRequests) % kMaxFileRequests;
+}
+
 bool ChangeWorkingDirectory(const char* path)
 {
 #ifdef WIN32
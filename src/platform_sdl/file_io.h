@@ -16,6 +16,7 @@ struct FileRequestQueue {
     int start, end;
     FileRequest* AddNewRequest();
     FileRequest* PopFrontRequest();
+    int NumPending();
     FileRequestQueue();
 };
 
@@ -0,0 +1,142 @@
+#include "platform_sdl/gpu_profiler.h"
+#include "platform_sdl/graphics.h"
+#include "platform_sdl/logger.h"
+#include "internal/common.h"
+#include <GL/glew.h>
+
+void GpuProfiler::Init() {
+    available = false;
+    frame_index = 0;
+    zone_stack_depth = 0;
+    num_skipped_zones = 0;
+    num_last_frame_zones = 0;
+    num_dropped_frames = 0;
+    frames_since_calibration = 0;
+    for(int i=0; i<kFramesInFlight; ++i){
+        frames[i].pending = false;
+        frames[i].num_zones = 0;
+    }
+#ifndef USE_OPENGLES
+    // Check the entry points too, GLEW's extension flags are unreliable in core profiles
+    if((GLEW_VERSION_3_3 || GLEW_ARB_timer_query) && 
+       glQueryCounter && glGetQueryObjectui64v && glGetInteger64v)
+    {
+        for(int i=0; i<kFramesInFlight; ++i){
+            glGenQueries(kMaxZonesPerFrame*2, (GLuint*)frames[i].queries);
+        }
+        Calibrate();
+        available = true;
+    } else {
+        LogMessage(kLogWarning, "GL timer queries not supported, GPU zones disabled");
+    }
+#endif
+}
+
+void GpuProfiler::Calibrate() {
+#ifndef USE_OPENGLES
+    GLint64 gpu_time;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+    calibration_perf_counter = SDL_GetPerformanceCounter();
+    calibration_gpu_time = gpu_time;
+    frames_since_calibration = 0;
+#endif
+}
+
+void GpuProfiler::StartFrame(Profiler* profiler) {
+    if(!available){
+        return;
+    }
+    // Unmatched zones from last frame would never be closed
+    while(zone_stack_depth > 0){
+        EndZone();
+    }
+    num_skipped_zones = 0;
+    frame_index = (frame_index+1)%kFramesInFlight;
+    Frame& frame = frames[frame_index];
+    if(frame.pending){
+        ReadBack(&frame, profiler);
+    }
+    frame.pending = false;
+    frame.num_zones = 0;
+    // The two clocks drift apart slowly
+    static const int kCalibrationIntervalFrames = 300;
+    if(++frames_since_calibration >= kCalibrationIntervalFrames){
+        Calibrate();
+    }
+}
+
+void GpuProfiler::ReadBack(Frame* frame, Profiler* profiler) {
+#ifndef USE_OPENGLES
+    GLuint ready = 0;
+    glGetQueryObjectuiv(frame->queries[frame->last_query], GL_QUERY_RESULT_AVAILABLE, &ready);
+    if(!ready){
+        // Waiting here would stall the CPU, lose this frame instead
+        ++num_dropped_frames;
+        return;
+    }
+    const double kPerfCounterPerNanosecond = SDL_GetPerformanceFrequency() / 1000000000.0;
+    num_last_frame_zones = 0;
+    for(int i=0; i<frame->num_zones; ++i){
+        GLuint64 start, end;
+        glGetQueryObjectui64v(frame->queries[i*2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(frame->queries[i*2+1], GL_QUERY_RESULT, &end);
+        if(end < start){
+            end = start;
+        }
+        ProfilerZone& zone = last_frame_zones[num_last_frame_zones++];
+        zone.label = frame->zones[i].label;
+        zone.depth = frame->zones[i].depth;
+        zone.milliseconds = (float)((end - start) / 1000000.0);
+        double start_offset = ((Sint64)start - calibration_gpu_time) * kPerfCounterPerNanosecond;
+        double end_offset = ((Sint64)end - calibration_gpu_time) * kPerfCounterPerNanosecond;
+        profiler->RecordGpuEvent(zone.label, zone.depth, 
+            (Uint64)((Sint64)calibration_perf_counter + (Sint64)start_offset),
+            (Uint64)((Sint64)calibration_perf_counter + (Sint64)end_offset));
+    }
+#endif
+}
+
+void GpuProfiler::StartZone(const char* label) {
+    if(!available){
+        return;
+    }
+    Frame& frame = frames[frame_index];
+    if(frame.num_zones >= kMaxZonesPerFrame || zone_stack_depth >= kMaxZoneDepth){
+        // Remember to ignore the matching EndZone
+        ++num_skipped_zones;
+        return;
+    }
+#ifndef USE_OPENGLES
+    int index = frame.num_zones++;
+    frame.zones[index].label = label;
+    frame.zones[index].depth = zone_stack_depth;
+    zone_stack[zone_stack_depth++] = index;
+    glQueryCounter(frame.queries[index*2], GL_TIMESTAMP);
+    frame.last_query = index*2;
+    frame.pending = true;
+#endif
+}
+
+void GpuProfiler::EndZone() {
+    if(!available){
+        return;
+    }
+    if(num_skipped_zones > 0){
+        --num_skipped_zones;
+    } else if(zone_stack_depth > 0){
+#ifndef USE_OPENGLES
+        Frame& frame = frames[frame_index];
+        int index = zone_stack[--zone_stack_depth];
+        glQueryCounter(frame.queries[index*2+1], GL_TIMESTAMP);
+        frame.last_query = index*2+1;
+#endif
+    }
+}
+
+int GpuProfiler::GetLastFrameZones(ProfilerZone* zones, int max_zones) {
+    int num_zones = min(num_last_frame_zones, max_zones);
+    for(int i=0; i<num_zones; ++i){
+        zones[i] = last_frame_zones[i];
+    }
+    return num_zones;
+}
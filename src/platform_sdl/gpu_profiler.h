@@ -0,0 +1,54 @@
+#pragma once
+#ifndef PLATFORM_SDL_GPU_PROFILER_H
+#define PLATFORM_SDL_GPU_PROFILER_H
+
+#include "platform_sdl/profiler.h"
+#include <SDL.h>
+
+// Measures GPU time of nested zones with GL_TIMESTAMP queries. Each frame's
+// queries are read back kFramesInFlight frames later, by which point the GPU
+// has finished them, so profiling never waits on the GPU. Needs timer
+// queries (GL 3.3 or ARB_timer_query); without them every call is a no-op.
+class GpuProfiler {
+public:
+    bool available;
+    void Init(); // Call with the GL context current
+    // Reads back the oldest frame in flight and sends its zones to profiler
+    void StartFrame(Profiler* profiler);
+    void StartZone(const char* label);
+    void EndZone();
+    // Zones of the most recent frame whose results have been read back
+    int GetLastFrameZones(ProfilerZone* zones, int max_zones);
+    int num_dropped_frames; // Read back before the GPU finished them
+private:
+    static const int kFramesInFlight = 4;
+    static const int kMaxZonesPerFrame = 32;
+    static const int kMaxZoneDepth = 8;
+    struct Zone {
+        const char* label;
+        int depth;
+    };
+    struct Frame {
+        bool pending;
+        int num_zones;
+        Zone zones[kMaxZonesPerFrame];
+        Uint32 queries[kMaxZonesPerFrame*2]; // Start and end timestamp of each zone
+        int last_query; // Issued last, so the rest are done once it is
+    };
+    void ReadBack(Frame* frame, Profiler* profiler);
+    void Calibrate();
+
+    Frame frames[kFramesInFlight];
+    int frame_index;
+    int zone_stack[kMaxZoneDepth];
+    int zone_stack_depth;
+    int num_skipped_zones;
+    ProfilerZone last_frame_zones[kMaxZonesPerFrame];
+    int num_last_frame_zones;
+    // Matching GPU and CPU clock readings, to place GPU zones on the CPU timeline
+    Sint64 calibration_gpu_time;
+    Uint64 calibration_perf_counter;
+    int frames_since_calibration;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "platform_sdl/graphics.h"
 #include "platform_sdl/error.h"
 #include "platform_sdl/file_io.h"
+#include "platform_sdl/logger.h"
 #include "platform_sdl/profiler.h"
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -106,8 +107,6 @@ int CreateShader(int type, const char *src) {
  }
 
  void InitGraphicsContext(GraphicsContext *graphics_context) {
-    Profiler profiler;
-    profiler.Init();
     graphics_context->screen_dims[0] = 1280;
     graphics_context->screen_dims[1] = 720;
 #ifdef USE_OPENGLES
@@ -159,7 +158,7 @@ int CreateShader(int type, const char *src) {
     int multisample_buffers, multisample_samples;
     SDL_GL_GetAttribute(SDL_GL_MULTISAMPLEBUFFERS, &multisample_buffers);
     SDL_GL_GetAttribute(SDL_GL_MULTISAMPLESAMPLES, &multisample_samples);
-    SDL_Log("Multisample buffers: %d Multisample samples: %d\n", multisample_buffers, multisample_samples);
+    LogMessage(kLogInfo, "Multisample buffers: %d Multisample samples: %d", multisample_buffers, multisample_samples);
 
     glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
 
@@ -175,6 +174,30 @@ int CreateShader(int type, const char *src) {
     glBindVertexArray(vao);
 
     graphics_context->num_shaders = 0;
+    graphics_context->gpu_profiler.Init();
+    graphics_context->render_stats.Clear();
+}
+
+void RenderStats::Clear() {
+    draw_calls = 0;
+    program_binds = 0;
+    texture_binds = 0;
+    buffer_binds = 0;
+    uniform_uploads = 0;
+    triangles = 0;
+    drawables_drawn = 0;
+    drawables_culled = 0;
+}
+
+void RecordRenderCounters(const RenderStats& stats, Profiler* profiler) {
+    profiler->RecordCounter("Draw calls", stats.draw_calls);
+    profiler->RecordCounter("Program binds", stats.program_binds);
+    profiler->RecordCounter("Texture binds", stats.texture_binds);
+    profiler->RecordCounter("Buffer binds", stats.buffer_binds);
+    profiler->RecordCounter("Uniform uploads", stats.uniform_uploads);
+    profiler->RecordCounter("Triangles", stats.triangles);
+    profiler->RecordCounter("Drawables drawn", stats.drawables_drawn);
+    profiler->RecordCounter("Drawables culled", stats.drawables_culled);
 }
 
 void InitGraphicsData(int *triangle_vbo, int *index_vbo) {
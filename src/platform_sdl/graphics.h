@@ -4,12 +4,14 @@
 
 #include <SDL.h>
 #include "glm/glm.hpp"
+#include "platform_sdl/gpu_profiler.h"
 
 #ifdef EMSCRIPTEN
 #define USE_OPENGLES
 #endif
 
 class FileLoadThreadData;
+class Profiler;
 
 //TODO: these should all be in a config or something
 static const int kMSAA = 4;
@@ -55,6 +57,20 @@ struct Shader {
     int uniforms[kNumUniformNames];
 };
 
+// GL work submitted during a frame. Binds count only non-zero objects, so
+// unbinding after a draw doesn't inflate the numbers.
+struct RenderStats {
+    int draw_calls;
+    int program_binds;
+    int texture_binds;
+    int buffer_binds;
+    int uniform_uploads;
+    int triangles;
+    int drawables_drawn;
+    int drawables_culled;
+    void Clear();
+};
+
 struct GraphicsContext {
     static const int kMaxShaders = 10;
     int num_shaders;
@@ -62,9 +78,13 @@ struct GraphicsContext {
     int screen_dims[2];
     SDL_Window* window;
     SDL_GLContext gl_context;
+    GpuProfiler gpu_profiler;
+    RenderStats render_stats;
 };
 
 void InitGraphicsContext(GraphicsContext *graphics_context);
+// Add the stats as profiler counter tracks
+void RecordRenderCounters(const RenderStats& stats, Profiler* profiler);
 void InitGraphicsData(int *triangle_vbo, int *index_vbo);
 int LoadImage(const char* path, FileLoadThreadData* file_load_data);
 int CreateShader(int type, const char *src);
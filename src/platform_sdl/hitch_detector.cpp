@@ -0,0 +1,129 @@
+#include "platform_sdl/hitch_detector.h"
+#include "platform_sdl/error.h"
+#include "platform_sdl/logger.h"
+#include "internal/common.h"
+#include <SDL.h>
+#include <cstring>
+#include <ctime>
+
+void HitchDetector::Init(float p_threshold_factor) {
+    threshold_factor = p_threshold_factor;
+    history_index = 0;
+    num_frames = 0;
+    last_capture_frame = -kMinCaptureIntervalFrames;
+    baseline_milliseconds = 0.0f;
+    SDL_AtomicSet(&capture_pending, 0);
+}
+
+bool HitchDetector::AddFrame(float milliseconds, Profiler* profiler) {
+    FrameRecord& record = history[history_index];
+    record.frame = num_frames;
+    record.milliseconds = milliseconds;
+    record.num_zones = profiler->GetLastFrameZones(record.zones, kMaxZones);
+    history_index = (history_index+1)%kHistoryFrames;
+    ++num_frames;
+
+    bool hitch = num_frames > kWarmupFrames &&
+                 milliseconds > baseline_milliseconds * threshold_factor &&
+                 num_frames - last_capture_frame >= kMinCaptureIntervalFrames;
+    if(hitch){
+        last_capture_frame = num_frames;
+    } else {
+        // Exponential moving average, hitches are left out so they don't raise the baseline
+        static const float kBaselineWeight = 0.05f;
+        if(num_frames == 1){
+            baseline_milliseconds = milliseconds;
+        } else {
+            baseline_milliseconds += (milliseconds - baseline_milliseconds) * kBaselineWeight;
+        }
+    }
+    return hitch;
+}
+
+static void WriteString(SDL_RWops* file, const char* str) {
+    SDL_RWwrite(file, str, 1, strlen(str));
+}
+
+static void WriteFrameRecordZones(SDL_RWops* file, int num_zones, const ProfilerZone* zones) {
+    static const int kBufSize = 512;
+    char buf[kBufSize];
+    for(int i=0; i<num_zones; ++i){
+        int index = 0;
+        for(int j=0; j<zones[i].depth && index < kBufSize/2; ++j){
+            for(int k=0; k<4; ++k){
+                buf[index++] = '-';
+            }
+        }
+        FormatString(&buf[index], kBufSize-index, "%s: %.3f ms\n", zones[i].label, zones[i].milliseconds);
+        WriteString(file, buf);
+    }
+}
+
+void HitchDetector::WriteCapture(const char* dir, const HitchContext& context) {
+    const FrameRecord& hitch_record = history[(history_index+kHistoryFrames-1)%kHistoryFrames];
+    if(SDL_AtomicGet(&capture_pending)){
+        LogMessage(kLogWarning, "Frame %d took %.1f ms, skipped hitch capture while the last one is written",
+                hitch_record.frame, hitch_record.milliseconds);
+        return;
+    }
+    char time_str[64];
+    time_t now = time(NULL);
+    strftime(time_str, sizeof(time_str), "%Y%m%d_%H%M%S", localtime(&now));
+    FormatString(capture.path, kMaxPathSize, "%shitch_%s_frame%d.txt", dir, time_str, hitch_record.frame);
+    capture.context = context;
+    capture.baseline_milliseconds = baseline_milliseconds;
+    capture.threshold_factor = threshold_factor;
+    capture.num_records = min(num_frames, kHistoryFrames);
+    for(int i=0; i<capture.num_records; ++i){
+        capture.records[i] = history[(history_index+kHistoryFrames-1-i)%kHistoryFrames];
+    }
+    SDL_AtomicSet(&capture_pending, 1);
+    if(!QueueLogWriterTask(WriteCaptureFile, this)){
+        SDL_AtomicSet(&capture_pending, 0);
+        LogMessage(kLogWarning, "Frame %d took %.1f ms, log writer too busy for a hitch capture",
+                hitch_record.frame, hitch_record.milliseconds);
+    }
+}
+
+void HitchDetector::WriteCaptureFile(void* p_hitch_detector) {
+    HitchDetector* hitch_detector = (HitchDetector*)p_hitch_detector;
+    const Capture& capture = hitch_detector->capture;
+    const FrameRecord& hitch_record = capture.records[0];
+    SDL_RWops* file = SDL_RWFromFile(capture.path, "w");
+    if(!file){
+        // Not worth interrupting the game over
+        LogMessage(kLogWarning, "Could not open %s for writing hitch capture", capture.path);
+        SDL_AtomicSet(&hitch_detector->capture_pending, 0);
+        return;
+    }
+    const HitchContext& context = capture.context;
+    static const int kBufSize = 1024;
+    char buf[kBufSize];
+    FormatString(buf, kBufSize,
+        "Hitch at frame %d\n"
+        "Game time: %.3f s\n"
+        "Characters: %d alive, %d with active minds\n"
+        "Frame time: %.3f ms (baseline %.3f ms, threshold %.2fx)\n"
+        "Pending file loader requests: %d\n"
+        "Audio update: %d us\n"
+        "Allocator: %d blocks, %d allocations this frame, %d / %d bytes used\n\n",
+        hitch_record.frame, context.game_time, context.characters_alive, context.active_minds,
+        hitch_record.milliseconds, capture.baseline_milliseconds, capture.threshold_factor,
+        context.pending_file_requests, context.audio_update_microseconds,
+        context.allocator_blocks, context.allocations_this_frame,
+        context.memory_used, context.memory_size);
+    WriteString(file, buf);
+    WriteString(file, "Hitch frame zones:\n");
+    WriteFrameRecordZones(file, hitch_record.num_zones, hitch_record.zones);
+    WriteString(file, "\nPrevious frames, most recent first:\n");
+    for(int i=1; i<capture.num_records; ++i){
+        const FrameRecord& record = capture.records[i];
+        FormatString(buf, kBufSize, "\nFrame %d: %.3f ms\n", record.frame, record.milliseconds);
+        WriteString(file, buf);
+        WriteFrameRecordZones(file, record.num_zones, record.zones);
+    }
+    SDL_RWclose(file);
+    LogMessage(kLogWarning, "Frame %d took %.1f ms, wrote hitch capture to %s",
+            hitch_record.frame, hitch_record.milliseconds, capture.path);
+    SDL_AtomicSet(&hitch_detector->capture_pending, 0);
+}
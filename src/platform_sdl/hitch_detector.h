@@ -0,0 +1,66 @@
+#pragma once
+#ifndef PLATFORM_SDL_HITCH_DETECTOR_H
+#define PLATFORM_SDL_HITCH_DETECTOR_H
+
+#include "platform_sdl/profiler.h"
+
+// State of the rest of the game at the time of a hitch
+struct HitchContext {
+    double game_time;
+    int characters_alive;
+    int active_minds;
+    int pending_file_requests;
+    int audio_update_microseconds;
+    int memory_used;
+    int memory_size;
+    int allocator_blocks;
+    int allocations_this_frame;
+};
+
+// Tracks a moving average of frame times and flags frames that take more than
+// threshold_factor times as long, keeping the profiler zones of recent frames
+// so a capture can show what led up to the hitch. Captures are written on the
+// log writer thread, so the detector has to outlive the global logger.
+class HitchDetector {
+public:
+    float threshold_factor;
+    void Init(float threshold_factor);
+    // Call once per frame after the frame's outermost profiler event has ended.
+    // Returns true if that frame was a hitch.
+    bool AddFrame(float milliseconds, Profiler* profiler);
+    // Copy the most recent frame and its history, and have the log writer
+    // thread write them to a timestamped file in dir. Skipped if the last
+    // capture is still being written.
+    void WriteCapture(const char* dir, const HitchContext& context);
+private:
+    static const int kWarmupFrames = 60; // Don't flag loading frames before the baseline settles
+    static const int kMinCaptureIntervalFrames = 60;
+    static const int kHistoryFrames = 8;
+    static const int kMaxZones = 64;
+    struct FrameRecord {
+        int frame;
+        float milliseconds;
+        int num_zones;
+        ProfilerZone zones[kMaxZones];
+    };
+    static const int kMaxPathSize = 4096;
+    // Everything the writer thread needs, so the game can carry on meanwhile
+    struct Capture {
+        char path[kMaxPathSize];
+        HitchContext context;
+        float baseline_milliseconds;
+        float threshold_factor;
+        int num_records;
+        FrameRecord records[kHistoryFrames]; // Hitch frame first
+    };
+    static void WriteCaptureFile(void* hitch_detector);
+    FrameRecord history[kHistoryFrames];
+    Capture capture;
+    SDL_atomic_t capture_pending; // Set until the writer thread is done with capture
+    int history_index; // Slot that will hold the next frame
+    int num_frames;
+    int last_capture_frame;
+    float baseline_milliseconds;
+};
+
+#endif
@@ -0,0 +1,368 @@
+#include "platform_sdl/logger.h"
+#include "internal/common.h"
+#include <cstdarg>
+#include <cstring>
+
+static Logger* global_logger = NULL;
+
+void SetGlobalLogger(Logger* logger) {
+    global_logger = logger;
+}
+
+void LogMessage(LogLevel level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    if(global_logger){
+        global_logger->Log(level, fmt, args);
+    } else {
+        SDL_LogMessageV(SDL_LOG_CATEGORY_APPLICATION, 
+            level == kLogError ? SDL_LOG_PRIORITY_ERROR : 
+            level == kLogWarning ? SDL_LOG_PRIORITY_WARN : SDL_LOG_PRIORITY_INFO,
+            fmt, args);
+    }
+    va_end(args);
+}
+
+bool QueueLogWriterTask(Logger::TaskFunc func, void* data) {
+    if(global_logger){
+        return global_logger->QueueTask(func, data);
+    }
+    func(data);
+    return true;
+}
+
+// What a printf conversion reads from the argument list
+enum LogArgType {
+    kLogArgNone, // %%
+    kLogArgInt,
+    kLogArgLong,
+    kLogArgLongLong,
+    kLogArgSize,
+    kLogArgDouble,
+    kLogArgPointer,
+    kLogArgString,
+    kLogArgUnsupported
+};
+
+static const int kMaxConversionLen = 16;
+
+// fmt points at a '%', end is set to just past its conversion
+static LogArgType ParseConversion(const char* fmt, const char** end) {
+    const char* c = fmt + 1;
+    while(*c == '-' || *c == '+' || *c == ' ' || *c == '#' || *c == '0'){
+        ++c;
+    }
+    while(*c >= '0' && *c <= '9'){
+        ++c;
+    }
+    if(*c == '.'){
+        ++c;
+        while(*c >= '0' && *c <= '9'){
+            ++c;
+        }
+    }
+    while(*c == 'h'){
+        ++c;
+    }
+    int num_longs = 0;
+    while(*c == 'l'){
+        ++num_longs;
+        ++c;
+    }
+    bool size = false;
+    if(*c == 'z'){
+        size = true;
+        ++c;
+    }
+    if(*c == '\0'){
+        *end = c;
+        return kLogArgUnsupported;
+    }
+    *end = c + 1;
+    if(*end - fmt >= kMaxConversionLen){
+        return kLogArgUnsupported;
+    }
+    switch(*c){
+        case '%':
+            return kLogArgNone;
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            if(size){
+                return kLogArgSize;
+            }
+            return num_longs == 0 ? kLogArgInt : num_longs == 1 ? kLogArgLong : kLogArgLongLong;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+            return kLogArgDouble;
+        case 'p':
+            return kLogArgPointer;
+        case 's':
+            return num_longs == 0 ? kLogArgString : kLogArgUnsupported;
+        default:
+            // %n, '*' widths and anything else unusual get formatted right away
+            return kLogArgUnsupported;
+    }
+}
+
+template<typename T>
+static bool PackArg(char* buf, int buf_size, int* len, T value) {
+    if(*len + (int)sizeof(T) > buf_size){
+        return false;
+    }
+    memcpy(&buf[*len], &value, sizeof(T));
+    *len += sizeof(T);
+    return true;
+}
+
+// Copy the arguments fmt reads into buf, strings included. Returns false if
+// fmt has a conversion this doesn't handle or the arguments don't fit.
+static bool PackArgs(char* buf, int buf_size, const char* fmt, va_list args) {
+    int len = 0;
+    for(const char* c = fmt; *c != '\0'; ){
+        if(*c != '%'){
+            ++c;
+            continue;
+        }
+        bool fits = true;
+        switch(ParseConversion(c, &c)){
+            case kLogArgNone: break;
+            case kLogArgInt: fits = PackArg(buf, buf_size, &len, va_arg(args, int)); break;
+            case kLogArgLong: fits = PackArg(buf, buf_size, &len, va_arg(args, long)); break;
+            case kLogArgLongLong: fits = PackArg(buf, buf_size, &len, va_arg(args, long long)); break;
+            case kLogArgSize: fits = PackArg(buf, buf_size, &len, va_arg(args, size_t)); break;
+            case kLogArgDouble: fits = PackArg(buf, buf_size, &len, va_arg(args, double)); break;
+            case kLogArgPointer: fits = PackArg(buf, buf_size, &len, va_arg(args, void*)); break;
+            case kLogArgString: {
+                const char* str = va_arg(args, const char*);
+                if(!str){
+                    str = "(null)";
+                }
+                int str_size = strlen(str) + 1;
+                fits = len + str_size <= buf_size;
+                if(fits){
+                    memcpy(&buf[len], str, str_size);
+                    len += str_size;
+                }
+                break;
+            }
+            case kLogArgUnsupported: return false;
+        }
+        if(!fits){
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+static void FormatPackedArg(char* buf, int buf_size, const char* conversion, const char** packed) {
+    T value;
+    memcpy(&value, *packed, sizeof(T));
+    *packed += sizeof(T);
+    FormatString(buf, buf_size, conversion, value);
+}
+
+// The other half of PackArgs
+static void FormatPackedArgs(char* buf, int buf_size, const char* fmt, const char* packed) {
+    int len = 0;
+    for(const char* c = fmt; *c != '\0' && len < buf_size-1; ){
+        if(*c != '%'){
+            buf[len++] = *(c++);
+            continue;
+        }
+        const char* end;
+        LogArgType type = ParseConversion(c, &end);
+        char conversion[kMaxConversionLen];
+        int conversion_len = min((int)(end - c), kMaxConversionLen-1);
+        memcpy(conversion, c, conversion_len);
+        conversion[conversion_len] = '\0';
+        c = end;
+        char* out = &buf[len];
+        int out_size = buf_size - len;
+        switch(type){
+            case kLogArgNone: FormatString(out, out_size, "%%"); break;
+            case kLogArgInt: FormatPackedArg<int>(out, out_size, conversion, &packed); break;
+            case kLogArgLong: FormatPackedArg<long>(out, out_size, conversion, &packed); break;
+            case kLogArgLongLong: FormatPackedArg<long long>(out, out_size, conversion, &packed); break;
+            case kLogArgSize: FormatPackedArg<size_t>(out, out_size, conversion, &packed); break;
+            case kLogArgDouble: FormatPackedArg<double>(out, out_size, conversion, &packed); break;
+            case kLogArgPointer: FormatPackedArg<void*>(out, out_size, conversion, &packed); break;
+            case kLogArgString:
+                FormatString(out, out_size, conversion, packed);
+                packed += strlen(packed) + 1;
+                break;
+            case kLogArgUnsupported: break; // PackArgs wouldn't have packed it
+        }
+        len += strlen(out);
+    }
+    buf[len] = '\0';
+}
+
+static const char* LogLevelName(int level) {
+    switch(level){
+        case kLogWarning: return "WARNING";
+        case kLogError: return "ERROR";
+        default: return "INFO";
+    }
+}
+
+bool Logger::Init(const char* path) {
+    for(int i=0; i<kNumRecords; ++i){
+        SDL_AtomicSet(&records[i].sequence, 0);
+    }
+    SDL_AtomicSet(&write_index, 0);
+    SDL_AtomicSet(&read_index, 0);
+    SDL_AtomicSet(&num_dropped, 0);
+    SDL_AtomicSet(&wants_to_quit, 0);
+    SDL_AtomicSet(&task_queued, 0);
+    task_func = NULL;
+    task_data = NULL;
+    init_time = SDL_GetPerformanceCounter();
+    thread = NULL;
+    file = SDL_RWFromFile(path, "w");
+    if(!file){
+        SDL_Log("Could not open log file %s: %s", path, SDL_GetError());
+    }
+#ifdef HAVE_THREADS
+    thread = SDL_CreateThread(RunThread, "LogWriterThread", this);
+    if(!thread){
+        SDL_Log("Could not create log writer thread: %s", SDL_GetError());
+        if(file){
+            SDL_RWclose(file);
+            file = NULL;
+        }
+        return false;
+    }
+#endif
+    return true;
+}
+
+void Logger::Dispose() {
+    SDL_AtomicSet(&wants_to_quit, 1);
+    if(thread){
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+    }
+    RunTask();
+    WriteRecords();
+    if(file){
+        SDL_RWclose(file);
+        file = NULL;
+    }
+}
+
+void Logger::Log(LogLevel level, const char* fmt, va_list args) {
+    // Claim a record, unless the writer has fallen a full ring behind
+    int index;
+    do {
+        index = SDL_AtomicGet(&write_index);
+        if(index - SDL_AtomicGet(&read_index) >= kNumRecords){
+            SDL_AtomicIncRef(&num_dropped);
+            return;
+        }
+    } while(!SDL_AtomicCAS(&write_index, index, index+1));
+    Record& record = records[index & (kNumRecords-1)];
+    record.level = level;
+    record.time = SDL_GetPerformanceCounter();
+    record.thread_id = SDL_ThreadID();
+    // Formatting, floats especially, is left to the writer thread when it can be
+    va_list packed_args;
+    va_copy(packed_args, args);
+    if(PackArgs(record.message, kMaxMessageLen, fmt, packed_args)){
+        record.fmt = fmt;
+    } else {
+        record.fmt = NULL;
+        VFormatString(record.message, kMaxMessageLen, fmt, args);
+    }
+    va_end(packed_args);
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&record.sequence, index+1);
+#ifndef HAVE_THREADS
+    // Nothing to hand off to
+    WriteRecords();
+#endif
+}
+
+bool Logger::QueueTask(TaskFunc func, void* data) {
+    if(SDL_AtomicGet(&task_queued)){
+        return false;
+    }
+    task_func = func;
+    task_data = data;
+#ifdef HAVE_THREADS
+    if(thread){
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&task_queued, 1);
+        return true;
+    }
+#endif
+    // Nothing to hand off to
+    func(data);
+    return true;
+}
+
+// Returns false if there was no task waiting
+bool Logger::RunTask() {
+    if(!SDL_AtomicGet(&task_queued)){
+        return false;
+    }
+    SDL_MemoryBarrierAcquire();
+    task_func(task_data);
+    SDL_AtomicSet(&task_queued, 0);
+    return true;
+}
+
+// Write out completed records in order, returns false if there were none
+bool Logger::WriteRecords() {
+    bool wrote = false;
+    int dropped = SDL_AtomicSet(&num_dropped, 0);
+    if(dropped > 0 && file){
+        static const int kBufSize = 128;
+        char buf[kBufSize];
+        FormatString(buf, kBufSize, "WARNING: log buffer full, dropped %d messages\n", dropped);
+        SDL_RWwrite(file, buf, 1, strlen(buf));
+    }
+    while(true){
+        int index = SDL_AtomicGet(&read_index);
+        Record& record = records[index & (kNumRecords-1)];
+        // A claimed record may still be being filled in
+        if(SDL_AtomicGet(&record.sequence) != index+1){
+            break;
+        }
+        SDL_MemoryBarrierAcquire();
+        const char* message = record.message;
+        char formatted[kMaxMessageLen];
+        if(record.fmt){
+            FormatPackedArgs(formatted, kMaxMessageLen, record.fmt, record.message);
+            message = formatted;
+        }
+        double seconds = (record.time - init_time) / (double)SDL_GetPerformanceFrequency();
+        SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, 
+            record.level == kLogError ? SDL_LOG_PRIORITY_ERROR : 
+            record.level == kLogWarning ? SDL_LOG_PRIORITY_WARN : SDL_LOG_PRIORITY_INFO,
+            "%s", message);
+        if(file){
+            static const int kBufSize = kMaxMessageLen + 64;
+            char buf[kBufSize];
+            FormatString(buf, kBufSize, "%10.6f\t%lu\t%s\t%s\n", seconds, 
+                (unsigned long)record.thread_id, LogLevelName(record.level), message);
+            SDL_RWwrite(file, buf, 1, strlen(buf));
+        }
+        // Free the record for reuse
+        SDL_AtomicSet(&read_index, index+1);
+        wrote = true;
+    }
+    return wrote;
+}
+
+int Logger::Run() {
+    while(!SDL_AtomicGet(&wants_to_quit)){
+        bool ran_task = RunTask();
+        if(!WriteRecords() && !ran_task){
+            SDL_Delay(5);
+        }
+    }
+    return 0;
+}
+
+int Logger::RunThread(void* logger) {
+    return ((Logger*)logger)->Run();
+}
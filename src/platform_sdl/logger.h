@@ -0,0 +1,66 @@
+#pragma once
+#ifndef PLATFORM_SDL_LOGGER_H
+#define PLATFORM_SDL_LOGGER_H
+
+#include <SDL.h>
+
+enum LogLevel {
+    kLogInfo,
+    kLogWarning,
+    kLogError
+};
+
+// Messages go into a fixed-size ring of records without taking a lock, and
+// a background thread writes them to a file (and SDL_Log) so logging never
+// waits on IO. If the ring fills up, new messages are dropped and counted.
+// Arguments are copied into the record and formatted by the writer thread,
+// so format strings have to outlive the message; use literals.
+// The writer thread can also take one other piece of slow IO at a time.
+class Logger {
+public:
+    typedef void (*TaskFunc)(void* data);
+    // Opens the log file and starts the writer thread
+    bool Init(const char* path);
+    // Writes any remaining messages and stops the writer thread
+    void Dispose();
+    void Log(LogLevel level, const char* fmt, va_list args);
+    // Call func(data) on the writer thread. Returns false without queueing
+    // it if the previous task hasn't finished yet. Only call from one thread.
+    bool QueueTask(TaskFunc func, void* data);
+private:
+    static const int kMaxMessageLen = 232;
+    struct Record {
+        SDL_atomic_t sequence; // Index+1 once written, lets the writer know it's complete
+        int level;
+        Uint64 time;
+        SDL_threadID thread_id;
+        const char* fmt; // If set, message holds the arguments for it instead of text
+        char message[kMaxMessageLen];
+    };
+    static const int kNumRecords = 1024; // Must be a power of two
+    Record records[kNumRecords];
+    SDL_atomic_t write_index; // Next record to claim
+    SDL_atomic_t read_index; // Next record for the writer thread
+    SDL_atomic_t num_dropped;
+    SDL_atomic_t wants_to_quit;
+    SDL_atomic_t task_queued;
+    TaskFunc task_func;
+    void* task_data;
+    Uint64 init_time;
+    SDL_RWops* file;
+    SDL_Thread* thread;
+    int Run();
+    bool WriteRecords();
+    bool RunTask();
+    static int RunThread(void* logger);
+};
+
+// Logger used by LogMessage, NULL to log straight to SDL_Log
+void SetGlobalLogger(Logger* logger);
+void LogMessage(LogLevel level, const char* fmt, ...);
+// Hand slow IO to the global logger's writer thread, or run it right away
+// without one. Returns false if the writer thread is still busy with the
+// last task.
+bool QueueLogWriterTask(Logger::TaskFunc func, void* data);
+
+#endif
@@ -0,0 +1,128 @@
+#include "platform_sdl/perf_counters.h"
+#include "platform_sdl/logger.h"
+#include <cstring>
+
+const char* PerfCounters::GetName(int counter) {
+    switch(counter){
+        case kCycles: return "cycles";
+        case kInstructions: return "instructions";
+        case kL1DataMisses: return "L1d misses";
+        case kLastLevelCacheMisses: return "LLC misses";
+        case kBranchMisses: return "branch misses";
+        default: return "unknown";
+    }
+}
+
+bool PerfCounters::IsAvailable(int counter) {
+    return fds[counter] != -1;
+}
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <errno.h>
+
+static int OpenPerfEvent(Uint32 type, Uint64 config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1 ? 1 : 0; // Leader starts the whole group
+    attr.exclude_kernel = 1; // Allowed at perf_event_paranoid 2, the usual default
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // pid 0, cpu -1: follow the calling thread on any CPU
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+bool PerfCounters::Init() {
+    group_fd = -1;
+    num_open = 0;
+    for(int i=0; i<kNumCounters; ++i){
+        fds[i] = -1;
+    }
+    struct {
+        Uint32 type;
+        Uint64 config;
+    } events[kNumCounters] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | 
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) | 
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    // Cycles lead the group, without them there is nothing worth reporting
+    group_fd = OpenPerfEvent(events[0].type, events[0].config, -1);
+    if(group_fd == -1){
+        LogMessage(kLogWarning, "Hardware performance counters unavailable (perf_event_open: %s)", strerror(errno));
+        return false;
+    }
+    fds[0] = group_fd;
+    num_open = 1;
+    for(int i=1; i<kNumCounters; ++i){
+        // Virtual machines often expose only some of the hardware events
+        fds[i] = OpenPerfEvent(events[i].type, events[i].config, group_fd);
+        if(fds[i] == -1){
+            LogMessage(kLogWarning, "Performance counter \"%s\" unavailable (%s)", GetName(i), strerror(errno));
+        } else {
+            ++num_open;
+        }
+    }
+    ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+void PerfCounters::Dispose() {
+    for(int i=kNumCounters-1; i>=0; --i){
+        if(fds[i] != -1){
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+    group_fd = -1;
+    num_open = 0;
+}
+
+void PerfCounters::Read(Uint64* values) {
+    // PERF_FORMAT_GROUP layout: count, then one value per open event in the
+    // order they were added to the group
+    Uint64 buf[1 + kNumCounters];
+    ssize_t bytes = read(group_fd, buf, sizeof(Uint64) * (1 + num_open));
+    int index = 1;
+    for(int i=0; i<kNumCounters; ++i){
+        if(fds[i] != -1 && bytes > 0 && index <= (int)buf[0]){
+            values[i] = buf[index++];
+        } else {
+            values[i] = 0;
+        }
+    }
+}
+
+#else
+
+bool PerfCounters::Init() {
+    group_fd = -1;
+    num_open = 0;
+    for(int i=0; i<kNumCounters; ++i){
+        fds[i] = -1;
+    }
+    LogMessage(kLogWarning, "Hardware performance counters are only available on Linux");
+    return false;
+}
+
+void PerfCounters::Dispose() {
+}
+
+void PerfCounters::Read(Uint64* values) {
+    for(int i=0; i<kNumCounters; ++i){
+        values[i] = 0;
+    }
+}
+
+#endif
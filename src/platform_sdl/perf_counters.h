@@ -0,0 +1,33 @@
+#pragma once
+#ifndef PLATFORM_SDL_PERF_COUNTERS_H
+#define PLATFORM_SDL_PERF_COUNTERS_H
+
+#include <SDL.h>
+
+// Hardware performance counters for the calling thread, opened as one
+// perf_event group so they are all scheduled and read together. Only
+// implemented on Linux; Init() returns false elsewhere, or when perf events
+// aren't permitted (e.g. perf_event_paranoid or a container's seccomp policy).
+class PerfCounters {
+public:
+    enum Counter {
+        kCycles,
+        kInstructions,
+        kL1DataMisses,
+        kLastLevelCacheMisses,
+        kBranchMisses,
+        kNumCounters
+    };
+    bool Init();
+    void Dispose();
+    // Current value of each counter, counters that failed to open read as 0
+    void Read(Uint64* values);
+    bool IsAvailable(int counter);
+    static const char* GetName(int counter);
+private:
+    int fds[kNumCounters]; // -1 if this counter couldn't be opened
+    int group_fd;
+    int num_open;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "platform_sdl/perf_overlay.h"
+#include "platform_sdl/debug_text.h"
+#include "platform_sdl/error.h"
+#include "platform_sdl/graphics.h"
+#include "platform_sdl/profiler.h"
+#include "internal/common.h"
+#include "internal/memory.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <GL/glew.h>
+#include <cstring>
+
+using namespace glm;
+
+void PerfOverlay::Init(int line_shader, TextAtlas* p_text_atlas, StackAllocator* stack_allocator) {
+    visible = false;
+    text_atlas = p_text_atlas;
+    for(int i=0; i<kNumFrameTimes; ++i){
+        frame_times[i] = 0.0f;
+    }
+    frame_time_index = 0;
+
+    int mem_needed = lines.AllocMemory(NULL);
+    void* mem = stack_allocator->Alloc(mem_needed);
+    if(!mem) {
+        FormattedError("Error", "Could not allocate memory for PerfOverlay lines (%d bytes)", mem_needed);
+        exit(1);
+    }
+    lines.AllocMemory(mem);
+    lines.num_lines = 0;
+    lines.shader = line_shader;
+    lines.vbo = CreateVBO(kArrayVBO, kStreamVBO, NULL,
+                          DebugDrawLines::kMaxLines *
+                          DebugDrawLines::kElementsPerPoint *
+                          2 * sizeof(GLfloat));
+}
+
+void PerfOverlay::AddFrameTime(float milliseconds) {
+    frame_times[frame_time_index] = milliseconds;
+    frame_time_index = (frame_time_index+1)%kNumFrameTimes;
+}
+
+void PerfOverlay::Draw(GraphicsContext* context, Profiler* profiler, const PerfOverlayStats& stats) {
+    if(!visible){
+        return;
+    }
+    PROFILE_SCOPE("Perf overlay");
+    context->gpu_profiler.StartZone("Perf overlay");
+    static const float kGraphWidth = 600.0f;
+    static const float kGraphHeight = 120.0f;
+    static const float kGraphMaxMilliseconds = 50.0f;
+    static const float kTargetMilliseconds = 1000.0f / 60.0f;
+    float graph_left = 40.0f;
+    float graph_bottom = context->screen_dims[1] - 40.0f;
+    float ms_to_pixels = kGraphHeight / kGraphMaxMilliseconds;
+
+    // Frame time graph, oldest frame on the left
+    float frame_time_sum = 0.0f;
+    float frame_time_max = 0.0f;
+    float step = kGraphWidth / (float)kNumFrameTimes;
+    for(int i=0; i<kNumFrameTimes; ++i){
+        float ms = frame_times[(frame_time_index+i)%kNumFrameTimes];
+        frame_time_sum += ms;
+        frame_time_max = max(frame_time_max, ms);
+        vec4 color(0.0f, 1.0f, 0.0f, 1.0f);
+        if(ms > kTargetMilliseconds * 2.0f){
+            color = vec4(1.0f, 0.0f, 0.0f, 1.0f);
+        } else if(ms > kTargetMilliseconds * 1.1f){
+            color = vec4(1.0f, 1.0f, 0.0f, 1.0f);
+        }
+        float x = graph_left + i * step;
+        float height = min(ms, kGraphMaxMilliseconds) * ms_to_pixels;
+        lines.Add(vec3(x, graph_bottom, 0.0f), vec3(x, graph_bottom - height, 0.0f),
+                  color, kDraw, 1);
+    }
+    // Reference lines at 60 and 30 fps
+    for(int i=1; i<=2; ++i){
+        float y = graph_bottom - kTargetMilliseconds * i * ms_to_pixels;
+        lines.Add(vec3(graph_left, y, 0.0f), vec3(graph_left + kGraphWidth, y, 0.0f),
+                  vec4(1.0f, 1.0f, 1.0f, 0.5f), kDraw, 1);
+    }
+
+    // Copy before the overlay's own draws add to it
+    RenderStats render_stats = context->render_stats;
+    static const int kBufSize = 4096;
+    char buf[kBufSize];
+    int len = 0;
+    float last_frame = frame_times[(frame_time_index+kNumFrameTimes-1)%kNumFrameTimes];
+    FormatString(&buf[len], kBufSize-len,
+        "Frame: %.2f ms (avg %.2f, max %.2f)\n"
+        "Memory: %.1f / %.1f MB\n"
+        "Characters: %d  Drawables: %d (%d drawn, %d culled)\n"
+        "Draw calls: %d  Triangles: %d\n"
+        "Binds: %d program, %d texture, %d buffer  Uniforms: %d\n"
+        "Audio buffer: %d%%  Underruns: %d  Latency: %.0f ms\n",
+        last_frame, frame_time_sum / kNumFrameTimes, frame_time_max,
+        stats.memory_used / (1024.0f*1024.0f), stats.memory_size / (1024.0f*1024.0f),
+        stats.characters_alive, stats.num_drawables, 
+        render_stats.drawables_drawn, render_stats.drawables_culled,
+        render_stats.draw_calls, render_stats.triangles,
+        render_stats.program_binds, render_stats.texture_binds, 
+        render_stats.buffer_binds, render_stats.uniform_uploads,
+        (int)(stats.audio_buffer_fill * 100.0f), stats.audio_underruns, 
+        stats.audio_latency_milliseconds);
+    len += strlen(&buf[len]);
+
+    static const int kMaxZones = 64;
+    ProfilerZone zones[kMaxZones];
+    int num_zones = profiler->GetLastFrameZones(zones, kMaxZones);
+    for(int i=0; i<num_zones && len < kBufSize-1; ++i){
+        static const int kMaxIndent = 16;
+        int indent = min(zones[i].depth * 2, kMaxIndent);
+        FormatString(&buf[len], kBufSize-len, "%*s%s: %.3f ms\n",
+            indent, "", zones[i].label, zones[i].milliseconds);
+        len += strlen(&buf[len]);
+    }
+    // GPU results lag a few frames behind, see GpuProfiler
+    num_zones = context->gpu_profiler.GetLastFrameZones(zones, kMaxZones);
+    if(num_zones > 0 && len < kBufSize-1){
+        FormatString(&buf[len], kBufSize-len, "GPU (%d frames dropped)\n", 
+            context->gpu_profiler.num_dropped_frames);
+        len += strlen(&buf[len]);
+    }
+    for(int i=0; i<num_zones && len < kBufSize-1; ++i){
+        static const int kMaxIndent = 16;
+        int indent = min(zones[i].depth * 2 + 2, kMaxIndent);
+        FormatString(&buf[len], kBufSize-len, "%*s%s: %.3f ms\n",
+            indent, "", zones[i].label, zones[i].milliseconds);
+        len += strlen(&buf[len]);
+    }
+
+    glDisable(GL_DEPTH_TEST);
+    mat4 proj_mat = ortho(0.0f, (float)context->screen_dims[0],
+        (float)context->screen_dims[1], 0.0f, -1.0f, 1.0f);
+    lines.Draw(context, profiler, proj_mat);
+    DrawText(text_atlas, context, context->screen_dims[0] - 440.0f, 40.0f, buf);
+    glEnable(GL_DEPTH_TEST);
+    context->gpu_profiler.EndZone();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef PLATFORM_SDL_PERF_OVERLAY_H
+#define PLATFORM_SDL_PERF_OVERLAY_H
+
+#include "platform_sdl/debug_draw.h"
+
+struct GraphicsContext;
+struct TextAtlas;
+class Profiler;
+class StackAllocator;
+
+// Numbers gathered by the game loop each frame for display
+struct PerfOverlayStats {
+    int memory_used;
+    int memory_size;
+    int characters_alive;
+    int num_drawables;
+    float audio_buffer_fill; // Fraction of the current audio buffer not yet played
+    int audio_underruns;
+    float audio_latency_milliseconds;
+};
+
+// Toggleable on-screen frame time graph, profiler zones and engine stats
+struct PerfOverlay {
+    bool visible;
+    static const int kNumFrameTimes = 300;
+    float frame_times[kNumFrameTimes]; // milliseconds
+    int frame_time_index;
+    DebugDrawLines lines;
+    TextAtlas* text_atlas;
+
+    void Init(int line_shader, TextAtlas* text_atlas, StackAllocator* stack_allocator);
+    void AddFrameTime(float milliseconds);
+    void Draw(GraphicsContext* context, Profiler* profiler, const PerfOverlayStats& stats);
+};
+
+#endif
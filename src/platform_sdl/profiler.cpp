@@ -1,40 +1,286 @@
 #include "platform_sdl/profiler.h"
 #include "platform_sdl/error.h"
+#include "platform_sdl/logger.h"
 #include "internal/common.h"
 #include <cstring>
+#include <cstdarg>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Reading the TSC is several times cheaper than SDL_GetPerformanceCounter, 
+// which keeps zone overhead low. Assumes an invariant TSC (any recent x86).
+static inline Uint64 GetTimestamp() {
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+// Cached lookup of the calling thread's buffer, cheaper than SDL_TLSGet.
+// NULL with the owner set means the thread couldn't get a buffer.
+static PROFILER_THREAD_LOCAL Profiler* thread_buffer_owner = NULL;
+static PROFILER_THREAD_LOCAL void* thread_buffer = NULL;
+
+static Profiler* global_profiler = NULL;
+
+void SetGlobalProfiler(Profiler* profiler) {
+    global_profiler = profiler;
+}
+
+Profiler* GetGlobalProfiler() {
+    return global_profiler;
+}
+
+static const int kMaxInternedLabels = 256;
+static const char* interned_labels[kMaxInternedLabels];
+static int num_interned_labels = 0;
+static SDL_SpinLock interned_labels_lock = 0;
+
+const char* InternProfileLabel(const char* label) {
+    // Only called once per PROFILE_SCOPE call site, so the lock is fine here
+    const char* interned = label;
+    SDL_AtomicLock(&interned_labels_lock);
+    bool found = false;
+    for(int i=0; i<num_interned_labels; ++i){
+        if(strcmp(interned_labels[i], label) == 0){
+            interned = interned_labels[i];
+            found = true;
+            break;
+        }
+    }
+    if(!found && num_interned_labels < kMaxInternedLabels){
+        interned_labels[num_interned_labels++] = label;
+    }
+    SDL_AtomicUnlock(&interned_labels_lock);
+    return interned;
+}
 
 void Profiler::Init() {
-    curr_event = -1;
-    event_stack_depth = 0;
-    num_events = 0;
+    SDL_AtomicSet(&num_events_reserved, 0);
+    SDL_AtomicSet(&num_events_committed, 0);
+    SDL_AtomicSet(&num_thread_buffers, 0);
+    thread_buffer_tls = SDL_TLSCreate();
+    num_counters = 0;
+    num_frame_markers = 0;
+    num_last_frame_events = 0;
+    init_time = GetTimestamp();
+    init_perf_counter = SDL_GetPerformanceCounter();
+    main_thread_id = SDL_ThreadID();
+    perf_counters = NULL;
+    perf_counters_thread_id = 0;
+    has_gpu_events = false;
+    SetThreadName("Main thread");
 }
 
-void Profiler::StartEvent(const char* txt) {
-    if(num_events < kMaxEvents && event_stack_depth < kMaxEventStackDepth){
-        curr_event = num_events;
-        event_stack[event_stack_depth] = curr_event;
-        Event& event = events[num_events++];
-        event.start_time = SDL_GetPerformanceCounter();
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer() {
+    if(thread_buffer_owner == this){
+        return (ThreadBuffer*)thread_buffer;
+    }
+    ThreadBuffer* buffer = (ThreadBuffer*)SDL_TLSGet(thread_buffer_tls);
+    if(!buffer){
+        // First event on this thread, claim a buffer
+        int index = SDL_AtomicAdd(&num_thread_buffers, 1);
+        if(index >= kMaxThreads){
+            // Remember, so this thread's events skip straight past the atomics
+            SDL_AtomicAdd(&num_thread_buffers, -1);
+            thread_buffer_owner = this;
+            thread_buffer = NULL;
+            LogMessage(kLogWarning, "Profiler is out of thread buffers, thread %lu won't be profiled",
+                       (unsigned long)SDL_ThreadID());
+            return NULL;
+        }
+        buffer = &thread_buffers[index];
+        buffer->thread_id = SDL_ThreadID();
+        buffer->name = NULL;
+        buffer->num_events = 0;
+        buffer->event_stack_depth = 0;
+        buffer->num_skipped_events = 0;
+        SDL_TLSSet(thread_buffer_tls, buffer, NULL);
+    }
+    thread_buffer_owner = this;
+    thread_buffer = buffer;
+    return buffer;
+}
+
+int Profiler::GetCurrentZones(const char** labels, int max_labels) {
+    // Only use the cached buffer, claiming one is not async-signal-safe
+    if(thread_buffer_owner != this || !thread_buffer){
+        return 0;
+    }
+    ThreadBuffer* buffer = (ThreadBuffer*)thread_buffer;
+    int num_labels = min(buffer->event_stack_depth, max_labels);
+    for(int i=0; i<num_labels; ++i){
+        labels[i] = buffer->events[buffer->event_stack[i]].label;
+    }
+    return num_labels;
+}
+
+void Profiler::SetPerfCounters(PerfCounters* p_perf_counters) {
+    perf_counters = p_perf_counters;
+    perf_counters_thread_id = SDL_ThreadID();
+}
+
+void Profiler::SetThreadName(const char* name) {
+    ThreadBuffer* buffer = GetThreadBuffer();
+    if(buffer){
+        buffer->name = name;
+    }
+}
+
+Profiler::ThreadBuffer* Profiler::StartEvent(const char* txt) {
+    ThreadBuffer* buffer = GetThreadBuffer();
+    if(buffer && 
+       buffer->num_events < ThreadBuffer::kMaxBufferedEvents && 
+       buffer->event_stack_depth < kMaxEventStackDepth)
+    {
+        buffer->event_stack[buffer->event_stack_depth] = buffer->num_events;
+        Event& event = buffer->events[buffer->num_events++];
         event.label = txt;
-        event.depth = event_stack_depth++;
+        event.thread_id = buffer->thread_id;
+        event.depth = buffer->event_stack_depth;
+        event.end_time = 0;
+        event.has_hw_counters = perf_counters && buffer->thread_id == perf_counters_thread_id;
+        // GetCurrentZones can run in a signal handler on this thread, so the
+        // event must be filled in before it becomes visible on the stack
+        SDL_CompilerBarrier();
+        ++buffer->event_stack_depth;
+        event.start_time = GetTimestamp();
+        // Read last so the syscall is mostly outside the event
+        if(event.has_hw_counters){
+            perf_counters->Read(event.hw_counters);
+        }
+    } else if(buffer) {
+        // Remember to ignore the matching EndEvent
+        ++buffer->num_skipped_events;
     }
+    return buffer;
 }
 
 void Profiler::EndEvent() {
-    if(event_stack_depth > 0 && curr_event != -1){
-        Event& event = events[curr_event];
-        event.end_time = SDL_GetPerformanceCounter();
-        --event_stack_depth;
-        if(event_stack_depth > 0){
-            curr_event = event_stack[event_stack_depth-1];
-        } else {
-            curr_event = -1;
+    EndEvent(GetThreadBuffer());
+}
+
+void Profiler::EndEvent(ThreadBuffer* buffer) {
+    if(buffer && buffer->num_skipped_events > 0){
+        --buffer->num_skipped_events;
+    } else if(buffer && buffer->event_stack_depth > 0){
+        Event& event = buffer->events[buffer->event_stack[--buffer->event_stack_depth]];
+        if(event.has_hw_counters){
+            Uint64 values[PerfCounters::kNumCounters];
+            perf_counters->Read(values);
+            for(int i=0; i<PerfCounters::kNumCounters; ++i){
+                event.hw_counters[i] = values[i] - event.hw_counters[i];
+            }
+        }
+        event.end_time = GetTimestamp();
+        if(buffer->event_stack_depth == 0){
+            Flush(buffer);
+        }
+    }
+}
+
+// Called when the outermost event of a thread ends, so every buffered event is complete
+void Profiler::Flush(ThreadBuffer* buffer) {
+    int num = buffer->num_events;
+    buffer->num_events = 0;
+    if(buffer->thread_id == main_thread_id){
+        memcpy(last_frame_events, buffer->events, sizeof(Event) * num);
+        num_last_frame_events = num;
+    }
+    AppendEvents(buffer->events, num);
+}
+
+void Profiler::AppendEvents(const Event* new_events, int num) {
+    if(SDL_AtomicGet(&num_events_reserved) >= kMaxEvents){
+        return;
+    }
+    int start = SDL_AtomicAdd(&num_events_reserved, num);
+    int num_copied = 0;
+    if(start < kMaxEvents){
+        num_copied = min(num, kMaxEvents - start);
+        memcpy(&events[start], new_events, sizeof(Event) * num_copied);
+    }
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&num_events_committed, num_copied);
+}
+
+void Profiler::RecordGpuEvent(const char* label, int depth, Uint64 start_perf_counter, Uint64 end_perf_counter) {
+    const double kPerfCounterToTicks = GetTicksPerSecond() / (double)SDL_GetPerformanceFrequency();
+    Event event;
+    event.label = label;
+    event.depth = depth;
+    event.thread_id = kGpuThreadId;
+    event.start_time = init_time + (Sint64)(((Sint64)start_perf_counter - (Sint64)init_perf_counter) * kPerfCounterToTicks);
+    event.end_time = init_time + (Sint64)(((Sint64)end_perf_counter - (Sint64)init_perf_counter) * kPerfCounterToTicks);
+    event.has_hw_counters = false;
+    has_gpu_events = true;
+    AppendEvents(&event, 1);
+}
+
+// Waits for in-progress flushes from other threads to finish copying
+int Profiler::GetNumCommittedEvents() {
+    int num_reserved = min(SDL_AtomicGet(&num_events_reserved), kMaxEvents);
+    while(SDL_AtomicGet(&num_events_committed) < num_reserved){
+        SDL_Delay(0);
+    }
+    SDL_MemoryBarrierAcquire();
+    return num_reserved;
+}
+
+// Timestamp rate, measured against SDL's counter over the whole run so far
+double Profiler::GetTicksPerSecond() {
+    Uint64 perf_counter = SDL_GetPerformanceCounter();
+    Uint64 time = GetTimestamp();
+    if(perf_counter == init_perf_counter){
+        return (double)SDL_GetPerformanceFrequency();
+    }
+    return (double)(time - init_time) * (double)SDL_GetPerformanceFrequency() / 
+           (double)(perf_counter - init_perf_counter);
+}
+
+int Profiler::GetLastFrameZones(ProfilerZone* zones, int max_zones) {
+    const double kTicksToMilliseconds = 1000.0 / GetTicksPerSecond();
+    int num_zones = min(num_last_frame_events, max_zones);
+    for(int i=0; i<num_zones; ++i){
+        Event& event = last_frame_events[i];
+        zones[i].label = event.label;
+        zones[i].depth = event.depth;
+        zones[i].milliseconds = (float)((event.end_time - event.start_time) * kTicksToMilliseconds);
+    }
+    return num_zones;
+}
+
+void Profiler::MarkFrame() {
+    if(num_frame_markers < kMaxFrameMarkers){
+        frame_markers[num_frame_markers++] = GetTimestamp();
+    }
+}
+
+void Profiler::RecordCounter(const char* label, double value) {
+    if(num_counters < kMaxCounters){
+        Counter& counter = counters[num_counters++];
+        counter.label = label;
+        counter.time = GetTimestamp();
+        counter.value = value;
+        if(num_counters == kMaxCounters){
+            LogMessage(kLogWarning, "Profiler counter samples full, dropping the rest");
         }
     }
 }
 
 void Profiler::Export(const char* filename) {
-    const int kPerfCountToMicroseconds = (int)(SDL_GetPerformanceFrequency() / 1000000);
+    const double kPerfCountToMicroseconds = GetTicksPerSecond() / 1000000.0;
+    int num_events = GetNumCommittedEvents();
     SDL_RWops* file = SDL_RWFromFile(filename, "w");
     if(file){
         static const int kBufSize = 1024;
@@ -50,7 +296,25 @@ void Profiler::Export(const char* filename) {
                 }
             }
             int microseconds = (int)((event.end_time - event.start_time) / kPerfCountToMicroseconds);
-            FormatString(&buf[index], kBufSize-index, "%s: %d us\n", events[i].label, microseconds);
+            FormatString(&buf[index], kBufSize-index, "%s%s: %d us", 
+                event.thread_id == kGpuThreadId ? "[GPU] " : "", events[i].label, microseconds);
+            if(event.has_hw_counters){
+                for(int j=0; j<PerfCounters::kNumCounters; ++j){
+                    if(perf_counters->IsAvailable(j)){
+                        index = strlen(buf);
+                        FormatString(&buf[index], kBufSize-index, ", %s %llu", 
+                            PerfCounters::GetName(j), (unsigned long long)event.hw_counters[j]);
+                    }
+                }
+                if(event.hw_counters[PerfCounters::kCycles] > 0){
+                    index = strlen(buf);
+                    FormatString(&buf[index], kBufSize-index, ", IPC %.2f", 
+                        (double)event.hw_counters[PerfCounters::kInstructions] / 
+                        (double)event.hw_counters[PerfCounters::kCycles]);
+                }
+            }
+            index = strlen(buf);
+            FormatString(&buf[index], kBufSize-index, "\n");
             SDL_RWwrite(file, buf, 1, strlen(buf));
         }
         if(num_events == kMaxEvents){
@@ -62,3 +326,91 @@ void Profiler::Export(const char* filename) {
         FormattedError("Error", "Could not open %s for writing", filename);
     }
 }
+
+static void WriteFormatted(SDL_RWops* file, const char* fmt, ...) {
+    static const int kBufSize = 1024;
+    char buf[kBufSize];
+    va_list args;
+    va_start(args, fmt);
+    VFormatString(buf, kBufSize, fmt, args);
+    va_end(args);
+    SDL_RWwrite(file, buf, 1, strlen(buf));
+}
+
+// Labels are string literals, but escape them anyway so the JSON stays valid
+static void EscapeJSON(const char* str, char* buf, int buf_size) {
+    int index = 0;
+    for(const char* c = str; *c != '\0' && index < buf_size-2; ++c){
+        if(*c == '"' || *c == '\\'){
+            buf[index++] = '\\';
+        }
+        if((unsigned char)*c >= 32){
+            buf[index++] = *c;
+        }
+    }
+    buf[index] = '\0';
+}
+
+void Profiler::ExportChromeTrace(const char* filename) {
+    // Trace-event timestamps are in microseconds
+    const double kTicksToMicroseconds = 1000000.0 / GetTicksPerSecond();
+    int num_events = GetNumCommittedEvents();
+    SDL_RWops* file = SDL_RWFromFile(filename, "w");
+    if(file){
+        static const int kLabelSize = 256;
+        char label[kLabelSize];
+        WriteFormatted(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        WriteFormatted(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"UnderGlass\"}}");
+        // Name each thread that produced events so it gets its own track
+        for(int i=0, len=min(SDL_AtomicGet(&num_thread_buffers), kMaxThreads); i<len; ++i){
+            ThreadBuffer& buffer = thread_buffers[i];
+            EscapeJSON(buffer.name ? buffer.name : "Thread", label, kLabelSize);
+            WriteFormatted(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                (unsigned long)buffer.thread_id, label);
+        }
+        if(has_gpu_events){
+            WriteFormatted(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"GPU\"}}",
+                (unsigned long)kGpuThreadId);
+        }
+        for(int i=0; i<num_events; ++i){
+            Event& event = events[i];
+            Uint64 end_time = event.end_time;
+            if(end_time < event.start_time){
+                end_time = event.start_time; // Event was never closed
+            }
+            EscapeJSON(event.label, label, kLabelSize);
+            WriteFormatted(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f",
+                label, (unsigned long)event.thread_id,
+                (event.start_time - init_time) * kTicksToMicroseconds,
+                (end_time - event.start_time) * kTicksToMicroseconds);
+            // Hardware counters show up in the selected event's details
+            if(event.has_hw_counters){
+                const char* separator = ",\"args\":{";
+                for(int j=0; j<PerfCounters::kNumCounters; ++j){
+                    if(perf_counters->IsAvailable(j)){
+                        WriteFormatted(file, "%s\"%s\":%llu", separator, 
+                            PerfCounters::GetName(j), (unsigned long long)event.hw_counters[j]);
+                        separator = ",";
+                    }
+                }
+                WriteFormatted(file, "}");
+            }
+            WriteFormatted(file, "}");
+        }
+        for(int i=0; i<num_frame_markers; ++i){
+            WriteFormatted(file, ",\n{\"name\":\"Frame %d\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f}",
+                i, (unsigned long)main_thread_id,
+                (frame_markers[i] - init_time) * kTicksToMicroseconds);
+        }
+        for(int i=0; i<num_counters; ++i){
+            Counter& counter = counters[i];
+            EscapeJSON(counter.label, label, kLabelSize);
+            WriteFormatted(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+                label, (counter.time - init_time) * kTicksToMicroseconds, counter.value);
+        }
+        WriteFormatted(file, "\n]}\n");
+        SDL_RWclose(file);
+    } else {
+        FormattedError("Error", "Could not open %s for writing", filename);
+    }
+}
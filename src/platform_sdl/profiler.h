@@ -2,29 +2,150 @@
 #ifndef PROFILER_HPP
 #define PROFILER_HPP
 
+#include "platform_sdl/perf_counters.h"
+#include "internal/job_system.h"
 #include <SDL.h>
 
+struct ProfilerZone {
+    const char* label;
+    int depth;
+    float milliseconds;
+};
+
+// Events can be recorded from any thread. Each thread collects its events in
+// its own buffer and copies them into the shared event list whenever its
+// outermost event ends, so recording never takes a lock.
 class Profiler {
 public:
+    struct ThreadBuffer;
     void Init();
-    void StartEvent(const char* txt);
+    // Returns the calling thread's buffer, NULL if it couldn't get one.
+    // Passing it back to EndEvent saves looking it up again.
+    ThreadBuffer* StartEvent(const char* txt);
     void EndEvent();
+    void EndEvent(ThreadBuffer* buffer);
+    // Labels of the calling thread's open events, outermost first. 
+    // Async-signal-safe, for use by the sampling profiler.
+    int GetCurrentZones(const char** labels, int max_labels);
+    // Attribute hardware counter deltas to events recorded on the calling
+    // thread, which must be the thread perf_counters was initialized on
+    void SetPerfCounters(PerfCounters* perf_counters);
+    // Add an already finished GPU zone to its own track, times are
+    // SDL_GetPerformanceCounter values
+    void RecordGpuEvent(const char* label, int depth, Uint64 start_perf_counter, Uint64 end_perf_counter);
+    // Name the calling thread's track in exported traces
+    void SetThreadName(const char* name);
+    // Instant marker at the start of each frame (main thread only)
+    void MarkFrame();
+    // Sample a named value, shown as a counter track in trace viewers (main thread only)
+    void RecordCounter(const char* label, double value);
+    // Samples per frame that fit for as many frames as get a MarkFrame()
+    static const int kMaxCountersPerFrame = 32;
+    // Events from the main thread's most recently completed outermost event,
+    // which is the last frame once the game loop is running
+    int GetLastFrameZones(ProfilerZone* zones, int max_zones);
     void Export( const char* filename );
+    // Chrome trace-event JSON, load in chrome://tracing or ui.perfetto.dev
+    void ExportChromeTrace( const char* filename );
 private:
     struct Event {
         const char* label;
         int depth;
+        SDL_threadID thread_id;
         Uint64 start_time;
         Uint64 end_time;
+        bool has_hw_counters;
+        // Values at the start of the event, then the deltas once it ends
+        Uint64 hw_counters[PerfCounters::kNumCounters];
     };
-    static const int kMaxEvents = 1024;
-    Event events[kMaxEvents];
-    int num_events;
     static const int kMaxEventStackDepth = 32;
-    int event_stack[kMaxEventStackDepth];
-    int event_stack_depth;
-    int curr_event;
+public:
+    // Only Profiler looks inside, public so PROFILE_SCOPE can hold on to one
+    struct ThreadBuffer {
+        SDL_threadID thread_id;
+        const char* name;
+        static const int kMaxBufferedEvents = 512;
+        Event events[kMaxBufferedEvents];
+        int num_events;
+        int event_stack[kMaxEventStackDepth];
+        int event_stack_depth;
+        int num_skipped_events;
+    };
+private:
+    ThreadBuffer* GetThreadBuffer();
+    void Flush(ThreadBuffer* buffer);
+    void AppendEvents(const Event* new_events, int num);
+    int GetNumCommittedEvents();
+    double GetTicksPerSecond();
+
+    static const int kMaxEvents = 16384;
+    Event events[kMaxEvents];
+    SDL_atomic_t num_events_reserved;
+    SDL_atomic_t num_events_committed;
+    Event last_frame_events[ThreadBuffer::kMaxBufferedEvents];
+    int num_last_frame_events;
+    // Every job worker, plus the main, file loader, audio and log writer threads
+    static const int kMaxThreads = JobSystem::kMaxWorkers + 4;
+    ThreadBuffer thread_buffers[kMaxThreads];
+    SDL_atomic_t num_thread_buffers;
+    SDL_TLSID thread_buffer_tls;
+
+    struct Counter {
+        const char* label;
+        Uint64 time;
+        double value;
+    };
+    static const int kMaxFrameMarkers = 1024;
+    static const int kMaxCounters = kMaxFrameMarkers * kMaxCountersPerFrame;
+    Counter counters[kMaxCounters];
+    int num_counters;
+    Uint64 frame_markers[kMaxFrameMarkers];
+    int num_frame_markers;
+    Uint64 init_time;
+    Uint64 init_perf_counter;
+    SDL_threadID main_thread_id;
+    static const SDL_threadID kGpuThreadId = 0; // Not a valid thread ID on any platform
+    bool has_gpu_events;
+    PerfCounters* perf_counters;
+    SDL_threadID perf_counters_thread_id;
+};
+
+// Profiler used by PROFILE_SCOPE, set once before any other threads start
+void SetGlobalProfiler(Profiler* profiler);
+Profiler* GetGlobalProfiler();
+// Returns one shared pointer per distinct label string, so zones can be
+// compared and grouped by pointer
+const char* InternProfileLabel(const char* label);
+
+class ProfileScope {
+public:
+    ProfileScope(const char* label) {
+        profiler = GetGlobalProfiler();
+        buffer = profiler ? profiler->StartEvent(label) : NULL;
+    }
+    ~ProfileScope() {
+        if(buffer){
+            profiler->EndEvent(buffer);
+        }
+    }
+private:
+    Profiler* profiler;
+    Profiler::ThreadBuffer* buffer;
 };
 
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// PROFILE_SCOPE("label") times the rest of the enclosing block
+#ifdef ENABLE_PROFILER
+#define PROFILE_SCOPE(label) \
+    static const char* PROFILE_CONCAT(profile_label_, __LINE__) = InternProfileLabel(label); \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_label_, __LINE__))
+#define PROFILE_THREAD_NAME(name) \
+    if(GetGlobalProfiler()) GetGlobalProfiler()->SetThreadName(name)
+#else
+#define PROFILE_SCOPE(label)
+#define PROFILE_THREAD_NAME(name)
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,231 @@
+#include "platform_sdl/sampling_profiler.h"
+#include "platform_sdl/logger.h"
+#include "platform_sdl/profiler.h"
+#include "platform_sdl/error.h"
+#include "internal/common.h"
+#include <SDL.h>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+
+// The signal handler can't take arguments, so the active sampler lives here
+static SamplingProfiler::Sample* sample_buffer = NULL;
+static int sample_buffer_size = 0;
+static volatile int num_samples = 0;
+static Profiler* sample_profiler = NULL;
+static timer_t sample_timer;
+
+// Runs on the interrupted thread, must stay async-signal-safe
+static void SampleSignalHandler(int, siginfo_t*, void*) {
+    int saved_errno = errno;
+    int index = __sync_fetch_and_add(&num_samples, 1);
+    if(index < sample_buffer_size){
+        SamplingProfiler::Sample& sample = sample_buffer[index];
+        sample.num_zones = sample_profiler->GetCurrentZones(sample.zones, SamplingProfiler::kMaxZones);
+        sample.num_frames = backtrace(sample.frames, SamplingProfiler::kMaxFrames);
+    }
+    errno = saved_errno;
+}
+
+bool SamplingProfiler::Start(Profiler* profiler, int samples_per_second) {
+    running = false;
+    samples = (Sample*)calloc(kMaxSamples, sizeof(Sample));
+    if(!samples){
+        LogMessage(kLogError, "Could not allocate memory for sampling profiler");
+        return false;
+    }
+    // backtrace() loads libgcc on first use, which isn't safe inside a signal handler
+    void* warm_up[1];
+    backtrace(warm_up, 1);
+
+    sample_buffer = samples;
+    sample_buffer_size = kMaxSamples;
+    num_samples = 0;
+    sample_profiler = profiler;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = SampleSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGPROF, &action, NULL) != 0){
+        LogMessage(kLogError, "sigaction failed: %s", strerror(errno));
+        free(samples);
+        samples = NULL;
+        return false;
+    }
+    // Counts CPU time of the whole process, the signal goes to a thread that is using it
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if(timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &sample_timer) != 0){
+        LogMessage(kLogError, "timer_create failed: %s", strerror(errno));
+        signal(SIGPROF, SIG_IGN);
+        free(samples);
+        samples = NULL;
+        return false;
+    }
+    struct itimerspec timer_spec;
+    long interval_ns = 1000000000L / max(1, samples_per_second);
+    timer_spec.it_interval.tv_sec = interval_ns / 1000000000L;
+    timer_spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+    timer_spec.it_value = timer_spec.it_interval;
+    timer_settime(sample_timer, 0, &timer_spec, NULL);
+    running = true;
+    return true;
+}
+
+void SamplingProfiler::Stop() {
+    if(running){
+        timer_delete(sample_timer);
+        signal(SIGPROF, SIG_IGN);
+        running = false;
+    }
+}
+
+static int CompareSamples(const void* a_ptr, const void* b_ptr) {
+    const SamplingProfiler::Sample* a = *(const SamplingProfiler::Sample**)a_ptr;
+    const SamplingProfiler::Sample* b = *(const SamplingProfiler::Sample**)b_ptr;
+    if(a->num_zones != b->num_zones){
+        return a->num_zones < b->num_zones ? -1 : 1;
+    }
+    for(int i=0; i<a->num_zones; ++i){
+        if(a->zones[i] != b->zones[i]){
+            return a->zones[i] < b->zones[i] ? -1 : 1;
+        }
+    }
+    if(a->num_frames != b->num_frames){
+        return a->num_frames < b->num_frames ? -1 : 1;
+    }
+    for(int i=0; i<a->num_frames; ++i){
+        if(a->frames[i] != b->frames[i]){
+            return a->frames[i] < b->frames[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Turn a backtrace_symbols() entry like "path/bin(_Z3foov+0x1a) [0x4005d4]"
+// into "foo()", or "bin+0x1a" when the function name isn't exported
+static void SymbolName(const char* symbol, char* buf, int buf_size) {
+    const char* open = strchr(symbol, '(');
+    const char* plus = open ? strchr(open, '+') : NULL;
+    if(open && plus && plus > open+1){
+        static const int kMangledSize = 512;
+        char mangled[kMangledSize];
+        int len = min((int)(plus - open - 1), kMangledSize-1);
+        memcpy(mangled, open+1, len);
+        mangled[len] = '\0';
+        int status;
+        char* demangled = abi::__cxa_demangle(mangled, NULL, NULL, &status);
+        FormatString(buf, buf_size, "%s", (status == 0 && demangled) ? demangled : mangled);
+        free(demangled);
+    } else {
+        const char* name_start = symbol;
+        for(const char* c = symbol; *c != '\0' && *c != '('; ++c){
+            if(*c == '/'){
+                name_start = c+1;
+            }
+        }
+        const char* close = open ? strchr(open, ')') : NULL;
+        if(open && close){
+            FormatString(buf, buf_size, "%.*s%.*s", (int)(open - name_start), name_start,
+                         (int)(close - open - 1), open+1);
+        } else {
+            FormatString(buf, buf_size, "%s", symbol);
+        }
+    }
+    // ';' separates frames in the folded format
+    for(char* c = buf; *c != '\0'; ++c){
+        if(*c == ';'){
+            *c = ':';
+        }
+    }
+}
+
+void SamplingProfiler::ExportFoldedStacks(const char* filename) {
+    if(!samples){
+        return;
+    }
+    int count = min((int)num_samples, kMaxSamples);
+    Sample** sorted = (Sample**)malloc(sizeof(Sample*) * max(count, 1));
+    if(!sorted){
+        FormattedError("Error", "Could not allocate memory to export samples");
+        return;
+    }
+    for(int i=0; i<count; ++i){
+        sorted[i] = &samples[i];
+    }
+    qsort(sorted, count, sizeof(Sample*), CompareSamples);
+
+    SDL_RWops* file = SDL_RWFromFile(filename, "w");
+    if(file){
+        // Skip the signal handler and the kernel's signal return trampoline
+        static const int kSkipFrames = 2;
+        static const int kLineSize = 8192;
+        static const int kSymbolSize = 512;
+        char line[kLineSize];
+        char symbol[kSymbolSize];
+        for(int i=0; i<count;){
+            int run_end = i+1;
+            while(run_end < count && CompareSamples(&sorted[i], &sorted[run_end]) == 0){
+                ++run_end;
+            }
+            const Sample* sample = sorted[i];
+            int len = 0;
+            line[0] = '\0';
+            if(sample->num_zones == 0){
+                FormatString(line, kLineSize, "[no zone]");
+                len = strlen(line);
+            }
+            for(int j=0; j<sample->num_zones && len < kLineSize-1; ++j){
+                FormatString(&line[len], kLineSize-len, j==0?"%s":";%s", sample->zones[j]);
+                len += strlen(&line[len]);
+            }
+            char** symbols = backtrace_symbols(sample->frames, sample->num_frames);
+            for(int j=sample->num_frames-1; j>=kSkipFrames && len < kLineSize-1; --j){
+                if(symbols){
+                    SymbolName(symbols[j], symbol, kSymbolSize);
+                } else {
+                    FormatString(symbol, kSymbolSize, "%p", sample->frames[j]);
+                }
+                FormatString(&line[len], kLineSize-len, ";%s", symbol);
+                len += strlen(&line[len]);
+            }
+            free(symbols);
+            FormatString(&line[len], kLineSize-len, " %d\n", run_end - i);
+            SDL_RWwrite(file, line, 1, strlen(line));
+            i = run_end;
+        }
+        SDL_RWclose(file);
+    } else {
+        FormattedError("Error", "Could not open %s for writing", filename);
+    }
+    free(sorted);
+    free(samples);
+    samples = NULL;
+}
+
+#else
+
+bool SamplingProfiler::Start(Profiler*, int) {
+    samples = NULL;
+    running = false;
+    LogMessage(kLogWarning, "Sampling profiler is only available on Linux");
+    return false;
+}
+
+void SamplingProfiler::Stop() {
+}
+
+void SamplingProfiler::ExportFoldedStacks(const char*) {
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef PLATFORM_SDL_SAMPLING_PROFILER_H
+#define PLATFORM_SDL_SAMPLING_PROFILER_H
+
+class Profiler;
+
+// Periodically interrupts whichever thread is using CPU and records its call
+// stack along with the Profiler events open on that thread. Only implemented
+// on Linux (SIGPROF from a CPU-time timer_create timer); Start() returns
+// false elsewhere.
+class SamplingProfiler {
+public:
+    bool Start(Profiler* profiler, int samples_per_second);
+    void Stop();
+    // One line per unique stack: "zone;...;zone;frame;...;frame count",
+    // root first, the input format of flamegraph.pl and speedscope
+    void ExportFoldedStacks(const char* filename);
+    static const int kMaxFrames = 24;
+    static const int kMaxZones = 8;
+    struct Sample {
+        int num_zones;
+        int num_frames;
+        const char* zones[kMaxZones];
+        void* frames[kMaxFrames];
+    };
+private:
+    static const int kMaxSamples = 16384;
+    Sample* samples;
+    bool running;
+};
+
+#endif